@@ -1,39 +1,87 @@
 #include "AST.h"
+#include "Engine.h"
+#include "Format.h"
+#include "Memory.h"
+
 #include <cmath>
+#include <cstring>
 
 using namespace AST;
 
-std::string Value::GetText(const ISheet &) const {
-    std::ostringstream ss;
-    ss << value_;
-    return ss.str();
+std::string Node::GetText(const ISheet &) const {
+    std::string text;
+    NumberFormatter formatter;
+    AppendText(text, formatter);
+    return text;
+}
+
+void Value::AppendText(std::string & out, NumberFormatter & formatter) const {
+    formatter.Append(value_, out);
 }
 
-std::string Cell::GetText(const ISheet & sheet) const {
-    auto text = pos_.ToString();
+void Cell::AppendText(std::string & out, NumberFormatter &) const {
     if (pos_.row < 0 || pos_.col < 0)
-        text = FormulaError(FormulaError::Category::Ref).ToString();
+        out += FormulaError(FormulaError::Category::Ref).ToString();
     else
-        text = pos_.ToString();
-    return text;
+        out += pos_.ToString();
 }
 
-IFormula::Value Cell::Evaluate(const ISheet & sheet) const {
-    if (pos_.row < 0 || pos_.col < 0){
-        return FormulaError::Category::Ref;
+namespace {
+    template <typename T>
+    void Put(Program & program, T const & value) {
+        auto bytes = reinterpret_cast<uint8_t const *>(&value);
+        program.insert(program.end(), bytes, bytes + sizeof(T));
+    }
+
+    void Put(Program & program, OpCode code) {
+        program.push_back(static_cast<uint8_t>(code));
     }
-    auto cell = sheet.GetCell(pos_);
-    if (!cell)
-        return static_cast<double>(0.0);
+}
+
+void Value::Compile(Program & program) const {
+    Put(program, OpCode::Number);
+    Put(program, value_);
+}
+
+size_t Value::MemoryUsage() const {
+    return memory::SharedBytes<Value>();
+}
+
+void Cell::Compile(Program & program) const {
+    Put(program, OpCode::Cell);
+    Put(program, static_cast<int32_t>(pos_.row));
+    Put(program, static_cast<int32_t>(pos_.col));
+}
 
-    auto cell_val = cell->GetValue();
-    if (std::holds_alternative<std::string>(cell_val)){
-        return FormulaError::Category::Value;
+size_t Cell::MemoryUsage() const {
+    return memory::SharedBytes<Cell>();
+}
+
+void Cell::Bind(DefaultCell const * cell, ISheet const * owner) const {
+    bound_.store(cell, std::memory_order_relaxed);
+    owner_.store(owner, std::memory_order_relaxed);
+}
+
+void Cell::CopyBinding(Cell const & other) const {
+    Bind(other.bound_.load(std::memory_order_relaxed), other.owner_.load(std::memory_order_relaxed));
+}
+
+BoxedValue Cell::Evaluate(const ISheet & sheet) const {
+    if (pos_.row < 0 || pos_.col < 0){
+        return FormulaError(FormulaError::Category::Ref);
+    }
+    BoxedValue cell_val;
+    // связь пишет только поток изменений, а снимки её не используют
+    if (auto bound = bound_.load(std::memory_order_relaxed); bound && owner_.load(std::memory_order_relaxed) == &sheet) {
+        cell_val = bound->GetBoxedValue();
+    } else if (auto cell = sheet.GetCell(pos_); cell) {
+        cell_val = BoxedValue::From(cell->GetValue());
+    } else {
+        return 0.0;
     }
-    else if (std::holds_alternative<FormulaError>(cell_val)) {
-        return std::get<FormulaError>(cell_val);
-    } else
-        return std::get<double>(cell_val);
+    if (cell_val.IsText())
+        return FormulaError(FormulaError::Category::Value);
+    return cell_val;
 }
 
 UnaryOp::UnaryOp(type op) {
@@ -44,21 +92,36 @@ void UnaryOp::SetValue(std::shared_ptr<const Node> node) {
     value_ = std::move(node);
 }
 
-IFormula::Value UnaryOp::Evaluate(const ISheet & sheet) const {
+BoxedValue UnaryOp::Evaluate(const ISheet & sheet) const {
     auto eval_val = value_->Evaluate(sheet);
-    if (std::holds_alternative<FormulaError>(eval_val))
-        return std::get<FormulaError>(eval_val);
-    return (op_ == type::UN_SUB) ? -1 * std::get<double>(eval_val) : std::get<double>(eval_val);
+    if (eval_val.IsError())
+        return eval_val;
+    return (op_ == type::UN_SUB) ? -1 * eval_val.AsNumber() : eval_val.AsNumber();
 }
 
-std::string UnaryOp::GetText(const ISheet & sheet) const {
+void UnaryOp::AppendText(std::string & out, NumberFormatter & formatter) const {
     if (op_ == type::UN_SUB) {
-        return '-' + ((is_brace_needed()) ? "(" + value_->GetText(sheet) + ")" : value_->GetText(sheet));
+        out += '-';
     } else if (op_ == type::UN_ADD) {
-        return '+' + ((is_brace_needed()) ? "(" + value_->GetText(sheet) + ")" : value_->GetText(sheet));
+        out += '+';
     }
 
-    return value_->GetText(sheet);
+    if (is_brace_needed()) {
+        out += '(';
+        value_->AppendText(out, formatter);
+        out += ')';
+    } else {
+        value_->AppendText(out, formatter);
+    }
+}
+
+void UnaryOp::Compile(Program & program) const {
+    value_->Compile(program);
+    Put(program, op_ == type::UN_SUB ? OpCode::Minus : OpCode::Plus);
+}
+
+size_t UnaryOp::MemoryUsage() const {
+    return memory::SharedBytes<UnaryOp>() + value_->MemoryUsage();
 }
 
 bool UnaryOp::is_brace_needed() const {
@@ -83,28 +146,28 @@ void BinaryOp::SetRight(std::shared_ptr<const Node> rhs_node) {
     right_ = std::move(rhs_node);
 }
 
-IFormula::Value BinaryOp::Evaluate(const ISheet & sheet) const {
+BoxedValue BinaryOp::Evaluate(const ISheet & sheet) const {
     auto lhs_val = left_->Evaluate(sheet);
     auto rhs_val = right_->Evaluate(sheet);
-    if (std::holds_alternative<FormulaError>(lhs_val)) {
-        return FormulaError(std::get<FormulaError>(lhs_val));
-    } else if (std::holds_alternative<FormulaError>(rhs_val)) {
-        return FormulaError(std::get<FormulaError>(rhs_val));
+    if (lhs_val.IsError()) {
+        return lhs_val;
+    } else if (rhs_val.IsError()) {
+        return rhs_val;
     }
 
     double value;
     switch (op_) {
         case type::ADD:
-            value = std::get<double>(lhs_val) + std::get<double>(rhs_val);
+            value = lhs_val.AsNumber() + rhs_val.AsNumber();
             break;
         case type::SUB:
-            value = std::get<double>(lhs_val) - std::get<double>(rhs_val);
+            value = lhs_val.AsNumber() - rhs_val.AsNumber();
             break;
         case type::MUL:
-            value = std::get<double>(lhs_val) * std::get<double>(rhs_val);
+            value = lhs_val.AsNumber() * rhs_val.AsNumber();
             break;
         case type::DIV: {
-            value = std::get<double>(lhs_val) / std::get<double>(rhs_val);
+            value = lhs_val.AsNumber() / rhs_val.AsNumber();
             break;
         }
         default:
@@ -115,12 +178,35 @@ IFormula::Value BinaryOp::Evaluate(const ISheet & sheet) const {
     return value;
 }
 
-std::string BinaryOp::GetText(const ISheet & sheet) const {
-    std::string expr_text =
-            (is_brace_needed_left() ? '(' + left_->GetText(sheet) + ')' : left_->GetText(sheet))
-            + sign.at(op_)
-            + (is_brace_needed_right() ? '(' + right_->GetText(sheet) + ')' : right_->GetText(sheet));
-    return expr_text;
+void BinaryOp::AppendText(std::string & out, NumberFormatter & formatter) const {
+    if (is_brace_needed_left()) {
+        out += '(';
+        left_->AppendText(out, formatter);
+        out += ')';
+    } else {
+        left_->AppendText(out, formatter);
+    }
+
+    out += sign[op_];
+
+    if (is_brace_needed_right()) {
+        out += '(';
+        right_->AppendText(out, formatter);
+        out += ')';
+    } else {
+        right_->AppendText(out, formatter);
+    }
+}
+
+void BinaryOp::Compile(Program & program) const {
+    left_->Compile(program);
+    right_->Compile(program);
+    static const OpCode codes[] = {OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div};
+    Put(program, codes[op_]);
+}
+
+size_t BinaryOp::MemoryUsage() const {
+    return memory::SharedBytes<BinaryOp>() + left_->MemoryUsage() + right_->MemoryUsage();
 }
 
 bool BinaryOp::is_brace_needed_left() const {
@@ -145,14 +231,116 @@ bool BinaryOp::is_brace_needed_right() const {
     }
 }
 
-IFormula::Value ASTree::Evaluate(const ISheet & sheet) const {
+BoxedValue ASTree::Evaluate(const ISheet & sheet) const {
     return root_->Evaluate(sheet);
 }
 
+void ASTree::Bind(Position pos, DefaultCell const * cell, ISheet const * owner) const {
+    auto it = std::lower_bound(order.begin(), order.end(), pos, [&](uint32_t index, Position pos) {
+        return cell_ptrs[index]->GetPos() < pos;
+    });
+    for (; it != order.end() && cell_ptrs[*it]->GetPos() == pos; ++it)
+        cell_ptrs[*it]->Bind(cell, owner);
+}
+
+void ASTree::IndexCells() {
+    order.clear();
+    for (uint32_t i = 0; i < cell_ptrs.size(); i++) {
+        if (cell_ptrs[i]->GetPos().row >= 0 && cell_ptrs[i]->GetPos().col >= 0)
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return cell_ptrs[lhs]->GetPos() < cell_ptrs[rhs]->GetPos();
+    });
+    cells.clear();
+    for (auto index : order) {
+        if (cells.empty() || !(cells.back() == cell_ptrs[index]->GetPos()))
+            cells.push_back(cell_ptrs[index]->GetPos());
+    }
+}
+
+void ASTree::CopyBindings(ASTree const & other) const {
+    for (size_t i = 0; i < cell_ptrs.size() && i < other.cell_ptrs.size(); i++)
+        cell_ptrs[i]->CopyBinding(*other.cell_ptrs[i]);
+}
+
+size_t ASTree::MemoryUsage() const {
+    // узлы Cell из cell_ptrs входят в дерево и уже посчитаны
+    return root_->MemoryUsage() + memory::VectorBytes(cell_ptrs) + memory::VectorBytes(cells) + memory::VectorBytes(order);
+}
+
+ASTree ASTree::FromProgram(uint8_t const * code, size_t size) {
+    std::vector<std::shared_ptr<const Node>> stack;
+    std::vector<std::shared_ptr<Cell>> cells;
+
+    auto read = [&](auto & value) {
+        if (size < sizeof(value))
+            throw FormulaException("truncated formula program");
+        std::memcpy(&value, code, sizeof(value));
+        code += sizeof(value);
+        size -= sizeof(value);
+    };
+    auto pop = [&]() {
+        if (stack.empty())
+            throw FormulaException("invalid formula program");
+        auto node = std::move(stack.back());
+        stack.pop_back();
+        return node;
+    };
+
+    while (size > 0) {
+        uint8_t op;
+        read(op);
+        switch (static_cast<OpCode>(op)) {
+            case OpCode::Number: {
+                double number;
+                read(number);
+                stack.push_back(std::make_shared<Value>(number));
+                break;
+            }
+            case OpCode::Cell: {
+                int32_t row, col;
+                read(row);
+                read(col);
+                // -1 в одной из координат - ссылка на удалённую ячейку (#REF!)
+                if (row < -1 || col < -1 || !Position{std::max(row, 0), std::max(col, 0)}.IsValid())
+                    throw FormulaException("invalid formula program");
+                auto cell = std::make_shared<Cell>(Position{row, col});
+                cells.push_back(cell);
+                stack.push_back(std::move(cell));
+                break;
+            }
+            case OpCode::Plus:
+            case OpCode::Minus: {
+                auto un_op = std::make_shared<UnaryOp>(static_cast<OpCode>(op) == OpCode::Minus ? type::UN_SUB : type::UN_ADD);
+                un_op->SetValue(pop());
+                stack.push_back(std::move(un_op));
+                break;
+            }
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul:
+            case OpCode::Div: {
+                static const type types[] = {type::ADD, type::SUB, type::MUL, type::DIV};
+                auto bin_op = std::make_shared<BinaryOp>(types[op - static_cast<uint8_t>(OpCode::Add)]);
+                bin_op->SetRight(pop());
+                bin_op->SetLeft(pop());
+                stack.push_back(std::move(bin_op));
+                break;
+            }
+            default:
+                throw FormulaException("invalid formula program");
+        }
+    }
+
+    if (stack.size() != 1)
+        throw FormulaException("invalid formula program");
+    return ASTree{stack.back(), std::move(cells)};
+}
+
 IFormula::HandlingResult ASTree::InsertRows(int before, int count) {
     IFormula::HandlingResult handle_type = IFormula::HandlingResult::NothingChanged;
 
-    cells.clear();
     for (auto & cell : cell_ptrs) {
         auto pos = cell->GetPos();
         if (pos.row >= before) {
@@ -161,17 +349,14 @@ IFormula::HandlingResult ASTree::InsertRows(int before, int count) {
                 handle_type = IFormula::HandlingResult::ReferencesRenamedOnly;
             }
         }
-        cells.push_back(cell->GetPos());
     }
-    std::sort(cells.begin(), cells.end());
-    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    IndexCells();
     return handle_type;
 }
 
 IFormula::HandlingResult ASTree::InsertCols(int before, int count) {
     IFormula::HandlingResult handle_type = IFormula::HandlingResult::NothingChanged;
 
-    cells.clear();
     for (auto & cell : cell_ptrs) {
         auto pos = cell->GetPos();
         if (pos.col >= before) {
@@ -180,17 +365,14 @@ IFormula::HandlingResult ASTree::InsertCols(int before, int count) {
                 handle_type = IFormula::HandlingResult::ReferencesRenamedOnly;
             }
         }
-        cells.push_back(cell->GetPos());
     }
-    std::sort(cells.begin(), cells.end());
-    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    IndexCells();
     return handle_type;
 }
 
 IFormula::HandlingResult ASTree::DeleteRows(int first, int count) {
     IFormula::HandlingResult handle_type = IFormula::HandlingResult::NothingChanged;
 
-    cells.clear();
     for (auto & cell : cell_ptrs){
         auto pos = cell->GetPos();
         if (pos.row >= first) {
@@ -204,11 +386,8 @@ IFormula::HandlingResult ASTree::DeleteRows(int first, int count) {
                 }
             }
         }
-        if (cell->GetPos().row >= 0 && cell->GetPos().col >= 0)
-            cells.push_back(cell->GetPos());
     }
-    std::sort(cells.begin(), cells.end());
-    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    IndexCells();
 
     return handle_type;
 }
@@ -216,7 +395,6 @@ IFormula::HandlingResult ASTree::DeleteRows(int first, int count) {
 IFormula::HandlingResult ASTree::DeleteCols(int first, int count) {
     IFormula::HandlingResult handle_type = IFormula::HandlingResult::NothingChanged;
 
-    cells.clear();
     for (auto & cell : cell_ptrs){
         auto pos = cell->GetPos();
         if (pos.col >= first) {
@@ -230,11 +408,8 @@ IFormula::HandlingResult ASTree::DeleteCols(int first, int count) {
                 }
             }
         }
-        if (cell->GetPos().col >= 0 && cell->GetPos().row >= 0)
-            cells.push_back(cell->GetPos());
     }
-    std::sort(cells.begin(), cells.end());
-    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    IndexCells();
 
     return handle_type;
 }
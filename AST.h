@@ -1,14 +1,18 @@
 #ifndef SPREADSHEET_AST_H
 #define SPREADSHEET_AST_H
 
+#include <atomic>
+#include <cstdint>
 #include <utility>
 #include <stack>
 #include <sstream>
 #include <map>
 #include <algorithm>
 
+#include "BoxedValue.h"
 #include "common.h"
 #include "formula.h"
+#include "Format.h"
 
 #include "FormulaLexer.h"
 #include "FormulaBaseListener.h"
@@ -25,7 +29,23 @@ public:
     }
 };
 
+struct DefaultCell;
+
 namespace AST {
+    // Постфиксная запись формулы: хранится в снимках таблицы и превращается
+    // обратно в дерево за один проход, без лексера и парсера
+    enum class OpCode : uint8_t {
+        Number,     // за кодом следует double
+        Cell,       // за кодом следуют int32 row и int32 col
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Plus,
+        Minus
+    };
+    using Program = std::vector<uint8_t>;
+
     enum type {
         ADD,
         SUB,
@@ -36,8 +56,13 @@ namespace AST {
         ATOM
     };
     struct Node {
-        [[nodiscard]] virtual IFormula::Value Evaluate(const ISheet &) const = 0;
-        [[nodiscard]] virtual std::string GetText(const ISheet &) const = 0;
+        [[nodiscard]] virtual BoxedValue Evaluate(const ISheet &) const = 0;
+        // Дописывает текст узла в out, не создавая промежуточных строк
+        virtual void AppendText(std::string & out, NumberFormatter & formatter) const = 0;
+        [[nodiscard]] std::string GetText(const ISheet &) const;
+        virtual void Compile(Program & program) const = 0;
+        // Байты узла и его поддерева вместе с блоками shared_ptr
+        [[nodiscard]] virtual size_t MemoryUsage() const = 0;
         [[nodiscard]] virtual type GetOpType() const {return op_;}
     protected:
         type op_;
@@ -64,8 +89,11 @@ namespace AST {
     struct Value : public Node {
     public:
         explicit Value(std::string const & number) : value_(std::stod(number)) { op_ = type::ATOM; }
-        [[nodiscard]] IFormula::Value Evaluate(const ISheet &) const override { return value_; }
-        [[nodiscard]] std::string GetText(const ISheet &) const override;
+        explicit Value(double number) : value_(number) { op_ = type::ATOM; }
+        [[nodiscard]] BoxedValue Evaluate(const ISheet &) const override { return value_; }
+        void AppendText(std::string & out, NumberFormatter & formatter) const override;
+        void Compile(Program & program) const override;
+        [[nodiscard]] size_t MemoryUsage() const override;
     private:
         const double value_;
     };
@@ -78,12 +106,24 @@ namespace AST {
             if (!pos_.IsValid())
                 throw FormulaException("invalid pos");
         }
-        [[nodiscard]] IFormula::Value Evaluate(const ISheet &) const override;
-        [[nodiscard]] std::string GetText(const ISheet &) const override;
+        // Без проверки: позиция может быть уже удалённой ячейкой (#REF!)
+        explicit Cell(Position pos) : pos_(pos) { op_ = type::ATOM; }
+        [[nodiscard]] BoxedValue Evaluate(const ISheet &) const override;
+        void AppendText(std::string & out, NumberFormatter & formatter) const override;
+        void Compile(Program & program) const override;
+        [[nodiscard]] size_t MemoryUsage() const override;
         [[nodiscard]] Position GetPos() const { return pos_; }
         void SetPos(Position new_pos) { pos_ = new_pos; }
+        // Ячейка таблицы owner, на которую указывает ссылка: вычисление на
+        // этой таблице читает её напрямую, минуя ISheet::GetCell. Ставится
+        // при создании ребра графа; граф сохраняет объекты ячеек при
+        // перезаписи и сдвигах, поэтому связь остаётся верной
+        void Bind(DefaultCell const * cell, ISheet const * owner) const;
+        void CopyBinding(Cell const & other) const;
     private:
         Position pos_;
+        mutable std::atomic<DefaultCell const *> bound_ {nullptr};
+        mutable std::atomic<ISheet const *> owner_ {nullptr};
     };
 
     struct UnaryOp : public Node {
@@ -91,8 +131,10 @@ namespace AST {
         explicit UnaryOp(type op);
         void SetValue(std::shared_ptr<const Node> node);
 
-        [[nodiscard]] IFormula::Value Evaluate(const ISheet &) const override;
-        [[nodiscard]] std::string GetText(const ISheet &) const override;
+        [[nodiscard]] BoxedValue Evaluate(const ISheet &) const override;
+        void AppendText(std::string & out, NumberFormatter & formatter) const override;
+        void Compile(Program & program) const override;
+        [[nodiscard]] size_t MemoryUsage() const override;
     private:
         std::shared_ptr<const Node> value_;
         [[nodiscard]] bool is_brace_needed() const;
@@ -100,19 +142,16 @@ namespace AST {
 
     struct BinaryOp : public Node {
     public:
-        static const inline std::map<type, std::string> sign{
-                {type::ADD, "+"},
-                {type::SUB, "-"},
-                {type::MUL, "*"},
-                {type::DIV, "/"}
-        };
+        static constexpr char sign[] = {'+', '-', '*', '/'};
 
         explicit BinaryOp(type op);
         void SetLeft(std::shared_ptr<const Node> lhs_node);
         void SetRight(std::shared_ptr<const Node> rhs_node);
 
-        [[nodiscard]] IFormula::Value Evaluate(const ISheet &) const override;
-        [[nodiscard]] std::string GetText(const ISheet &) const override;
+        [[nodiscard]] BoxedValue Evaluate(const ISheet &) const override;
+        void AppendText(std::string & out, NumberFormatter & formatter) const override;
+        void Compile(Program & program) const override;
+        [[nodiscard]] size_t MemoryUsage() const override;
     private:
         std::shared_ptr<const Node> left_, right_;
         [[nodiscard]] bool is_brace_needed_left() const;
@@ -122,17 +161,25 @@ namespace AST {
     struct ASTree {
     public:
         explicit ASTree(std::shared_ptr<const Node> root_node, std::vector<std::shared_ptr<Cell>> ptrs) : root_(std::move(root_node)), cell_ptrs(std::move(ptrs)) {
-            for (auto & cell : cell_ptrs) {
-                cells.push_back(cell->GetPos());
-            }
-            std::sort(cells.begin(), cells.end());
-            cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+            IndexCells();
         }
         [[nodiscard]] std::string GetExpression(const ISheet & sheet) const { return root_->GetText(sheet); }
-        [[nodiscard]] IFormula::Value Evaluate(const ISheet &) const;
+        void AppendExpression(std::string & out, NumberFormat format = NumberFormat::Shortest) const {
+            NumberFormatter formatter(format);
+            root_->AppendText(out, formatter);
+        }
+        void Compile(Program & program) const { root_->Compile(program); }
+        [[nodiscard]] size_t MemoryUsage() const;
+        // Бросает FormulaException, если программа повреждена
+        static ASTree FromProgram(uint8_t const * code, size_t size);
+        [[nodiscard]] BoxedValue Evaluate(const ISheet &) const;
         [[nodiscard]] std::vector<Position> GetCellsPos() const {
             return cells;
         }
+        // Связывает ссылки на pos с ячейкой cell таблицы owner
+        void Bind(Position pos, DefaultCell const * cell, ISheet const * owner) const;
+        // Переносит связи из дерева с теми же ссылками в том же порядке
+        void CopyBindings(ASTree const & other) const;
 
         IFormula::HandlingResult InsertRows(int before, int count);
         IFormula::HandlingResult InsertCols(int before, int count);
@@ -143,6 +190,12 @@ namespace AST {
         std::shared_ptr<const Node> root_;
         std::vector<std::shared_ptr<Cell>> cell_ptrs;
         std::vector<Position> cells;
+        // Номера ссылок из cell_ptrs без #REF!, упорядоченные по позиции:
+        // Bind находит ссылки на ячейку двоичным поиском
+        std::vector<uint32_t> order;
+
+        // Перестраивает cells и order после изменения позиций ссылок
+        void IndexCells();
     };
 
     struct ASTListener final : public FormulaBaseListener {
@@ -0,0 +1,47 @@
+#ifndef SPREADSHEET_ALLOCATION_HOOK_H
+#define SPREADSHEET_ALLOCATION_HOOK_H
+
+#include <cstdlib>
+#include <new>
+
+#include "Allocations.h"
+
+// Заменяет глобальные operator new и delete счётчиками из Allocations.h.
+// Подключается ровно в одну единицу трансляции исполняемого файла, который
+// хочет считать выделения: spreadsheet_bench всегда, тесты - с опцией CMake
+// SPREADSHEET_ALLOC_HOOK
+
+namespace allocation_hook {
+    inline void * Allocate(std::size_t size) {
+        RecordAllocation(size);
+        if (void * ptr = std::malloc(size ? size : 1))
+            return ptr;
+        throw std::bad_alloc();
+    }
+}
+
+void * operator new(std::size_t size) {
+    return allocation_hook::Allocate(size);
+}
+
+void * operator new[](std::size_t size) {
+    return allocation_hook::Allocate(size);
+}
+
+void operator delete(void * ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif //SPREADSHEET_ALLOCATION_HOOK_H
@@ -0,0 +1,45 @@
+#include "Allocations.h"
+
+#include <atomic>
+
+namespace {
+    constexpr std::array<std::string_view, kAllocSubsystems> kNames {
+        "other", "parse", "graph", "storage", "eval", "print"
+    };
+
+    // Нулевые до любой динамической инициализации: operator new может
+    // вызываться из конструкторов статических объектов
+    struct Counter {
+        std::atomic<uint64_t> count {0};
+        std::atomic<uint64_t> bytes {0};
+    };
+    std::array<Counter, kAllocSubsystems> counters;
+}
+
+std::string_view AllocSubsystemName(AllocSubsystem subsystem) {
+    return kNames[static_cast<int>(subsystem)];
+}
+
+AllocationCount AllocationStats::Total() const {
+    AllocationCount total;
+    for (auto & item : by_subsystem) {
+        total.count += item.count;
+        total.bytes += item.bytes;
+    }
+    return total;
+}
+
+AllocationStats GetAllocationStats() {
+    AllocationStats stats;
+    for (int i = 0; i < kAllocSubsystems; i++) {
+        stats.by_subsystem[i].count = counters[i].count.load(std::memory_order_relaxed);
+        stats.by_subsystem[i].bytes = counters[i].bytes.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void RecordAllocation(std::size_t bytes) {
+    auto & counter = counters[static_cast<int>(AllocScope::Current())];
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,68 @@
+#ifndef SPREADSHEET_ALLOCATIONS_H
+#define SPREADSHEET_ALLOCATIONS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Учёт выделений памяти по подсистемам движка. Код таблицы помечает свои
+// участки AllocScope; считает выделения глобальный operator new из
+// AllocationHook.h, если исполняемый файл его подключил, иначе
+// GetAllocationStats возвращает нули
+
+enum class AllocSubsystem {
+    Other,      // вне размеченных участков: код программы, тесты
+    Parse,      // разбор формул
+    Graph,      // граф зависимостей и проверка циклов
+    Storage,    // ячейки, сетка, версии, снимки, правка формул при сдвигах
+    Eval,       // вычисление формул
+    Print       // PrintValues, PrintTexts
+};
+inline constexpr int kAllocSubsystems = static_cast<int>(AllocSubsystem::Print) + 1;
+
+std::string_view AllocSubsystemName(AllocSubsystem subsystem);
+
+struct AllocationCount {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+struct AllocationStats {
+    std::array<AllocationCount, kAllocSubsystems> by_subsystem {};
+
+    [[nodiscard]] AllocationCount const & operator[](AllocSubsystem subsystem) const {
+        return by_subsystem[static_cast<int>(subsystem)];
+    }
+    [[nodiscard]] AllocationCount Total() const;
+};
+
+// Выделения всех потоков с запуска программы; разность двух вызовов даёт
+// выделения участка
+AllocationStats GetAllocationStats();
+
+// Выделения внутри области относятся к subsystem; вложенная область
+// перекрывает внешнюю до своего конца. Действует в текущем потоке
+class AllocScope {
+public:
+    explicit AllocScope(AllocSubsystem subsystem) : previous_(current_) {
+        current_ = subsystem;
+    }
+    ~AllocScope() {
+        current_ = previous_;
+    }
+    AllocScope(AllocScope const &) = delete;
+    AllocScope & operator=(AllocScope const &) = delete;
+
+    [[nodiscard]] static AllocSubsystem Current() {
+        return current_;
+    }
+private:
+    static inline thread_local AllocSubsystem current_ = AllocSubsystem::Other;
+    AllocSubsystem previous_;
+};
+
+// Вызывается из operator new в AllocationHook.h
+void RecordAllocation(std::size_t bytes);
+
+#endif //SPREADSHEET_ALLOCATIONS_H
@@ -0,0 +1,75 @@
+#include "Engine.h"
+
+#include <stdexcept>
+
+void SpreadSheet::BeginBatch() {
+    if (batch)
+        throw std::logic_error("batch is already started");
+    batch.emplace();
+}
+
+void SpreadSheet::Commit() {
+    if (!batch)
+        throw std::logic_error("no batch to commit");
+    auto staged = std::move(*batch);
+    batch.reset();
+    ApplyCells(std::move(staged));
+}
+
+void SpreadSheet::Rollback() {
+    if (!batch)
+        throw std::logic_error("no batch to roll back");
+    batch.reset();
+}
+
+bool SpreadSheet::InBatch() const {
+    return batch.has_value();
+}
+
+void SpreadSheet::CheckNoBatch() const {
+    if (batch)
+        throw std::logic_error("operation is not allowed inside a batch");
+}
+
+void SpreadSheet::ApplyCells(std::map<Position, std::shared_ptr<DefaultCell>> staged) {
+    // Очистки выполняются первыми, иначе загружаемые формулы могли бы
+    // образовать цикл с прежним содержимым очищаемых позиций. Они журналируются
+    // лишь после успешной загрузки, а при откате копии прежних ячеек
+    // загружаются обратно без журнала
+    auto attached = std::exchange(journal, nullptr);
+    std::vector<CellEntry> entries;
+    std::vector<Position> cleared;
+    std::vector<CellEntry> prev_cells;
+    entries.reserve(staged.size());
+    recalc_hold++;
+    for (auto & [pos, cell] : staged) {
+        if (cell) {
+            entries.push_back({pos, std::move(cell)});
+        } else if (auto current = GetCell(pos); current && current != &default_value) {
+            prev_cells.push_back({pos, std::make_shared<DefaultCell>(dynamic_cast<DefaultCell const &>(*current))});
+            ClearCell(pos);
+            cleared.push_back(pos);
+        }
+    }
+
+    journal = attached;
+    try {
+        if (!entries.empty())
+            LoadCells(std::move(entries));
+    } catch (...) {
+        journal = nullptr;
+        if (!prev_cells.empty())
+            LoadCells(std::move(prev_cells));
+        journal = attached;
+        recalc_hold--;
+        PublishChanges();
+        throw;
+    }
+    if (journal) {
+        for (auto & pos : cleared) {
+            Log(JournalOp::ClearCell, pos, 0, 0);
+        }
+    }
+    recalc_hold--;
+    PublishChanges();
+}
@@ -0,0 +1,95 @@
+#ifndef SPREADSHEET_BOXED_VALUE_H
+#define SPREADSHEET_BOXED_VALUE_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <variant>
+
+#include "common.h"
+#include "formula.h"
+
+// Значение ячейки в восьми байтах: число, ошибка формулы или ссылка на
+// текст. Число хранится как есть, остальное - в полезной нагрузке NaN с
+// установленным знаком. Такие NaN не встречаются среди чисел, потому что
+// любой NaN при упаковке приводится к одному положительному. Вычислитель и
+// кэш значений ячеек работают с BoxedValue, а ICell::Value собирается
+// только на границе ICell
+class BoxedValue {
+public:
+    BoxedValue() = default;
+    BoxedValue(double number) {
+        if (std::isnan(number))
+            bits_ = kCanonicalNaN;
+        else
+            std::memcpy(&bits_, &number, sizeof(bits_));
+    }
+    BoxedValue(FormulaError error)
+        : bits_(kErrorTag << kTagShift | static_cast<uint64_t>(error.GetCategory())) {}
+    // handle - номер текста в пуле таблицы
+    static BoxedValue Text(uint32_t handle = 0) {
+        BoxedValue value;
+        value.bits_ = kTextTag << kTagShift | handle;
+        return value;
+    }
+    // Для значений формул и сохранённых значений; текст теряет содержимое
+    static BoxedValue From(ICell::Value const & value) {
+        if (auto number = std::get_if<double>(&value))
+            return *number;
+        if (auto error = std::get_if<FormulaError>(&value))
+            return *error;
+        return Text();
+    }
+
+    [[nodiscard]] bool IsNumber() const {
+        return bits_ >> kTagShift < kErrorTag;
+    }
+    [[nodiscard]] bool IsError() const {
+        return bits_ >> kTagShift == kErrorTag;
+    }
+    [[nodiscard]] bool IsText() const {
+        return bits_ >> kTagShift == kTextTag;
+    }
+
+    [[nodiscard]] double AsNumber() const {
+        double number;
+        std::memcpy(&number, &bits_, sizeof(number));
+        return number;
+    }
+    [[nodiscard]] FormulaError AsError() const {
+        return static_cast<FormulaError::Category>(bits_ & kPayloadMask);
+    }
+    [[nodiscard]] uint32_t TextHandle() const {
+        return static_cast<uint32_t>(bits_ & kPayloadMask);
+    }
+
+    // Значение формулы: текст в арифметике - ошибка #VALUE!
+    [[nodiscard]] IFormula::Value ToFormulaValue() const {
+        if (IsNumber())
+            return AsNumber();
+        if (IsError())
+            return AsError();
+        return FormulaError(FormulaError::Category::Value);
+    }
+
+    // Побитовое сравнение: равные числа и одинаковые ошибки совпадают,
+    // 0.0 и -0.0 различаются
+    bool operator==(BoxedValue rhs) const {
+        return bits_ == rhs.bits_;
+    }
+    bool operator!=(BoxedValue rhs) const {
+        return bits_ != rhs.bits_;
+    }
+private:
+    static constexpr int kTagShift = 48;
+    static constexpr uint64_t kErrorTag = 0xFFF9;
+    static constexpr uint64_t kTextTag = 0xFFFA;
+    static constexpr uint64_t kPayloadMask = (uint64_t(1) << kTagShift) - 1;
+    static constexpr uint64_t kCanonicalNaN = 0x7FF8000000000000ull;
+
+    uint64_t bits_ = 0;
+};
+
+static_assert(sizeof(BoxedValue) == 8, "BoxedValue must fit into a register");
+
+#endif //SPREADSHEET_BOXED_VALUE_H
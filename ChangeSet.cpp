@@ -0,0 +1,131 @@
+#include "ChangeSet.h"
+#include "Engine.h"
+
+#include <algorithm>
+
+uint64_t SpreadSheet::GetVersion() const {
+    return change_version;
+}
+
+void SpreadSheet::TouchTile(Position pos, uint64_t version, bool invalidated) const {
+    auto & versions = tiles[TileIndex(pos.row / kTileSize, pos.col / kTileSize)];
+    versions.changed = std::max(versions.changed, version);
+    if (invalidated)
+        versions.invalidated = std::max(versions.invalidated, version);
+}
+
+void SpreadSheet::MarkChanged(Position pos, DefaultCell const & cell, uint64_t version) const {
+    cell.SetVersion(pos, version);
+    TouchTile(pos, version);
+}
+
+void SpreadSheet::MarkValueChanged(DefaultCell const & cell) const {
+    std::lock_guard lock(change_mutex);
+    MarkChanged(cell.GetPosition(), cell, change_version);
+}
+
+void SpreadSheet::RecordRemoved(Position pos, uint64_t version) {
+    removed_cells[pos] = version;
+    if (removed_cells.size() <= kMaxRemovedCells)
+        return;
+    std::vector<uint64_t> versions;
+    versions.reserve(removed_cells.size());
+    for (auto & [removed, removed_version] : removed_cells)
+        versions.push_back(removed_version);
+    auto middle = versions.begin() + versions.size() / 2;
+    std::nth_element(versions.begin(), middle, versions.end());
+    removed_horizon = std::max(removed_horizon, *middle);
+    for (auto it = removed_cells.begin(); it != removed_cells.end();) {
+        if (it->second <= removed_horizon)
+            it = removed_cells.erase(it);
+        else
+            ++it;
+    }
+}
+
+void SpreadSheet::ResetPositions() {
+    structure_version = ++change_version;
+    tiles.clear();
+    removed_cells.clear();
+    // ячейки сдвинулись: дерево снимков строится заново, старые снимки
+    // сохраняют свои узлы
+    frozen_cells.Clear();
+    for (int row = 0; row < static_cast<int>(cells.size()); row++) {
+        for (int col = 0; col < static_cast<int>(cells[row].size()); col++) {
+            if (auto cell = cells[row][col].lock(); cell) {
+                cell->SetVersion({row, col}, cell->GetVersion());
+                if (frozen)
+                    frozen_cells.Set({row, col}, FrozenCell::From(*cell));
+            }
+        }
+    }
+    recalc_full = true;
+    recalc_changes.clear();
+    PublishChanges();
+}
+
+ChangeSet SpreadSheet::GetChangesSince(uint64_t since) const {
+    ChangeSet changes;
+    changes.version = change_version;
+    changes.size = size;
+    if (since >= change_version)
+        return changes;
+    changes.full = since < structure_version || since < removed_horizon;
+
+    // Плитки просматриваются под change_mutex, а значения вычисляются уже
+    // после: пересчёт формулы сам отмечает изменения
+    auto collect_changed = [&](uint64_t TileVersions::* versions, auto func) {
+        std::vector<std::pair<Position, std::shared_ptr<DefaultCell>>> collected;
+        auto collect = [&](int first_row, int last_row, int first_col, int last_col) {
+            for (int row = first_row; row < last_row; row++) {
+                int end_col = std::min(last_col, static_cast<int>(cells[row].size()));
+                for (int col = first_col; col < end_col; col++) {
+                    if (auto cell = cells[row][col].lock(); cell && func(*cell))
+                        collected.emplace_back(Position{row, col}, std::move(cell));
+                }
+            }
+        };
+        std::lock_guard lock(change_mutex);
+        if (changes.full) {
+            collect(0, size.rows, 0, size.cols);
+            return collected;
+        }
+        std::vector<uint64_t> changed_tiles;
+        for (auto & [tile, tile_versions] : tiles) {
+            if (tile_versions.*versions > since)
+                changed_tiles.push_back(tile);
+        }
+        std::sort(changed_tiles.begin(), changed_tiles.end());
+        for (auto tile : changed_tiles) {
+            int tile_row = static_cast<int>(tile / kTileCols);
+            int tile_col = static_cast<int>(tile % kTileCols);
+            collect(tile_row * kTileSize, std::min((tile_row + 1) * kTileSize, size.rows),
+                    tile_col * kTileSize, (tile_col + 1) * kTileSize);
+        }
+        return collected;
+    };
+
+    // Сначала вычисляются формулы, отложенные после изменений их аргументов:
+    // пересчёт может изменить значения в плитках, которые иначе уже были бы
+    // просмотрены
+    auto invalid = collect_changed(&TileVersions::invalidated, [](DefaultCell const & cell) {
+        return cell.GetKind() == Literal::Kind::Formula && cell.GetFormula()->status != DefaultFormula::Status::Valid;
+    });
+    for (auto & [pos, cell] : invalid)
+        (void)cell->GetBoxedValue();
+
+    auto changed = collect_changed(&TileVersions::changed, [&](DefaultCell const & cell) {
+        return changes.full || cell.GetVersion() > since;
+    });
+    changes.cells.reserve(changed.size());
+    for (auto & [pos, cell] : changed)
+        changes.cells.push_back({pos, cell->GetValue()});
+
+    if (!changes.full) {
+        for (auto & [pos, version] : removed_cells) {
+            if (version > since)
+                changes.cells.push_back({pos, ICell::Value(std::string())});
+        }
+    }
+    return changes;
+}
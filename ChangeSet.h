@@ -0,0 +1,45 @@
+#ifndef SPREADSHEET_CHANGESET_H
+#define SPREADSHEET_CHANGESET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+// Изменения отслеживаются по плиткам kTileSize x kTileSize: у каждой
+// изменявшейся плитки хранится версия последнего изменения в ней, поэтому
+// запрос изменений просматривает только изменившиеся плитки
+inline constexpr int kTileSize = 32;
+inline constexpr int kTileCols = (Position::kMaxCols + kTileSize - 1) / kTileSize;
+
+// Сколько очисток ячеек помнит таблица для запросов изменений
+inline constexpr size_t kMaxRemovedCells = 4096;
+
+inline uint64_t TileIndex(int tile_row, int tile_col) {
+    return static_cast<uint64_t>(tile_row) * kTileCols + static_cast<uint64_t>(tile_col);
+}
+
+// Версии последнего изменения текста или значения в плитке и последнего
+// сброса формулы в ней
+struct TileVersions {
+    uint64_t changed = 0;
+    uint64_t invalidated = 0;
+};
+
+struct CellChange {
+    Position pos;
+    ICell::Value value;     // пустая строка, если ячейку очистили
+};
+
+struct ChangeSet {
+    uint64_t version = 0;   // передаётся в следующий запрос как since
+    // После since менялась структура таблицы (вставка или удаление строк и
+    // столбцов, загрузка снимка) или since старше хранимых очисток: cells
+    // содержит все ячейки, а прежнее содержимое следует отбросить
+    bool full = false;
+    Size size;
+    std::vector<CellChange> cells;
+};
+
+#endif //SPREADSHEET_CHANGESET_H
@@ -1,35 +1,113 @@
 #include "Engine.h"
+#include "Allocations.h"
+#include "Export.h"
+#include "Format.h"
+#include "Tracing.h"
 
 #include <algorithm>
+#include <optional>
 
 
 ICell::Value DefaultCell::GetValue() const {
-     if (formula_ && formula_->status != DefaultFormula::Status::Valid) {
-        auto eval_val = formula_->GetValue();
-        if (std::holds_alternative<double>(eval_val))
-            value = std::get<double>(eval_val);
-        else
-            value = std::get<FormulaError>(eval_val);
-    } else if (std::holds_alternative<std::string>(value)
-        && std::get<std::string>(value).front() == kEscapeSign) {
-        return ICell::Value(std::get<std::string>(value).substr(1));
+    if (kind_ == Literal::Kind::Text)
+        return ICell::Value(std::string(GetTextValue()));
+    auto boxed = GetBoxedValue();
+    if (boxed.IsError())
+        return boxed.AsError();
+    return boxed.AsNumber();
+}
+
+BoxedValue DefaultCell::GetBoxedValue() const {
+    switch (kind_) {
+        case Literal::Kind::Formula:
+            if (formula_->status.load(std::memory_order_acquire) != DefaultFormula::Status::Valid) {
+                AddStat(formula_->GetStatsCollector(), StatCounter::CacheMisses);
+                std::lock_guard lock(formula_->GetMutex());
+                if (formula_->status.load(std::memory_order_relaxed) != DefaultFormula::Status::Valid) {
+                    AddStat(formula_->GetStatsCollector(), StatCounter::FormulaEvaluations);
+                    LatencyScope::Nested evaluation;
+                    AllocScope allocations(AllocSubsystem::Eval);
+                    TraceSpan span("Evaluate", "formula", pos_, TraceSpan::Sampled{});
+                    auto new_value = formula_->GetValue();
+                    if (new_value != value) {
+                        value = new_value;
+                        if (auto sheet = dynamic_cast<SpreadSheet const *>(formula_->GetSheet()); sheet)
+                            sheet->MarkValueChanged(*this);
+                    }
+                    formula_->status.store(DefaultFormula::Status::Valid, std::memory_order_release);
+                }
+            } else {
+                AddStat(formula_->GetStatsCollector(), StatCounter::CacheHits);
+            }
+            return value;
+        case Literal::Kind::Text:
+            return BoxedValue::Text(text_.GetHandle());
+        default:
+            return value;
     }
-    return value;
 }
 
 std::string DefaultCell::GetText() const {
     if (formula_){
-        return "=" + formula_->GetExpression();
+        return kFormulaSign + formula_->GetCachedExpression();
     }
-    if (std::holds_alternative<std::string>(value))
-        return std::get<std::string>(value);
-    else if (std::holds_alternative<double>(value)) {
-        std::stringstream ss;
-        auto val = std::get<double>(value);
-        ss << val;
-        return ss.str();
-    } else
-        return std::string{std::get<FormulaError>(value).ToString()};
+    return std::string(text_.View());
+}
+
+std::string DefaultCell::GetExactText() const {
+    if (formula_)
+        return kFormulaSign + formula_->GetExactExpression();
+    return std::string(text_.View());
+}
+
+std::string_view DefaultCell::GetTextValue() const {
+    auto text = text_.View();
+    if (!text.empty() && text.front() == kEscapeSign)
+        text.remove_prefix(1);
+    return text;
+}
+
+namespace {
+    // FNV-1a
+    constexpr uint64_t kHashBasis = 14695981039346656037ull;
+    constexpr uint64_t kHashPrime = 1099511628211ull;
+
+    uint64_t HashAppend(uint64_t hash, std::string_view text, bool skip_spaces) {
+        for (char c : text) {
+            if (skip_spaces && isspace(c))
+                continue;
+            hash = (hash ^ static_cast<unsigned char>(c)) * kHashPrime;
+        }
+        return hash;
+    }
+}
+
+uint64_t DefaultCell::HashText(std::string_view text) {
+    bool is_formula = text.size() > 1 && text.front() == kFormulaSign;
+    return HashAppend(kHashBasis, text, is_formula);
+}
+
+uint64_t DefaultCell::GetTextHash() const {
+    if (formula_)
+        return formula_->GetExpressionHash();
+    return text_.IsPooled() ? text_.Hash() : HashText(text_.View());
+}
+
+bool DefaultCell::HasSameText(std::string_view text) const {
+    if (GetTextHash() != HashText(text))
+        return false;
+    if (formula_)
+        return !text.empty() && text.front() == kFormulaSign && is_str_equal(formula_->GetCachedExpression(), text.substr(1));
+    return text_.View() == text;
+}
+
+DefaultCell::DefaultCell(std::shared_ptr<DefaultFormula> formula) : kind_(Literal::Kind::Formula), value(0.0), formula_(std::move(formula)) {}
+
+void DefaultCell::RestoreValue(BoxedValue cached) {
+    if (!formula_)
+        return;
+    value = cached;
+    formula_->status = DefaultFormula::Status::Valid;
 }
 
 std::vector<Position> DefaultCell::GetReferencedCells() const {
@@ -38,55 +116,67 @@ std::vector<Position> DefaultCell::GetReferencedCells() const {
     return std::vector<Position>{};
 }
 
-DefaultCell::DefaultCell(const std::string &text, ISheet const * sheet) : value(Value(text)) {
-    if (text.size() > 1 && text.front() == '='){
-        formula_ = std::make_shared<DefaultFormula>(text.substr(1), sheet);
-    } else if (AllIsDigits(text)) {
-        if (!text.empty())
-            value = ICell::Value(std::stod(text));
-        else value = static_cast<double>(0.0);
+DefaultCell::DefaultCell(const std::string &text, ISheet const * sheet) : DefaultCell(text, ClassifyLiteral(text), sheet) {}
+
+DefaultCell::DefaultCell(std::string_view text, Literal literal, ISheet const * sheet) : kind_(literal.kind), value(literal.number) {
+    if (kind_ == Literal::Kind::Formula) {
+        formula_ = std::make_shared<DefaultFormula>(std::string(text.substr(1)), sheet);
+    } else if (kind_ == Literal::Kind::Text) {
+        text_ = CellText(PoolOf(sheet), text, HashText(text));
+    } else {
+        text_ = CellText(text);
     }
 }
 
-bool DefaultCell::AllIsDigits(const std::string &str) {
-    return std::all_of(str.begin(), str.end(), [](auto c) {
-        return std::isdigit(c);
-    }) || (str.size() > 1 && (str.front() == '-' || str.front() == '+') && std::all_of(std::next(str.begin()), str.end(), [](auto c) {
-        return std::isdigit(c);
-    }));
+TextPool & DefaultCell::PoolOf(ISheet const * sheet) {
+    if (auto spread_sheet = dynamic_cast<SpreadSheet const *>(sheet); spread_sheet)
+        return spread_sheet->text_pool;
+    return TextPool::Detached();
 }
 
-DefaultFormula::DefaultFormula(std::string const & val, const ISheet * sheet) : sheet_(sheet) {
+DefaultFormula::DefaultFormula(std::string const & val, const ISheet * sheet) : sheet_(sheet), stats_(StatsOf(sheet)) {
     BuildAST(val);
 }
 
+DefaultFormula::DefaultFormula(std::shared_ptr<AST::ASTree> tree, const ISheet * sheet) : as_tree(std::move(tree)), sheet_(sheet), stats_(StatsOf(sheet)) {}
+
+StatsCollector * DefaultFormula::StatsOf(ISheet const * sheet) {
+#ifdef SPREADSHEET_STATS
+    if (auto spread_sheet = dynamic_cast<SpreadSheet const *>(sheet); spread_sheet)
+        return &spread_sheet->stats;
+#endif
+    return nullptr;
+}
+
+NumberFormat DefaultFormula::FormatOf(ISheet const * sheet) {
+    if (auto spread_sheet = dynamic_cast<SpreadSheet const *>(sheet); spread_sheet)
+        return spread_sheet->GetNumberFormat();
+    return NumberFormat::Shortest;
+}
+
 std::unique_ptr<IFormula> ParseFormula(std::string expression) {
     auto formula = std::make_unique<DefaultFormula>(expression);
     return formula;
 }
 
 bool is_str_equal(std::string_view str1, std::string_view str2) {
-    for (auto it_s1 = str1.begin(), it_s2 = str2.begin(); it_s1 != str1.end(); it_s1++, it_s2++){
+    auto it_s1 = str1.begin(), it_s2 = str2.begin();
+    while (true) {
         while (it_s1 != str1.end() && isspace(*it_s1))
             it_s1++;
         while (it_s2 != str2.end() && isspace(*it_s2))
             it_s2++;
 
         if (it_s1 == str1.end() || it_s2 == str2.end())
-            return false;
+            return it_s1 == str1.end() && it_s2 == str2.end();
 
-        if (*it_s1 != *it_s2)
+        if (*it_s1++ != *it_s2++)
             return false;
     }
-    return true;
 }
 
-IFormula::Value DefaultFormula::GetValue() const {
-    auto val = Evaluate(*sheet_);
-    if (status == Status::Error)
-        return GetError();
-    else
-        return val;
+BoxedValue DefaultFormula::GetValue() const {
+    return EvaluateBoxed(*sheet_);
 }
 
 std::vector<Position> DefaultFormula::GetReferencedCells() const {
@@ -94,48 +184,104 @@ std::vector<Position> DefaultFormula::GetReferencedCells() const {
 }
 
 std::string DefaultFormula::GetExpression() const {
-    return as_tree->GetExpression(*sheet_);
+    return GetCachedExpression();
+}
+
+std::string const & DefaultFormula::GetCachedExpression() const {
+    if (expression_cached_.load(std::memory_order_acquire))
+        return expression_;
+
+    std::lock_guard lock(expression_mutex_);
+    if (!expression_cached_.load(std::memory_order_relaxed)) {
+        expression_.clear();
+        as_tree->AppendExpression(expression_, FormatOf(sheet_));
+
+        uint64_t hash = HashAppend(kHashBasis, std::string_view(&kFormulaSign, 1), false);
+        expression_hash_ = HashAppend(hash, expression_, false);
+        expression_cached_.store(true, std::memory_order_release);
+    }
+    return expression_;
+}
+
+std::string DefaultFormula::GetExactExpression() const {
+    if (FormatOf(sheet_) == NumberFormat::Shortest)
+        return GetCachedExpression();
+    std::string expression;
+    as_tree->AppendExpression(expression, NumberFormat::Shortest);
+    return expression;
+}
+
+uint64_t DefaultFormula::GetExpressionHash() const {
+    GetCachedExpression();
+    return expression_hash_;
+}
+
+void DefaultFormula::InvalidateExpression() {
+    expression_cached_ = false;
 }
 
+IFormula::HandlingResult DefaultFormula::InvalidateExpression(IFormula::HandlingResult result) {
+    if (result != HandlingResult::NothingChanged)
+        InvalidateExpression();
+    return result;
+}
+
+// Не меняет состояние формулы: статус выставляет вычисляющая ячейка
 IFormula::Value DefaultFormula::Evaluate(const ISheet &sheet) const {
-    IFormula::Value val;
+    return EvaluateBoxed(sheet).ToFormulaValue();
+}
+
+BoxedValue DefaultFormula::EvaluateBoxed(const ISheet &sheet) const {
+    if (!as_tree)
+        return error;
     try {
-        val = as_tree->Evaluate(sheet);
-        status = Status::Valid;
+        return as_tree->Evaluate(sheet);
     } catch (FormulaError & fe) {
-        status = Status::Error;
-        error = fe;
+        return fe;
     }
-    return val;
 }
 
 IFormula::HandlingResult DefaultFormula::HandleInsertedRows(int before, int count) {
-    if (GetReferencedCells().empty())
+    if (!References([&](Position pos) { return pos.row >= before; }))
         return IFormula::HandlingResult::NothingChanged;
-    return as_tree->InsertRows(before, count);
+    return InvalidateExpression(MutableAST().InsertRows(before, count));
 }
 
 IFormula::HandlingResult DefaultFormula::HandleInsertedCols(int before, int count) {
-    if (GetReferencedCells().empty())
+    if (!References([&](Position pos) { return pos.col >= before; }))
         return IFormula::HandlingResult::NothingChanged;
-    return as_tree->InsertCols(before, count);
+    return InvalidateExpression(MutableAST().InsertCols(before, count));
 }
 
 IFormula::HandlingResult DefaultFormula::HandleDeletedRows(int first, int count) {
-    if (GetReferencedCells().empty())
+    if (!References([&](Position pos) { return pos.row >= first; }))
         return IFormula::HandlingResult::NothingChanged;
-    return as_tree->DeleteRows(first, count);
+    return InvalidateExpression(MutableAST().DeleteRows(first, count));
 }
 
 IFormula::HandlingResult DefaultFormula::HandleDeletedCols(int first, int count) {
-    if (GetReferencedCells().empty())
+    if (!References([&](Position pos) { return pos.col >= first; }))
         return IFormula::HandlingResult::NothingChanged;
-    return as_tree->DeleteCols(first, count);
+    return InvalidateExpression(MutableAST().DeleteCols(first, count));
+}
+
+AST::ASTree & DefaultFormula::MutableAST() {
+    if (as_tree.use_count() > 1) {
+        AST::Program program;
+        as_tree->Compile(program);
+        auto copy = std::make_shared<AST::ASTree>(AST::ASTree::FromProgram(program.data(), program.size()));
+        copy->CopyBindings(*as_tree);
+        as_tree = std::move(copy);
+    }
+    return *as_tree;
 }
 
 void DefaultFormula::BuildAST(std::string const & text) const {
     if (!as_tree || (as_tree && as_tree->GetCellsPos().empty())) {
         try {
+            AddStat(stats_, StatCounter::ParserInvocations);
+            TraceSpan span("Parse", "formula");
+            AllocScope allocations(AllocSubsystem::Parse);
             std::stringstream ss(text);
             as_tree = std::make_shared<AST::ASTree>(AST::ParseFormula(ss, *sheet_));
         } catch (FormulaError & fe) {
@@ -154,17 +300,29 @@ FormulaError DefaultFormula::GetError() const {
 }
 
 void SpreadSheet::SetCell(Position pos, std::string text) {
+    LatencyScope timing(stats, SheetMethod::SetCell);
+    TraceSpan span("SetCell", "edit", pos);
+    AllocScope allocations(AllocSubsystem::Storage);
     if (!pos.IsValid()) {
         throw InvalidPositionException("invalid pos");
     }
 
+    if (batch) {
+        auto literal = ClassifyLiteral(text, number_syntax);
+        (*batch)[pos] = std::make_shared<DefaultCell>(std::move(text), literal, this);
+        return;
+    }
+
     CheckSizeCorrectly(pos);
 
-    if (auto cell = cells.at(pos.row).at(pos.col).lock(); (cell && is_str_equal(cell->GetText(), text)))
+    if (auto cell = cells.at(pos.row).at(pos.col).lock(); (cell && cell->HasSameText(text)))
         return;
+    auto version = ++change_version;
+    stats.Add(StatCounter::Writes);
 
     std::shared_ptr<DefaultCell> prev_val = nullptr;
-    std::shared_ptr<DefaultCell> val = std::make_shared<DefaultCell>(text, this);
+    auto literal = ClassifyLiteral(text, number_syntax);
+    std::shared_ptr<DefaultCell> val = std::make_shared<DefaultCell>(std::move(text), literal, this);
     if (auto cell = cells.at(pos.row).at(pos.col); !cell.expired()) {
         dep_graph.InvalidOutcoming(cell.lock());
         prev_val = std::make_shared<DefaultCell>(*cells.at(pos.row).at(pos.col).lock());
@@ -187,10 +345,94 @@ void SpreadSheet::SetCell(Position pos, std::string text) {
             }
         }
     } catch (const CircularDependencyException& ex) {
-        if (prev_val)
-            *cells.at(pos.row).at(pos.col).lock() = *prev_val;
+        if (prev_val) {
+            // рёбра новой формулы заменяются рёбрами прежнего содержимого,
+            // заодно ссылки прежней формулы связываются с живыми ячейками
+            auto cell = cells.at(pos.row).at(pos.col).lock();
+            dep_graph.DeleteEdges(cell);
+            *cell = *prev_val;
+            for (auto & cell_pos : cell->GetReferencedCells())
+                dep_graph.AddEdge(pos, cell_pos, false);
+        }
         throw ex;
     }
+    MarkChanged(pos, *val, version);
+    FreezeCell(pos);
+    removed_cells.erase(pos);
+    LogSetCell(pos, *val);
+    PublishChanges();
+}
+
+void SpreadSheet::LoadCells(std::vector<CellEntry> entries) {
+    TraceSpan span("LoadCells", "edit", static_cast<int64_t>(entries.size()));
+    AllocScope allocations(AllocSubsystem::Storage);
+    CheckNoBatch();
+    for (auto & entry : entries) {
+        if (!entry.pos.IsValid())
+            throw InvalidPositionException("invalid pos");
+    }
+
+    auto version = ++change_version;
+    // прежние ячейки копируются, как в SetCell: повторный разбор их текста
+    // потерял бы числа формул при неточном формате таблицы
+    std::vector<CellEntry> prev_cells;
+    size_t installed = 0;
+    // все ячейки уходят на пересчёт одним заданием
+    recalc_hold++;
+    try {
+        std::vector<Position> formulas;
+        for (auto & [pos, val] : entries) {
+            CheckSizeCorrectly(pos);
+            if (auto cell = cells[pos.row][pos.col].lock(); cell) {
+                prev_cells.push_back({pos, std::make_shared<DefaultCell>(*cell)});
+                dep_graph.InvalidOutcoming(cell);
+                dep_graph.Delete(pos, cell);
+            } else if (dep_graph.IsExist(pos)) {
+                dep_graph.InvalidOutcoming(pos);
+            }
+            if (val->GetFormula())
+                formulas.push_back(pos);
+            cells[pos.row][pos.col] = dep_graph.AddVertex(pos, val);
+            installed++;
+        }
+
+        std::vector<std::shared_ptr<DefaultCell>> roots;
+        roots.reserve(formulas.size());
+        for (auto & pos : formulas) {
+            auto cell = cells[pos.row][pos.col].lock();
+            for (auto & cell_pos : cell->GetReferencedCells()) {
+                dep_graph.AddEdge(pos, cell_pos, false);
+            }
+            roots.push_back(std::move(cell));
+        }
+        dep_graph.CheckAcyclicity(roots);
+    } catch (...) {
+        // откат не журналируется: таблица возвращается к уже записанному состоянию
+        auto attached = std::exchange(journal, nullptr);
+        for (size_t i = 0; i < installed; i++) {
+            ClearCell(entries[i].pos);
+        }
+        // сетка держит слабые ссылки: пока entries владеют снятыми
+        // ячейками, их позиции не выглядят пустыми
+        entries.clear();
+        if (!prev_cells.empty())
+            LoadCells(std::move(prev_cells));
+        journal = attached;
+        recalc_hold--;
+        PublishChanges();
+        throw;
+    }
+
+    for (auto & entry : entries) {
+        auto cell = cells[entry.pos.row][entry.pos.col].lock();
+        MarkChanged(entry.pos, *cell, version);
+        FreezeCell(entry.pos);
+        removed_cells.erase(entry.pos);
+        LogSetCell(entry.pos, *cell);
+    }
+    stats.Add(StatCounter::Writes, entries.size());
+    recalc_hold--;
+    PublishChanges();
 }
 
 const ICell* SpreadSheet::GetCell(Position pos) const {
@@ -199,6 +441,7 @@ const ICell* SpreadSheet::GetCell(Position pos) const {
 
 // TODO ячейка - nullptr, если на нее никто не ссылается
 ICell* SpreadSheet::GetCell(Position pos) {
+    LatencyScope timing(stats, SheetMethod::GetCell);
     if (pos.row > size.rows - 1 || pos.col > size.cols - 1) {
         return nullptr;
     }
@@ -208,26 +451,51 @@ ICell* SpreadSheet::GetCell(Position pos) {
         else return nullptr;
     }
     auto& cell = cells.at(pos.row).at(pos.col);
-    return (cell.expired() || cell.lock()->GetText().empty()) ? nullptr : cell.lock().get();
+    return cell.expired() ? nullptr : cell.lock().get();
 }
 
 void SpreadSheet::ClearCell(Position pos) {
+    LatencyScope timing(stats, SheetMethod::ClearCell);
+    TraceSpan span("ClearCell", "edit", pos);
+    AllocScope allocations(AllocSubsystem::Storage);
     if (!pos.IsValid())
         throw InvalidPositionException("invalid pos");
+    if (batch) {
+        (*batch)[pos] = nullptr;
+        return;
+    }
 
     if (!(size > pos))
         return;
 
     if (static_cast<int>(cells.at(pos.row).size()) > pos.col) {
         if (auto cell = cells.at(pos.row).at(pos.col); !cell.expired()) {
+            auto version = ++change_version;
+            stats.Add(StatCounter::Writes);
             dep_graph.InvalidOutcoming(cell.lock());
             dep_graph.Delete(pos, cell.lock());
             TryToCompress(pos);
+            // на ячейку ссылаются формулы - она остаётся пустой
+            std::shared_ptr<DefaultCell> left;
+            if (static_cast<int>(cells.size()) > pos.row && static_cast<int>(cells[pos.row].size()) > pos.col)
+                left = cells[pos.row][pos.col].lock();
+            if (left)
+                MarkChanged(pos, *left, version);
+            else
+                RecordRemoved(pos, version);
+            FreezeCell(pos);
+            TouchTile(pos, version);
+            Log(JournalOp::ClearCell, pos, 0, 0);
+            PublishChanges();
         }
     }
 }
 
 void SpreadSheet::InsertRows(int before, int count) {
+    LatencyScope timing(stats, SheetMethod::InsertRows);
+    TraceSpan span("InsertRows", "structure", count);
+    AllocScope allocations(AllocSubsystem::Storage);
+    CheckNoBatch();
     if (size.rows + count >= Position::kMaxRows || dep_graph.GetMaxCachePos().row + count >= Position::kMaxRows)
         throw TableTooBigException("The number of rows is greater than the maximum");
     if (size.rows <= before)
@@ -250,12 +518,18 @@ void SpreadSheet::InsertRows(int before, int count) {
     for (int row = static_cast<int>(prev_size) - 1; row >= before; --row){
         std::swap(cells[row], cells[row + count]);
     }
-    dep_graph.InsertRows(before, count);
+    {
+        TraceSpan graph_span("ShiftGraph", "structure");
+        dep_graph.InsertRows(before, count);
+    }
     size.rows = cells.size();
 
+    TraceSpan fixup_span("FixupFormulas", "structure");
+    uint64_t touched = 0;
     for (int i = 0; i < size.rows; i++) {
         for (auto & el : cells[i]) {
             if (!el.expired()) {
+                touched++;
                 if (i >= before + count)
                     dep_graph.InvalidOutcoming(el.lock());
                 auto formula = dynamic_cast<DefaultFormula *>(el.lock()->GetFormula().get());
@@ -265,10 +539,20 @@ void SpreadSheet::InsertRows(int before, int count) {
             }
         }
     }
+    fixup_span.SetCount(static_cast<int64_t>(touched));
+    fixup_span.Close();
+    stats.Add(StatCounter::Writes);
+    stats.Add(StatCounter::StructureCellsTouched, touched);
+    ResetPositions();
+    Log(JournalOp::InsertRows, {0, 0}, before, count);
 }
 
 void SpreadSheet::InsertCols(int before, int count) {
-    if (size.cols + count >= Position::kMaxCols || dep_graph.GetMaxCachePos().col + count >= Position::kMaxRows)
+    LatencyScope timing(stats, SheetMethod::InsertCols);
+    TraceSpan span("InsertCols", "structure", count);
+    AllocScope allocations(AllocSubsystem::Storage);
+    CheckNoBatch();
+    if (size.cols + count >= Position::kMaxCols || dep_graph.GetMaxCachePos().col + count >= Position::kMaxCols)
         throw TableTooBigException("The number of cols is greater than the maximum");
     if (size.cols <= before)
         return;
@@ -291,12 +575,18 @@ void SpreadSheet::InsertCols(int before, int count) {
         }
         throw excep;
     }
-    dep_graph.InsertCols(before, count);
+    {
+        TraceSpan graph_span("ShiftGraph", "structure");
+        dep_graph.InsertCols(before, count);
+    }
     size.cols += count;
 
+    TraceSpan fixup_span("FixupFormulas", "structure");
+    uint64_t touched = 0;
     for (auto & row : cells) {
         for (int i = 0; i < static_cast<int>(row.size()); i++) {
             if (!row[i].expired()) {
+                touched++;
                 if (i >= before + count)
                     dep_graph.InvalidOutcoming(row[i].lock());
                 auto formula = dynamic_cast<DefaultFormula *>(row[i].lock()->GetFormula().get());
@@ -306,108 +596,162 @@ void SpreadSheet::InsertCols(int before, int count) {
             }
         }
     }
+    fixup_span.SetCount(static_cast<int64_t>(touched));
+    fixup_span.Close();
+    stats.Add(StatCounter::Writes);
+    stats.Add(StatCounter::StructureCellsTouched, touched);
+    ResetPositions();
+    Log(JournalOp::InsertCols, {0, 0}, before, count);
 }
 
 void SpreadSheet::DeleteRows(int first, int count) {
+    LatencyScope timing(stats, SheetMethod::DeleteRows);
+    TraceSpan span("DeleteRows", "structure", count);
+    AllocScope allocations(AllocSubsystem::Storage);
+    CheckNoBatch();
     if (size == Size{0, 0})                 // TODO надо ли делать такую проверку?
         return;
 
+    TraceSpan fixup_span("FixupFormulas", "structure");
+    uint64_t touched = 0;
     for (int i = 0; i < size.rows; i++){
         for (auto col_it = cells[i].begin(); col_it != cells[i].end(); col_it++) {
             if (!col_it->expired()) {
+                touched++;
                 if (i >= first + count)
                     dep_graph.InvalidOutcoming(col_it->lock());
-                else if (i >= first && i < count) {
+                else if (i >= first && i < first + count) {
+                    // ячейка, на которую ссылаются, уходит за таблицу, и её
+                    // вершину освобождает dep_graph.DeleteRows/DeleteCols
                     dep_graph.Delete({i, static_cast<int>(col_it - cells[i].begin())}, col_it->lock());
-                    dep_graph.Delete({i, static_cast<int>(col_it - cells[i].begin())});
                     continue;
                 }
                 auto formula = dynamic_cast<DefaultFormula *>(col_it->lock()->GetFormula().get());
-                if (formula) {
-                    formula->HandleDeletedRows(first, count);
+                // ссылка на удалённую ячейку стала #REF!: значение формулы устарело
+                if (formula && formula->HandleDeletedRows(first, count) == IFormula::HandlingResult::ReferencesChanged) {
+                    dep_graph.InvalidOutcoming(col_it->lock());
                 }
             }
         }
     }
-    dep_graph.DeleteRows(first, count);
+    fixup_span.SetCount(static_cast<int64_t>(touched));
+    fixup_span.Close();
+    {
+        TraceSpan graph_span("ShiftGraph", "structure");
+        dep_graph.DeleteRows(first, count);
+    }
 
-    cells.erase(cells.begin() + first, cells.begin() + first + count);
-    size.rows = (size.rows >= count) ? size.rows - count : 0;
-    if (auto pos = Position{size.rows - 1, size.cols - 1}; static_cast<int>(cells.at(pos.row).size()) > pos.col && cells.at(pos.row).at(pos.col).expired()){
+    // строки за таблицей удалять не из чего, сдвигаются только ссылки
+    int removed = std::clamp(size.rows - first, 0, count);
+    cells.erase(cells.begin() + first, cells.begin() + first + removed);
+    size.rows -= removed;
+    if (auto pos = Position{size.rows - 1, size.cols - 1}; size.rows && size.cols && static_cast<int>(cells.at(pos.row).size()) > pos.col && cells.at(pos.row).at(pos.col).expired()){
         TryToCompress(pos);
     }
+    stats.Add(StatCounter::Writes);
+    stats.Add(StatCounter::StructureCellsTouched, touched);
+    ResetPositions();
+    Log(JournalOp::DeleteRows, {0, 0}, first, count);
 }
 
 void SpreadSheet::DeleteCols(int first, int count) {
+    LatencyScope timing(stats, SheetMethod::DeleteCols);
+    TraceSpan span("DeleteCols", "structure", count);
+    AllocScope allocations(AllocSubsystem::Storage);
+    CheckNoBatch();
     if (size == Size{0, 0})
         return;
 
+    TraceSpan fixup_span("FixupFormulas", "structure");
+    uint64_t touched = 0;
     for (int i = 0; i < size.rows; i++){
         for (auto col_it = cells[i].begin(); col_it != cells[i].end(); col_it++){
             if (!col_it->expired()) {
+                touched++;
                 if (static_cast<int>(col_it - cells[i].begin()) >= first + count)
                     dep_graph.InvalidOutcoming(col_it->lock());
-                else if (static_cast<int>(col_it - cells[i].begin()) >= first && static_cast<int>(col_it - cells[i].begin()) < count) {
+                else if (static_cast<int>(col_it - cells[i].begin()) >= first && static_cast<int>(col_it - cells[i].begin()) < first + count) {
+                    // ячейка, на которую ссылаются, уходит за таблицу, и её
+                    // вершину освобождает dep_graph.DeleteRows/DeleteCols
                     dep_graph.Delete({i, static_cast<int>(col_it - cells[i].begin())}, col_it->lock());
-                    dep_graph.Delete({i, static_cast<int>(col_it - cells[i].begin())});
                     continue;
                 }
                 auto formula = dynamic_cast<DefaultFormula *>(col_it->lock()->GetFormula().get());
-                if (formula) {
-                    formula->HandleDeletedCols(first, count);
+                // ссылка на удалённую ячейку стала #REF!: значение формулы устарело
+                if (formula && formula->HandleDeletedCols(first, count) == IFormula::HandlingResult::ReferencesChanged) {
+                    dep_graph.InvalidOutcoming(col_it->lock());
                 }
             }
         }
     }
-    dep_graph.DeleteCols(first, count);
+    fixup_span.SetCount(static_cast<int64_t>(touched));
+    fixup_span.Close();
+    {
+        TraceSpan graph_span("ShiftGraph", "structure");
+        dep_graph.DeleteCols(first, count);
+    }
 
     for (auto & row : cells){
-        if (static_cast<int>(row.size()) >= first)
-            row.erase(row.begin() + first, row.begin() + first + count);
+        if (static_cast<int>(row.size()) > first)
+            row.erase(row.begin() + first, row.begin() + std::min(static_cast<int>(row.size()), first + count));
     }
-    size.cols = (size.cols >= count) ? size.cols - count : 0;
-    if (auto pos = Position{size.rows - 1, size.cols - 1}; static_cast<int>(cells.at(pos.row).size()) > pos.col && cells.at(pos.row).at(pos.col).expired()){
+    size.cols -= std::clamp(size.cols - first, 0, count);
+    if (auto pos = Position{size.rows - 1, size.cols - 1}; size.rows && size.cols && static_cast<int>(cells.at(pos.row).size()) > pos.col && cells.at(pos.row).at(pos.col).expired()){
         TryToCompress(pos);
     }
+    stats.Add(StatCounter::Writes);
+    stats.Add(StatCounter::StructureCellsTouched, touched);
+    ResetPositions();
+    Log(JournalOp::DeleteCols, {0, 0}, first, count);
 }
 
 Size SpreadSheet::GetPrintableSize() const {
+    LatencyScope timing(stats, SheetMethod::GetPrintableSize);
     return size;
 }
 
-void SpreadSheet::PrintValues(std::ostream &output) const {
-    for (int i = 0; i < size.rows; i++){
-        for (int j = 0; j < size.cols; j++) {
-            if (static_cast<int>(cells[i].size()) > j) {
-                if (auto cell = GetCell({i, j}); cell) {
-                    if (std::holds_alternative<double>(cell->GetValue()))
-                        output << std::get<double>(cell->GetValue());
-                    else if (std::holds_alternative<FormulaError>(cell->GetValue()))
-                        output << std::get<FormulaError>(cell->GetValue()).ToString();
-                    else
-                        output << std::get<std::string>(cell->GetValue());
-                }
-            }
-            if (j != size.cols - 1)
-                output << '\t';
-        }
-        output << '\n';
+void SpreadSheet::SetNumberSyntax(NumberSyntax syntax) {
+    number_syntax = syntax;
+}
+
+NumberSyntax SpreadSheet::GetNumberSyntax() const {
+    return number_syntax;
+}
+
+void SpreadSheet::SetNumberFormat(NumberFormat format) {
+    if (format == number_format)
+        return;
+    number_format = format;
+    auto invalidate = [](std::shared_ptr<DefaultCell> const & cell) {
+        if (cell && cell->GetFormula())
+            cell->GetFormula()->InvalidateExpression();
+    };
+    for (auto & row : cells) {
+        for (auto & cell : row)
+            invalidate(cell.lock());
+    }
+    if (batch) {
+        for (auto & [pos, cell] : *batch)
+            invalidate(cell);
     }
 }
 
+NumberFormat SpreadSheet::GetNumberFormat() const {
+    return number_format;
+}
+
+void SpreadSheet::PrintValues(std::ostream &output) const {
+    LatencyScope timing(stats, SheetMethod::PrintValues);
+    TraceSpan span("PrintValues", "print");
+    AllocScope allocations(AllocSubsystem::Print);
+    Exporter().WriteValues(*this, output);
+}
+
 void SpreadSheet::PrintTexts(std::ostream &output) const {
-    for (int i = 0; i < size.rows; i++){
-        for (int j = 0; j < size.cols; j++) {
-            if (static_cast<int>(cells[i].size()) > j) {
-                if (auto cell = GetCell({i, j}); cell) {
-                    output << cell->GetText();
-                }
-            }
-            if (j != size.cols - 1)
-                output << '\t';
-        }
-        output << '\n';
-    }
+    LatencyScope timing(stats, SheetMethod::PrintTexts);
+    TraceSpan span("PrintTexts", "print");
+    AllocScope allocations(AllocSubsystem::Print);
+    Exporter().WriteTexts(*this, output);
 }
 
 void SpreadSheet::CheckSizeCorrectly(Position pos) {
@@ -428,7 +772,22 @@ void SpreadSheet::CheckSizeCorrectly(Position pos) {
         size.cols = pos.col + 1;
 }
 
-SpreadSheet::SpreadSheet() : dep_graph(*this), size(Size{0, 0}), default_value("", this) {}
+SpreadSheet::SpreadSheet() : dep_graph(*this, &stats), size(Size{0, 0}), default_value("", this) {}
+
+SheetStats SpreadSheet::GetStats() const {
+    return stats.Get();
+}
+
+void SpreadSheet::ResetStats() {
+    stats.Reset();
+}
+
+void SpreadSheet::Clear() {
+    cells.clear();
+    memory_usage.reset();
+    dep_graph.Clear();
+    size = Size{0, 0};
+}
 
 void SpreadSheet::TryToCompress(Position from_pos) {
     if (from_pos.col == size.cols - 1) {
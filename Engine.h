@@ -1,35 +1,69 @@
 #ifndef SPREADSHEET_ENGINE_H
 #define SPREADSHEET_ENGINE_H
 
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <string>
 #include <variant>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 #include <unordered_map>
 #include <utility>
 
 #include "Graph.h"
+#include "Journal.h"
 #include "AST.h"
+#include "BoxedValue.h"
+#include "ChangeSet.h"
+#include "Recalc.h"
+#include "Snapshot.h"
+#include "Stats.h"
+#include "Subscriptions.h"
+#include "Format.h"
+#include "Literal.h"
+#include "Memory.h"
+#include "TextPool.h"
 #include "common.h"
 #include "formula.h"
 
+// Чтение ячеек (GetValue, GetText) можно вести из нескольких потоков
+// одновременно, если таблица в это время не изменяется. Значение формулы
+// вычисляется один раз под её мьютексом и публикуется записью status = Valid;
+// чтение уже вычисленного значения блокировок не берёт
 struct DefaultFormula : public IFormula {
     enum class Status {
         Invalid,
         Error,
         Valid
-    } mutable status = Status::Invalid;
+    };
+    mutable std::atomic<Status> status {Status::Invalid};
 
     explicit DefaultFormula(std::string const & val, const ISheet * sheet = nullptr);
+    DefaultFormula(std::shared_ptr<AST::ASTree> tree, const ISheet * sheet);
 
-    Value GetValue() const;
+    // Значение на таблице sheet_ в упакованном виде
+    BoxedValue GetValue() const;
 
     FormulaError GetError() const;
 
     IFormula::Value Evaluate(const ISheet& sheet) const override;
 
     std::string GetExpression() const override;
+    // Каноническое выражение хранится в формуле и перестраивается только
+    // после изменений, о которых сообщили Handle*, и смены формата чисел
+    // таблицы. Числа записываются в формате таблицы sheet_
+    std::string const & GetCachedExpression() const;
+    // Выражение с числами в кратчайшей точной записи при любом формате
+    // таблицы: по нему формула восстанавливается без потерь
+    std::string GetExactExpression() const;
+    // Сбрасывает кешированное выражение
+    void InvalidateExpression();
+    // Хеш текста "=выражение" без пробельных символов
+    uint64_t GetExpressionHash() const;
 
     [[nodiscard]] std::vector<Position> GetReferencedCells() const override;
 
@@ -40,32 +74,116 @@ struct DefaultFormula : public IFormula {
     HandlingResult HandleDeletedCols(int first, int count = 1) override;
 
     const std::shared_ptr<AST::ASTree> GetAST() const;
+    // Добавляет к usage формулу, её дерево и кэш выражения
+    void AddMemoryUsage(SheetMemoryUsage & usage) const;
+    [[nodiscard]] const ISheet * GetSheet() const {
+        return sheet_;
+    }
+    // Счётчики таблицы sheet_, если это SpreadSheet
+    [[nodiscard]] StatsCollector * GetStatsCollector() const {
+        return stats_;
+    }
+    // Захватывается на время вычисления значения ячейки с этой формулой
+    [[nodiscard]] std::mutex & GetMutex() const {
+        return mutex_;
+    }
 
     friend std::unique_ptr<IFormula> ParseFormula(std::string expression);
 protected:
     mutable FormulaError error {FormulaError::Category::Ref};
     mutable std::shared_ptr<AST::ASTree> as_tree;
     const ISheet * sheet_;
+    StatsCollector * stats_;
+
+    mutable std::mutex mutex_;
+
+    mutable std::string expression_;
+    mutable uint64_t expression_hash_ = 0;
+    mutable std::atomic<bool> expression_cached_ {false};
+    mutable std::mutex expression_mutex_;
 
     void BuildAST(std::string const & text) const;
+    BoxedValue EvaluateBoxed(const ISheet & sheet) const;
+    static StatsCollector * StatsOf(ISheet const * sheet);
+    static NumberFormat FormatOf(ISheet const * sheet);
+    HandlingResult InvalidateExpression(HandlingResult result);
+    // Дерево может разделяться со снимками таблицы, поэтому перед изменением
+    // копируется, если у него есть другие владельцы
+    AST::ASTree & MutableAST();
+    template <typename Pred>
+    bool References(Pred pred) const {
+        auto refs = as_tree ? as_tree->GetCellsPos() : std::vector<Position>{};
+        return std::any_of(refs.begin(), refs.end(), pred);
+    }
 };
 
 struct DefaultCell : public ICell {
+    // Текст текстовой ячейки хранится в пуле таблицы sheet, без таблицы - в
+    // TextPool::Detached(); тексты чисел ячейка хранит сама
     explicit DefaultCell(std::string const & text, ISheet const * sheet = nullptr);
+    DefaultCell(std::string_view text, Literal literal, ISheet const * sheet = nullptr);
+    explicit DefaultCell(std::shared_ptr<DefaultFormula> formula);
     [[nodiscard]] Value GetValue() const override;
+    // То же значение без сборки ICell::Value; текст - BoxedValue::Text()
+    [[nodiscard]] BoxedValue GetBoxedValue() const;
 
     [[nodiscard]] std::string GetText() const override;
+    // Текст, который разбирается обратно в ту же ячейку; отличается от
+    // GetText числами формул, если формат таблицы теряет точность
+    [[nodiscard]] std::string GetExactText() const;
 
     [[nodiscard]] std::vector<Position> GetReferencedCells() const override;
 
+    // Совпадает ли текст ячейки с text с точностью до пробелов в формуле.
+    // Сначала сравниваются хеши, поэтому несовпадение обнаруживается за O(1)
+    [[nodiscard]] bool HasSameText(std::string_view text) const;
+    [[nodiscard]] uint64_t GetTextHash() const;
+    static uint64_t HashText(std::string_view text);
+
     [[nodiscard]] std::shared_ptr<DefaultFormula> GetFormula() const {
         return formula_;
     }
+    [[nodiscard]] Literal::Kind GetKind() const {
+        return kind_;
+    }
+    // Текст в том виде, в котором он был задан; для формул пуст. Указывает
+    // в пул текстов или в саму ячейку и действителен до изменения ячейки
+    [[nodiscard]] std::string_view GetRawText() const {
+        return text_.View();
+    }
+    // Значение текстовой ячейки без экранирующего символа, без копирования
+    [[nodiscard]] std::string_view GetTextValue() const;
+    // Значение формулы, вычисленное ранее (например, сохранённое в снимке)
+    void RestoreValue(BoxedValue cached);
+    // Добавляет к usage ячейку, её текст и формулу
+    void AddMemoryUsage(SheetMemoryUsage & usage) const;
+
+    // Позиция в таблице и версия последнего изменения текста или значения;
+    // ведёт SpreadSheet
+    [[nodiscard]] Position GetPosition() const {
+        return pos_;
+    }
+    [[nodiscard]] uint64_t GetVersion() const {
+        return version_;
+    }
+    void SetVersion(Position pos, uint64_t version) const {
+        pos_ = pos;
+        version_ = version;
+    }
 private:
-    mutable Value value;
+    static TextPool & PoolOf(ISheet const * sheet);
+
+    Literal::Kind kind_ = Literal::Kind::Empty;
+    CellText text_;
+    mutable BoxedValue value;
     std::shared_ptr<DefaultFormula> formula_ = nullptr;
+    mutable Position pos_ {0, 0};
+    mutable uint64_t version_ = 0;
+};
 
-    bool AllIsDigits(std::string const & str);
+struct CellEntry {
+    Position pos;
+    std::shared_ptr<DefaultCell> cell;
 };
 
 struct SpreadSheet : public ISheet {
@@ -88,16 +206,179 @@ public:
 
     void PrintValues(std::ostream& output) const override;
     void PrintTexts(std::ostream& output) const override;
+
+    // Пакетная загрузка заранее разобранных ячеек с неповторяющимися позициями.
+    // Рёбра графа добавляются без проверок, затем граф один раз проверяется на
+    // циклы. При исключении прежнее содержимое позиций восстанавливается
+    void LoadCells(std::vector<CellEntry> entries);
+
+    void SetNumberSyntax(NumberSyntax syntax);
+    [[nodiscard]] NumberSyntax GetNumberSyntax() const;
+
+    // Как числа выводятся в значениях и выражениях формул, по умолчанию
+    // NumberFormat::Shortest. Смена формата перестраивает тексты формул
+    void SetNumberFormat(NumberFormat format);
+    [[nodiscard]] NumberFormat GetNumberFormat() const;
+
+    // Двоичный снимок таблицы: тексты, формулы в виде программ (AST::Program),
+    // связи графа и последние вычисленные значения. Load отображает файл в
+    // память и восстанавливает таблицу без разбора формул, заменяя текущее
+    // содержимое. Формат описан в SnapshotFile.h
+    void Save(std::string const & path) const;
+    void Load(std::string const & path);
+
+    // Журнал, в который пишется каждая успешная изменяющая операция; таблица
+    // им не владеет. Номер последней записанной операции сохраняется в снимке.
+    // Журнал с меньшим номером, чем у таблицы, усекается до её номера, с
+    // большим (не применённые Replay операции) - std::logic_error
+    void SetJournal(Journal * journal);
+    [[nodiscard]] uint64_t GetJournalSequence() const;
+    // Применяет записи журнала с номерами больше GetJournalSequence(). Подряд
+    // идущие SetCell/ClearCell загружаются одним LoadCells
+    void Replay(std::string const & journal_path);
+    // Save и усечение журнала до сохранённого номера
+    void Checkpoint(std::string const & snapshot_path);
+
+    // Версия последнего изменения; растёт с каждой изменяющей операцией
+    [[nodiscard]] uint64_t GetVersion() const;
+    // Ячейки, текст или значение которых изменились после версии since, и
+    // очищенные ячейки. Если ничего не менялось, ответ дан за O(1), иначе
+    // просматриваются только плитки, изменившиеся после since. Хранится не
+    // больше kMaxRemovedCells последних очисток: для since старше них ответ
+    // содержит таблицу целиком
+    [[nodiscard]] ChangeSet GetChangesSince(uint64_t since) const;
+
+    // Снимок текущего содержимого за O(1): таблица ведёт персистентное дерево
+    // ячеек, и последующие изменения копируют только затронутые узлы. Дерево
+    // строится при первом вызове, до этого изменения за него не платят.
+    // Вызывается в том же потоке, что и изменения
+    [[nodiscard]] std::shared_ptr<const SheetSnapshot> Snapshot() const;
+
+    // Пакет изменений. Между BeginBatch и Commit вызовы SetCell и ClearCell
+    // только запоминаются: текст разбирается сразу, и ошибка формулы бросается
+    // из SetCell, но чтения видят таблицу до пакета. Commit применяет пакет
+    // разом, как LoadCells: граф обновляется один раз и один раз проверяется
+    // на циклы. При исключении таблица остаётся такой, какой была до пакета.
+    // Вставка и удаление строк и столбцов, LoadCells, Load и Replay внутри
+    // пакета бросают std::logic_error
+    void BeginBatch();
+    void Commit();
+    void Rollback();
+    [[nodiscard]] bool InBatch() const;
+
+    // Режим пересчёта. В Async изменяющие операции не ждут вычислений: их
+    // результат передаётся фоновому потоку (RecalcWorker), который
+    // пересчитывает только зависящие от изменений формулы. Чтения через
+    // GetCell по-прежнему вычисляют значения сами
+    void SetRecalcMode(RecalcMode mode);
+    [[nodiscard]] RecalcMode GetRecalcMode() const;
+    // Последний снимок, в котором вычислены все формулы; в Lazy - Snapshot()
+    [[nodiscard]] std::shared_ptr<const SheetSnapshot> GetConsistentView() const;
+    // Значение ячейки после пересчёта всех изменений, сделанных до вызова.
+    // Как и WaitForRecalc, можно вызывать из любого потока
+    [[nodiscard]] std::shared_future<ICell::Value> GetValueAsync(Position pos) const;
+    // Ждёт, пока пересчитаны все изменения, сделанные до вызова, и
+    // разосланы уведомления о них
+    void WaitForRecalc() const;
+
+    // Подписка на значения ячеек range. После каждого пересчёта (в Lazy -
+    // после каждой изменяющей операции) подписчик получает одно уведомление
+    // со всеми ячейками, значение которых действительно изменилось. Функция
+    // вызывается в потоке пересчёта и не должна менять таблицу или ждать
+    // пересчёта; очередь можно читать из любых потоков. Возвращает номер для
+    // Unsubscribe
+    uint64_t Subscribe(CellRange range, NotificationCallback callback);
+    uint64_t Subscribe(CellRange range, std::shared_ptr<NotificationQueue> queue);
+    bool Unsubscribe(uint64_t id);
+
+    // Счётчики горячих путей и гистограммы задержек методов ISheet с
+    // последнего ResetStats; без SPREADSHEET_STATS - нули. Можно вызывать
+    // параллельно с чтениями
+    [[nodiscard]] SheetStats GetStats() const;
+    void ResetStats();
+
+    // Оценка занятой памяти по подсистемам. Обход ячеек и графа занимает
+    // O(ячеек + рёбер), его результат запоминается до следующего изменения
+    // таблицы, так что повторные вызовы без правок стоят O(1). Вызывается в
+    // том же потоке, что и изменения
+    [[nodiscard]] SheetMemoryUsage MemoryUsage() const;
 private:
+    void Clear();
+    void Log(JournalOp op, Position pos, int first, int count, std::string_view text = {});
+    // SetCell с точным текстом cell; без журнала текст не строится
+    void LogSetCell(Position pos, DefaultCell const & cell);
+
+    // Позиции с пустым указателем очищаются, затем остальные загружаются
+    // одним LoadCells; при ошибке очищенные восстанавливаются
+    void ApplyCells(std::map<Position, std::shared_ptr<DefaultCell>> staged);
+    void CheckNoBatch() const;
+
+    void TouchTile(Position pos, uint64_t version, bool invalidated = false) const;
+    void MarkChanged(Position pos, DefaultCell const & cell, uint64_t version) const;
+    void MarkValueChanged(DefaultCell const & cell) const;
+    // После структурных изменений: позиции ячеек пересчитываются, а следующие
+    // запросы изменений получают таблицу целиком
+    void ResetPositions();
+    // Запоминает очистку pos; сверх kMaxRemovedCells старшая половина
+    // очисток забывается и сдвигает removed_horizon
+    void RecordRemoved(Position pos, uint64_t version);
+    // Переносит содержимое позиции в дерево снимков, если оно ведётся
+    void FreezeCell(Position pos);
+    // Передаёт накопленные изменения фоновому пересчёту, а без него сразу
+    // уведомляет подписчиков. Внутри LoadCells и ApplyCells откладывается до
+    // конца операции (recalc_hold)
+    void PublishChanges();
+    void NotifySubscribers();
+    uint64_t Subscribe(CellRange range, NotificationCallback callback, std::shared_ptr<NotificationQueue> queue);
     void CheckSizeCorrectly(Position pos);
     void TryToCompress(Position from_pos);
 
     friend DependencyGraph;
+    friend struct Exporter;
+    friend struct DefaultCell;
+    friend struct DefaultFormula;
 
+    // Объявлен первым: ячейки возвращают тексты в пул, разрушаясь
+    mutable TextPool text_pool;
     std::vector<std::vector<std::weak_ptr<DefaultCell>>> cells {};
+    mutable StatsCollector stats;
     mutable DependencyGraph dep_graph;
 
     Size size;
+    NumberSyntax number_syntax = NumberSyntax::Decimal;
+    NumberFormat number_format = NumberFormat::Shortest;
+
+    Journal * journal = nullptr;
+    uint64_t journal_sequence = 0;
+
+    std::optional<std::map<Position, std::shared_ptr<DefaultCell>>> batch;
+
+    uint64_t change_version = 0;
+    uint64_t structure_version = 0;
+    // только плитки, в которых что-то менялось, по TileIndex
+    mutable FlatMap<uint64_t, TileVersions> tiles;
+    // Защищает плитки и версии ячеек от читателей, пересчитывающих формулы
+    mutable std::mutex change_mutex;
+    // Очищенные позиции без ячеек и версии их очистки. Запросы изменений со
+    // since раньше removed_horizon (забытые очистки) получают таблицу целиком
+    std::map<Position, uint64_t> removed_cells;
+    uint64_t removed_horizon = 0;
+
+    // результат MemoryUsage и версия, для которой он посчитан
+    mutable std::optional<SheetMemoryUsage> memory_usage;
+    mutable uint64_t memory_usage_version = 0;
+
+    mutable CellTrie frozen_cells;
+    mutable bool frozen = false;
+
+    std::vector<Position> recalc_changes;
+    bool recalc_full = false;
+    int recalc_hold = 0;
+    std::atomic<uint64_t> recalc_version {0};
+    Notifier notifier;
+    uint64_t notified_version = 0;
+    // поток пересчёта работает только с переданными ему деревьями и notifier
+    std::unique_ptr<RecalcWorker> recalc;
 
     DefaultCell default_value;
 };
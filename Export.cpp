@@ -0,0 +1,146 @@
+#include "Export.h"
+#include "Engine.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+Exporter::Exporter(ExportOptions const & options) : options_(options), buffers_(1) {}
+
+void Exporter::AppendRows(SpreadSheet const & sheet, Bounds const & bounds, int first_row, int last_row,
+                          std::string & out, AppendCell append_cell, NumberFormatter & formatter) {
+    for (int i = first_row; i < last_row; i++) {
+        auto & row = sheet.cells[i];
+        int filled = std::clamp(static_cast<int>(row.size()), bounds.first_col, bounds.last_col);
+        for (int j = bounds.first_col; j < filled; j++) {
+            if (auto cell = row[j].lock(); cell)
+                append_cell(*cell, out, formatter);
+            if (j != bounds.last_col - 1)
+                out += '\t';
+        }
+        // за последней ячейкой строки остаются только разделители
+        if (filled < bounds.last_col)
+            out.append(bounds.last_col - 1 - filled, '\t');
+        out += '\n';
+    }
+}
+
+void Exporter::Write(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range, AppendCell append_cell, PrepareCell prepare_cell) {
+    auto printable = sheet.GetPrintableSize();
+    Bounds bounds{};
+    bounds.first_row = std::max(range.first.row, 0);
+    bounds.first_col = std::max(range.first.col, 0);
+    bounds.last_row = static_cast<int>(std::min<long long>(printable.rows, static_cast<long long>(bounds.first_row) + std::max(range.size.rows, 0)));
+    bounds.last_col = static_cast<int>(std::min<long long>(printable.cols, static_cast<long long>(bounds.first_col) + std::max(range.size.cols, 0)));
+    bounds.last_col = std::max(bounds.last_col, bounds.first_col);
+
+    if (options_.threads != 1 && bounds.last_row > bounds.first_row + 1) {
+        WriteStripes(sheet, output, bounds, append_cell, prepare_cell);
+        return;
+    }
+
+    auto & buffer = buffers_.front();
+    NumberFormatter formatter(sheet.GetNumberFormat());
+    buffer.clear();
+    for (int i = bounds.first_row; i < bounds.last_row; i++) {
+        AppendRows(sheet, bounds, i, i + 1, buffer, append_cell, formatter);
+        if (buffer.size() >= options_.buffer_size) {
+            output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+    output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Exporter::WriteStripes(SpreadSheet const & sheet, std::ostream & output, Bounds const & bounds, AppendCell append_cell, PrepareCell prepare_cell) {
+    // Вычисления меняют кешированные значения формул, поэтому выполняются
+    // заранее в одном потоке; после них форматирование только читает ячейки
+    for (int i = bounds.first_row; i < bounds.last_row; i++) {
+        auto & row = sheet.cells[i];
+        int filled = std::clamp(static_cast<int>(row.size()), bounds.first_col, bounds.last_col);
+        for (int j = bounds.first_col; j < filled; j++) {
+            if (auto cell = row[j].lock(); cell)
+                prepare_cell(*cell);
+        }
+    }
+
+    // Полоса - столько строк, сколько примерно занимает buffer_size байт
+    int cols = std::max(bounds.last_col - bounds.first_col, 1);
+    int stripe_rows = static_cast<int>(std::clamp<size_t>(options_.buffer_size / (cols * 8), 1, Position::kMaxRows));
+    int stripes = (bounds.last_row - bounds.first_row + stripe_rows - 1) / stripe_rows;
+
+    size_t threads = options_.threads;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::clamp<size_t>(threads, 1, stripes);
+    buffers_.resize(std::max(buffers_.size(), threads));
+
+    auto format = sheet.GetNumberFormat();
+    std::vector<std::exception_ptr> errors(threads);
+    // Полосы обрабатываются волнами по threads штук, чтобы память не росла
+    // с размером таблицы
+    for (int first_stripe = 0; first_stripe < stripes; first_stripe += static_cast<int>(threads)) {
+        int wave = std::min(static_cast<int>(threads), stripes - first_stripe);
+        auto format_stripe = [&, first_stripe](size_t index) {
+            try {
+                auto & buffer = buffers_[index];
+                buffer.clear();
+                int first_row = bounds.first_row + (first_stripe + static_cast<int>(index)) * stripe_rows;
+                NumberFormatter formatter(format);
+                AppendRows(sheet, bounds, first_row, std::min(first_row + stripe_rows, bounds.last_row), buffer, append_cell, formatter);
+            } catch (...) {
+                errors[index] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 1; i < wave; i++) {
+            workers.emplace_back(format_stripe, i);
+        }
+        format_stripe(0);
+        for (auto & worker : workers) {
+            worker.join();
+        }
+
+        for (int i = 0; i < wave; i++) {
+            if (errors[i])
+                std::rethrow_exception(errors[i]);
+            output.write(buffers_[i].data(), static_cast<std::streamsize>(buffers_[i].size()));
+        }
+    }
+}
+
+void Exporter::WriteValues(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range) {
+    auto append_value = [](DefaultCell const & cell, std::string & out, NumberFormatter & formatter) {
+        if (cell.GetKind() == Literal::Kind::Text) {
+            out += cell.GetTextValue();
+            return;
+        }
+        auto value = cell.GetBoxedValue();
+        if (value.IsNumber())
+            formatter.Append(value.AsNumber(), out);
+        else if (value.IsError())
+            out += value.AsError().ToString();
+    };
+    auto evaluate = [](DefaultCell const & cell) {
+        if (cell.GetFormula())
+            (void)cell.GetBoxedValue();
+    };
+    Write(sheet, output, range, append_value, evaluate);
+}
+
+void Exporter::WriteTexts(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range) {
+    auto append_text = [](DefaultCell const & cell, std::string & out, NumberFormatter &) {
+        if (auto formula = cell.GetFormula(); formula) {
+            out += kFormulaSign;
+            out += formula->GetCachedExpression();
+        } else {
+            out += cell.GetRawText();
+        }
+    };
+    auto build_expression = [](DefaultCell const & cell) {
+        if (auto formula = cell.GetFormula(); formula)
+            formula->GetCachedExpression();
+    };
+    Write(sheet, output, range, append_text, build_expression);
+}
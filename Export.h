@@ -0,0 +1,56 @@
+#ifndef SPREADSHEET_EXPORT_H
+#define SPREADSHEET_EXPORT_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+struct SpreadSheet;
+struct DefaultCell;
+struct NumberFormatter;
+
+// Прямоугольник [first, first + size), обрезается по печатной области таблицы.
+// По умолчанию - вся таблица
+struct ExportRange {
+    Position first {0, 0};
+    Size size {Position::kMaxRows, Position::kMaxCols};
+};
+
+struct ExportOptions {
+    size_t buffer_size = 1 << 20;   // сколько байт копится перед записью в поток
+    unsigned threads = 1;           // 0 - по числу ядер
+};
+
+// Пишет значения или тексты в формате PrintValues/PrintTexts. Вывод копится
+// в собственных буферах, которые переиспользуются между вызовами, и уходит в
+// поток блоками не меньше buffer_size. Каждая ячейка читается и вычисляется
+// один раз, хвосты строк без ячеек заполняются разделителями целиком.
+// С несколькими потоками формулы сначала вычисляются последовательно, затем
+// полосы строк форматируются параллельно, каждая в свой буфер, и пишутся в
+// поток по порядку. Результат побайтно совпадает с последовательным
+struct Exporter {
+public:
+    explicit Exporter(ExportOptions const & options = {});
+
+    void WriteValues(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range = {});
+    void WriteTexts(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range = {});
+private:
+    struct Bounds {
+        int first_row, last_row;
+        int first_col, last_col;
+    };
+    using AppendCell = void (*)(DefaultCell const &, std::string &, NumberFormatter &);
+    using PrepareCell = void (*)(DefaultCell const &);
+
+    void Write(SpreadSheet const & sheet, std::ostream & output, ExportRange const & range, AppendCell append_cell, PrepareCell prepare_cell);
+    void WriteStripes(SpreadSheet const & sheet, std::ostream & output, Bounds const & bounds, AppendCell append_cell, PrepareCell prepare_cell);
+    static void AppendRows(SpreadSheet const & sheet, Bounds const & bounds, int first_row, int last_row,
+                           std::string & out, AppendCell append_cell, NumberFormatter & formatter);
+
+    ExportOptions options_;
+    std::vector<std::string> buffers_;
+};
+
+#endif //SPREADSHEET_EXPORT_H
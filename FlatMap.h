@@ -0,0 +1,251 @@
+#ifndef SPREADSHEET_FLAT_MAP_H
+#define SPREADSHEET_FLAT_MAP_H
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+// Позиция, упакованная в одно число: строка в старших битах, столбец в
+// младших 14. Порядок ключей совпадает с порядком Position
+struct PositionKey {
+    static constexpr int kColBits = 14;
+    static constexpr int kRowBits = 64 - kColBits;
+    static_assert(Position::kMaxCols <= (1 << kColBits), "column does not fit into PositionKey");
+
+    uint64_t value = 0;
+
+    PositionKey() = default;
+    PositionKey(Position pos) : value(static_cast<uint64_t>(pos.row) << kColBits | static_cast<uint64_t>(pos.col)) {
+        assert(pos.IsValid());
+    }
+    [[nodiscard]] Position ToPosition() const {
+        return {static_cast<int>(value >> kColBits), static_cast<int>(value & ((uint64_t(1) << kColBits) - 1))};
+    }
+
+    bool operator==(PositionKey rhs) const {
+        return value == rhs.value;
+    }
+    bool operator<(PositionKey rhs) const {
+        return value < rhs.value;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<PositionKey> {
+        size_t operator()(PositionKey key) const noexcept {
+            return static_cast<size_t>(key.value);
+        }
+    };
+}
+
+// Хеш-таблица с открытой адресацией и линейным пробированием: пары лежат
+// подряд в одном массиве, вставка выделяет память только при росте таблицы.
+// Вставка может перенести все элементы, удаление сдвигает следующие за
+// удалённым, поэтому итераторы и ссылки живут только до изменения таблицы.
+// Порядок обхода не определён
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatMap {
+    using Slot = std::optional<std::pair<Key, Value>>;
+public:
+    using value_type = std::pair<Key, Value>;
+
+    template <typename SlotIt, typename Ref>
+    class Iterator {
+    public:
+        Iterator(SlotIt it, SlotIt end) : it_(it), end_(end) {
+            Skip();
+        }
+        Ref operator*() const {
+            return **it_;
+        }
+        auto operator->() const {
+            return &**it_;
+        }
+        Iterator & operator++() {
+            ++it_;
+            Skip();
+            return *this;
+        }
+        bool operator==(Iterator const & rhs) const {
+            return it_ == rhs.it_;
+        }
+        bool operator!=(Iterator const & rhs) const {
+            return it_ != rhs.it_;
+        }
+    private:
+        friend FlatMap;
+        void Skip() {
+            while (it_ != end_ && !*it_)
+                ++it_;
+        }
+        SlotIt it_, end_;
+    };
+    using iterator = Iterator<typename std::vector<Slot>::iterator, value_type &>;
+    using const_iterator = Iterator<typename std::vector<Slot>::const_iterator, value_type const &>;
+
+    iterator begin() {
+        return {slots_.begin(), slots_.end()};
+    }
+    iterator end() {
+        return {slots_.end(), slots_.end()};
+    }
+    const_iterator begin() const {
+        return {slots_.begin(), slots_.end()};
+    }
+    const_iterator end() const {
+        return {slots_.end(), slots_.end()};
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+    // Байты массива ячеек
+    [[nodiscard]] size_t MemoryUsage() const {
+        return slots_.capacity() * sizeof(Slot);
+    }
+
+    void clear() {
+        slots_.clear();
+        size_ = 0;
+        shift_ = 64;
+    }
+    // Места на count элементов без роста таблицы
+    void reserve(size_t count) {
+        size_t capacity = kMinCapacity;
+        while (capacity * kMaxLoad < count * kLoadDenominator)
+            capacity *= 2;
+        if (capacity > slots_.size())
+            Rehash(capacity);
+    }
+
+    iterator find(Key const & key) {
+        return {slots_.begin() + static_cast<std::ptrdiff_t>(FindIndex(key)), slots_.end()};
+    }
+    const_iterator find(Key const & key) const {
+        return {slots_.begin() + static_cast<std::ptrdiff_t>(FindIndex(key)), slots_.end()};
+    }
+    [[nodiscard]] size_t count(Key const & key) const {
+        return FindIndex(key) != slots_.size();
+    }
+    Value & at(Key const & key) {
+        auto index = FindIndex(key);
+        if (index == slots_.size())
+            throw std::out_of_range("FlatMap::at");
+        return slots_[index]->second;
+    }
+    Value const & at(Key const & key) const {
+        auto index = FindIndex(key);
+        if (index == slots_.size())
+            throw std::out_of_range("FlatMap::at");
+        return slots_[index]->second;
+    }
+    Value & operator[](Key const & key) {
+        return try_emplace(key).first->second;
+    }
+
+    // Как у std::unordered_map: существующий элемент не заменяется
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key const & key, Args &&... args) {
+        if (auto index = FindIndex(key); index != slots_.size())
+            return {At(index), false};
+        if ((size_ + 1) * kLoadDenominator > slots_.size() * kMaxLoad)
+            Rehash(slots_.empty() ? kMinCapacity : slots_.size() * 2);
+        auto index = Home(key);
+        while (slots_[index])
+            index = (index + 1) & Mask();
+        slots_[index].emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        size_++;
+        return {At(index), true};
+    }
+    template <typename V>
+    std::pair<iterator, bool> emplace(Key const & key, V && value) {
+        return try_emplace(key, std::forward<V>(value));
+    }
+
+    size_t erase(Key const & key) {
+        auto index = FindIndex(key);
+        if (index == slots_.size())
+            return 0;
+        EraseIndex(index);
+        return 1;
+    }
+    void erase(iterator it) {
+        EraseIndex(static_cast<size_t>(it.it_ - slots_.begin()));
+    }
+private:
+    static constexpr size_t kMinCapacity = 8;
+    // наибольшая заполненность 3/4
+    static constexpr size_t kMaxLoad = 3;
+    static constexpr size_t kLoadDenominator = 4;
+
+    [[nodiscard]] size_t Mask() const {
+        return slots_.size() - 1;
+    }
+    // Фибоначчиево хеширование: старшие биты произведения перемешаны и для
+    // выровненных указателей, и для идущих подряд чисел
+    [[nodiscard]] size_t Home(Key const & key) const {
+        return static_cast<size_t>((static_cast<uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+    // Индекс ключа или slots_.size(), если его нет
+    [[nodiscard]] size_t FindIndex(Key const & key) const {
+        if (slots_.empty())
+            return 0;
+        for (auto index = Home(key); slots_[index]; index = (index + 1) & Mask()) {
+            if (slots_[index]->first == key)
+                return index;
+        }
+        return slots_.size();
+    }
+    iterator At(size_t index) {
+        return {slots_.begin() + static_cast<std::ptrdiff_t>(index), slots_.end()};
+    }
+
+    // Элементы за удалённым, чьё место в цепочке пробирования не раньше
+    // освободившейся ячейки, сдвигаются назад, так что надгробия не нужны
+    void EraseIndex(size_t hole) {
+        slots_[hole].reset();
+        size_--;
+        for (auto index = (hole + 1) & Mask(); slots_[index]; index = (index + 1) & Mask()) {
+            auto home = Home(slots_[index]->first);
+            bool stays = hole <= index ? (hole < home && home <= index) : (hole < home || home <= index);
+            if (stays)
+                continue;
+            slots_[hole] = std::move(slots_[index]);
+            slots_[index].reset();
+            hole = index;
+        }
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> old(capacity);
+        std::swap(old, slots_);
+        shift_ = 64;
+        for (size_t bits = capacity; bits > 1; bits >>= 1)
+            shift_--;
+        for (auto & slot : old) {
+            if (!slot)
+                continue;
+            auto index = Home(slot->first);
+            while (slots_[index])
+                index = (index + 1) & Mask();
+            slots_[index] = std::move(slot);
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    int shift_ = 64;
+};
+
+#endif //SPREADSHEET_FLAT_MAP_H
@@ -0,0 +1,26 @@
+#include "Format.h"
+
+#include <charconv>
+
+char * FormatNumber(double value, char * first, char * last, NumberFormat format) {
+    std::to_chars_result res;
+    if (format == NumberFormat::Stream)
+        res = std::to_chars(first, last, value, std::chars_format::general, 6);
+    else
+        res = std::to_chars(first, last, value);
+    return res.ptr;
+}
+
+std::string_view NumberFormatter::Format(double value) {
+    auto end = FormatNumber(value, buf_, buf_ + kMaxNumberLength, format_);
+    return std::string_view(buf_, end - buf_);
+}
+
+void NumberFormatter::Append(double value, std::string & out) {
+    out.append(Format(value));
+}
+
+std::string FormatNumber(double value) {
+    NumberFormatter formatter;
+    return std::string(formatter.Format(value));
+}
@@ -0,0 +1,34 @@
+#ifndef SPREADSHEET_FORMAT_H
+#define SPREADSHEET_FORMAT_H
+
+#include <string>
+#include <string_view>
+
+// Как числа превращаются в текст при выводе значений и выражений
+enum class NumberFormat {
+    Shortest,   // кратчайшая запись, по которой число восстанавливается без потерь
+    Stream      // как std::ostream по умолчанию: 6 значащих цифр
+};
+
+// Достаточно для любого double в обоих форматах
+inline constexpr size_t kMaxNumberLength = 32;
+
+// Пишет число в [first, last), возвращает указатель за последним символом
+char * FormatNumber(double value, char * first, char * last, NumberFormat format);
+
+// Форматирует числа в собственный буфер, который переиспользуется между вызовами
+struct NumberFormatter {
+public:
+    explicit NumberFormatter(NumberFormat format = NumberFormat::Shortest) : format_(format) {}
+
+    // Результат действителен до следующего вызова Format
+    std::string_view Format(double value);
+    void Append(double value, std::string & out);
+private:
+    NumberFormat format_;
+    char buf_[kMaxNumberLength];
+};
+
+std::string FormatNumber(double value);
+
+#endif //SPREADSHEET_FORMAT_H
@@ -1,9 +1,14 @@
 #include "Graph.h"
+#include "Allocations.h"
 #include "Engine.h"
+#include "Tracing.h"
 
 #include <algorithm>
+#include <cassert>
+#include <climits>
 
 std::weak_ptr<DefaultCell> DependencyGraph::AddVertex(Position pos, std::shared_ptr<DefaultCell> new_cell) {
+    AllocScope allocations(AllocSubsystem::Graph);
     if (IsExist(pos)) {
         *cache_cells_located_behind_table[pos].cur_val = std::move(*new_cell);
         auto it = vertexes.find(cache_cells_located_behind_table[pos].cur_val);
@@ -16,8 +21,20 @@ std::weak_ptr<DefaultCell> DependencyGraph::AddVertex(Position pos, std::shared_
 }
 
 void DependencyGraph::Delete(Position pos, const std::shared_ptr<DefaultCell>& cell_ptr) {
+    AllocScope allocations(AllocSubsystem::Graph);
+    DeleteEdges(cell_ptr);
+    if (vertexes.at(cell_ptr).outcoming_ids.empty()) {
+        vertexes.erase(cell_ptr);
+    } else {
+        *cell_ptr = DefaultCell("");
+        cache_cells_located_behind_table.emplace(pos, CacheVertex{cell_ptr});
+    }
+}
+
+void DependencyGraph::DeleteEdges(const std::shared_ptr<DefaultCell>& cell_ptr) {
+    AllocScope allocations(AllocSubsystem::Graph);
     auto it = vertexes.find(cell_ptr);
-    auto inc_ids = it->second.incoming_ids;
+    std::vector<std::shared_ptr<DefaultCell>> released;
     for (auto el : it->second.incoming_ids) {
         auto child = vertexes.find(incoming.at(el).to.lock());
         auto & out_from_child = child->second.outcoming_ids;
@@ -29,6 +46,8 @@ void DependencyGraph::Delete(Position pos, const std::shared_ptr<DefaultCell>& c
         outcoming.erase(*to_del);
         out_from_child.erase(to_del);
         incoming.erase(el);
+        if (child->second.detached && out_from_child.empty())
+            released.push_back(child->first);
     }
     it->second.incoming_ids.clear();
     auto child_cells = cell_ptr->GetReferencedCells();
@@ -37,20 +56,21 @@ void DependencyGraph::Delete(Position pos, const std::shared_ptr<DefaultCell>& c
             if (child_it->second.cur_val && vertexes.at(child_it->second.cur_val).outcoming_ids.empty()) {
                 vertexes.erase(child_it->second.cur_val);
                 Delete(child);
+                // ячейки больше нет и в сетке: следующие снимки её не видят
+                if (auto spread_sheet = dynamic_cast<SpreadSheet *>(&sheet); spread_sheet)
+                    spread_sheet->FreezeCell(child);
             } else if (vertexes.at(child_it->second.cur_val).outcoming_ids.empty()) {
                 Delete(child);
             }
         }
     }
-    if (vertexes.at(cell_ptr).outcoming_ids.empty()) {
-        vertexes.erase(cell_ptr);
-    } else {
-        *cell_ptr = DefaultCell("");
-        cache_cells_located_behind_table.emplace(pos, CacheVertex{cell_ptr});
-    }
+    for (auto & child : released)
+        vertexes.erase(child);
 }
 
-void DependencyGraph::AddEdge(Position par_pos, Position child_pos) {
+void DependencyGraph::AddEdge(Position par_pos, Position child_pos, bool check_acyclicity) {
+    AllocScope allocations(AllocSubsystem::Graph);
+    TraceSpan span("AddEdge", "graph", par_pos);
     if (outcoming.empty() && incoming.empty())
         c = 0;
     if (c == INT_MAX)
@@ -83,14 +103,21 @@ void DependencyGraph::AddEdge(Position par_pos, Position child_pos) {
     auto in_it = incoming.emplace(edge_id, Edge{par_cell, child_cell});
     vertexes.at(par_cell).incoming_ids.push_back(edge_id);
 
-    try {
-        CheckAcyclicity(par_cell);
-    } catch (const CircularDependencyException& excp) {
-        outcoming.erase(out_it.first);
-        incoming.erase(in_it.first);
-        vertexes.at(par_cell).incoming_ids.pop_back();
-        vertexes.at(child_cell).outcoming_ids.pop_back();
-        throw excp;
+    if (check_acyclicity) {
+        try {
+            CheckAcyclicity({par_cell});
+        } catch (const CircularDependencyException& excp) {
+            outcoming.erase(out_it.first);
+            incoming.erase(in_it.first);
+            vertexes.at(par_cell).incoming_ids.pop_back();
+            vertexes.at(child_cell).outcoming_ids.pop_back();
+            throw excp;
+        }
+    }
+    // ребро держит ячейку в графе, пока формула на неё ссылается
+    if (auto formula = par_cell->GetFormula(); formula) {
+        if (auto & as_tree = formula->GetAST(); as_tree)
+            as_tree->Bind(child_pos, child_cell.get(), &sheet);
     }
 }
 
@@ -119,22 +146,35 @@ void DependencyGraph::InvalidIncoming(std::shared_ptr<DefaultCell> cell_ptr) {
 }
 
 void DependencyGraph::InvalidOutcoming(std::shared_ptr<DefaultCell> cell_ptr) {
+    TraceSpan span("Invalidate", "graph");
+    auto invalidated = Invalidate(cell_ptr);
+    AddStat(stats, StatCounter::CellsInvalidated, invalidated);
+    span.SetCount(static_cast<int64_t>(invalidated));
+}
+
+uint64_t DependencyGraph::Invalidate(std::shared_ptr<DefaultCell> const & cell_ptr) {
     auto it = vertexes.find(cell_ptr);
     if (it == vertexes.end())
-        return;
+        return 0;
 
+    uint64_t invalidated = 0;
     auto formula_it = it->first->GetFormula().get();
     if (formula_it && formula_it->status == DefaultFormula::Status::Invalid) {
-        return;
+        return 0;
     } else if (formula_it) {
         formula_it->status = DefaultFormula::Status::Invalid;
+        invalidated++;
+        // значение может измениться: плитка попадёт в следующий запрос изменений
+        if (auto spread_sheet = dynamic_cast<SpreadSheet const *>(&sheet); spread_sheet)
+            spread_sheet->TouchTile(it->first->GetPosition(), spread_sheet->change_version, true);
     }
 
     for (auto id : it->second.outcoming_ids) {
         auto next_cell = vertexes.find(outcoming.at(id).to.lock());
 
-        InvalidOutcoming(next_cell->first);
+        invalidated += Invalidate(next_cell->first);
     }
+    return invalidated;
 }
 
 bool DependencyGraph::IsExist(Position pos) {
@@ -147,90 +187,151 @@ void DependencyGraph::Delete(Position pos) {
     cache_cells_located_behind_table.erase(pos);
 }
 
+void DependencyGraph::Clear() {
+    vertexes.clear();
+    cache_cells_located_behind_table.clear();
+    outcoming.clear();
+    incoming.clear();
+    c = 0;
+}
+
 void DependencyGraph::InvalidOutcoming(Position pos) {
     if (cache_cells_located_behind_table.count(pos))
         InvalidOutcoming(cache_cells_located_behind_table.at(pos).cur_val);
 }
 
 void DependencyGraph::InsertRows(int before, int count) {
+    AllocScope allocations(AllocSubsystem::Graph);
     if (cache_cells_located_behind_table.empty())
         return;
-    if (std::prev(cache_cells_located_behind_table.end())->first.row >= Position::kMaxRows - count)
+    if (GetMaxCachePos().row >= Position::kMaxRows - count)
         throw TableTooBigException("can't insert because too big exception");
 
-    std::map<Position, CacheVertex> new_cache;
-    for (auto & el : cache_cells_located_behind_table){
-        if (el.first.row >= before) {
-            new_cache[{el.first.row + count, el.first.col}] = std::move(el.second);
-        } else {
-            new_cache[el.first] = std::move(el.second);
-        }
+    FlatMap<PositionKey, CacheVertex> new_cache;
+    new_cache.reserve(cache_cells_located_behind_table.size());
+    for (auto & [key, vertex] : cache_cells_located_behind_table){
+        auto pos = key.ToPosition();
+        if (pos.row >= before)
+            pos.row += count;
+        new_cache.emplace(pos, std::move(vertex));
     }
     std::swap(cache_cells_located_behind_table, new_cache);
 }
 
 void DependencyGraph::InsertCols(int before, int count) {
+    AllocScope allocations(AllocSubsystem::Graph);
     if (cache_cells_located_behind_table.empty())
         return;
-    if (std::prev(cache_cells_located_behind_table.end())->first.col >= Position::kMaxCols - count)
+    if (GetMaxCachePos().col >= Position::kMaxCols - count)
         throw TableTooBigException("can't insert because too big exception");
 
-    std::map<Position, CacheVertex> new_cache;
-    for (auto & el : cache_cells_located_behind_table){
-        if (el.first.col >= before) {
-            new_cache[{el.first.row, el.first.col + count}] = std::move(el.second);
-        } else {
-            new_cache[el.first] = std::move(el.second);
-        }
+    FlatMap<PositionKey, CacheVertex> new_cache;
+    new_cache.reserve(cache_cells_located_behind_table.size());
+    for (auto & [key, vertex] : cache_cells_located_behind_table){
+        auto pos = key.ToPosition();
+        if (pos.col >= before)
+            pos.col += count;
+        new_cache.emplace(pos, std::move(vertex));
     }
     std::swap(cache_cells_located_behind_table, new_cache);
 }
 
+void DependencyGraph::Detach(std::shared_ptr<DefaultCell> const & cell_ptr) {
+    auto it = vertexes.find(cell_ptr);
+    if (it->second.outcoming_ids.empty())
+        vertexes.erase(it);
+    else
+        it->second.detached = true;
+}
+
+// Позиции за удалёнными строками сдвигаются, как и ссылки формул. Ссылки на
+// удалённые строки становятся #REF!, а их вершины остаются в графе, пока на
+// них указывают рёбра ссылавшихся формул
 void DependencyGraph::DeleteRows(int first, int count) {
-    std::map<Position, CacheVertex> new_cache;
-    for (auto & el : cache_cells_located_behind_table){
-        if (el.first.row > first && el.first.row >= first + count) {
-            new_cache[el.first] = std::move(el.second);
+    AllocScope allocations(AllocSubsystem::Graph);
+    FlatMap<PositionKey, CacheVertex> new_cache;
+    new_cache.reserve(cache_cells_located_behind_table.size());
+    for (auto & [key, vertex] : cache_cells_located_behind_table){
+        auto pos = key.ToPosition();
+        if (pos.row < first) {
+            new_cache.emplace(pos, std::move(vertex));
+        } else if (pos.row >= first + count) {
+            new_cache.emplace(Position{pos.row - count, pos.col}, std::move(vertex));
         } else {
-            vertexes.erase(new_cache[el.first].cur_val);
+            Detach(vertex.cur_val);
         }
     }
     std::swap(cache_cells_located_behind_table, new_cache);
 }
 
 void DependencyGraph::DeleteCols(int first, int count) {
-    std::map<Position, CacheVertex> new_cache;
-    for (auto & el : cache_cells_located_behind_table){
-        if (el.first.col >= first && el.first.col >= first + count) {
-            new_cache[el.first] = std::move(el.second);
+    AllocScope allocations(AllocSubsystem::Graph);
+    FlatMap<PositionKey, CacheVertex> new_cache;
+    new_cache.reserve(cache_cells_located_behind_table.size());
+    for (auto & [key, vertex] : cache_cells_located_behind_table){
+        auto pos = key.ToPosition();
+        if (pos.col < first) {
+            new_cache.emplace(pos, std::move(vertex));
+        } else if (pos.col >= first + count) {
+            new_cache.emplace(Position{pos.row, pos.col - count}, std::move(vertex));
         } else {
-            vertexes.erase(new_cache[el.first].cur_val);
+            Detach(vertex.cur_val);
         }
     }
     std::swap(cache_cells_located_behind_table, new_cache);
 }
 
-void DependencyGraph::CheckAcyclicity(std::shared_ptr<struct DefaultCell> cell_ptr) {
-    std::unordered_set<std::shared_ptr<struct DefaultCell>> solo_cells;
-
-    solo_cells.insert(cell_ptr);
-    CheckAcylicityImpl(cell_ptr, solo_cells);
-}
+// Обход в глубину от roots по ссылкам формул. До проверки граф был ацикличен,
+// поэтому любой новый цикл проходит через одну из roots
+void DependencyGraph::CheckAcyclicity(std::vector<std::shared_ptr<DefaultCell>> const & roots) {
+    AllocScope allocations(AllocSubsystem::Graph);
+    enum class Color {
+        InProgress,
+        Done
+    };
+    FlatMap<DefaultCell const *, Color> colors;
+    colors.reserve(roots.size() * 2);
+    std::vector<std::pair<std::shared_ptr<DefaultCell>, size_t>> path;
+    uint64_t visited = 0;
+    TraceSpan span("CheckAcyclicity", "graph");
+
+    for (auto & root : roots) {
+        if (!colors.emplace(root.get(), Color::InProgress).second)
+            continue;
+        path.emplace_back(root, 0);
+
+        while (!path.empty()) {
+            auto & ids = vertexes.at(path.back().first).incoming_ids;
+            if (path.back().second == ids.size()) {
+                colors[path.back().first.get()] = Color::Done;
+                path.pop_back();
+                continue;
+            }
 
-void DependencyGraph::CheckAcylicityImpl(std::shared_ptr<struct DefaultCell> cell_ptr,
-                                         std::unordered_set<std::shared_ptr<struct DefaultCell>> &cols) {
-    for (int id : vertexes.at(cell_ptr).outcoming_ids){
-        if (cols.count(outcoming.at(id).to.lock()))
-            throw CircularDependencyException{"circular dependency"};
-        cols.insert(outcoming.at(id).to.lock());
-        CheckAcylicityImpl(outcoming.at(id).to.lock(), cols);
+            auto child = incoming.at(ids[path.back().second++]).to.lock();
+            visited++;
+            auto [it, inserted] = colors.emplace(child.get(), Color::InProgress);
+            if (inserted) {
+                path.emplace_back(std::move(child), 0);
+            } else if (it->second == Color::InProgress) {
+                AddStat(stats, StatCounter::EdgesVisited, visited);
+                span.SetCount(static_cast<int64_t>(visited));
+                throw CircularDependencyException{"circular dependency"};
+            }
+        }
     }
+    AddStat(stats, StatCounter::EdgesVisited, visited);
+    span.SetCount(static_cast<int64_t>(visited));
 }
 
 Position DependencyGraph::GetMaxCachePos() const {
-    if (cache_cells_located_behind_table.empty())
-        return {0, 0};
-    return std::prev(cache_cells_located_behind_table.end())->first;
+    Position max_pos {0, 0};
+    for (auto & [key, vertex] : cache_cells_located_behind_table) {
+        auto pos = key.ToPosition();
+        max_pos.row = std::max(max_pos.row, pos.row);
+        max_pos.col = std::max(max_pos.col, pos.col);
+    }
+    return max_pos;
 }
 
 bool DependencyGraph::HasOutcomings(Position pos) {
@@ -1,14 +1,14 @@
 #ifndef SPREADSHEET_GRAPH_H
 #define SPREADSHEET_GRAPH_H
 
+#include "FlatMap.h"
+#include "Memory.h"
+#include "Stats.h"
 #include "common.h"
 
 #include <algorithm>
 #include <memory>
-#include <map>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
 
 struct Edge {
     std::weak_ptr<struct DefaultCell> from;
@@ -18,6 +18,9 @@ using EdgeID = size_t;
 struct Edges {
     std::vector<EdgeID> incoming_ids;
     std::vector<EdgeID> outcoming_ids;
+    // Ячейка удалённой строки или столбца: её нет ни в таблице, ни за ней, и
+    // вершину держат только рёбра формул, чьи ссылки на неё стали #REF!
+    bool detached = false;
 };
 
 struct CacheVertex {
@@ -26,14 +29,21 @@ struct CacheVertex {
 
 struct DependencyGraph {
 public:
-    explicit DependencyGraph(ISheet & com_sheet) : sheet(com_sheet) {}
+    explicit DependencyGraph(ISheet & com_sheet, StatsCollector * stats = nullptr) : sheet(com_sheet), stats(stats) {}
 
     std::weak_ptr<struct DefaultCell> AddVertex(Position pos, std::shared_ptr<struct DefaultCell> new_cell);
     bool IsExist(Position pos);
-    void AddEdge(Position par_pos, Position child_pos);
+    // При check_acyclicity == false проверка откладывается до явного вызова
+    // CheckAcyclicity: так пакетная загрузка проверяет граф один раз
+    void AddEdge(Position par_pos, Position child_pos, bool check_acyclicity = true);
+    void CheckAcyclicity(std::vector<std::shared_ptr<struct DefaultCell>> const & roots);
 
     void Delete(Position pos, const std::shared_ptr<struct DefaultCell>& cell_ptr);
+    // Удаляет только рёбра от ячейки к ячейкам, на которые ссылается её
+    // формула, и ставшие ненужными ячейки за таблицей
+    void DeleteEdges(const std::shared_ptr<struct DefaultCell>& cell_ptr);
     void Delete(Position pos);
+    void Clear();
 
     void InsertRows(int before, int count);
     void InsertCols(int before, int count);
@@ -48,19 +58,28 @@ public:
 
     bool HasOutcomings(Position pos);
 
+    // Наибольшие строка и столбец среди ячеек за пределами таблицы
     Position GetMaxCachePos() const;
+
+    // Добавляет к usage вершины, рёбра и карту ячеек за таблицей, а также
+    // сами ячейки: граф владеет всеми ячейками таблицы
+    void AddMemoryUsage(SheetMemoryUsage & usage) const;
 private:
-    std::unordered_map<std::shared_ptr<struct DefaultCell>, Edges> vertexes;
-    std::map<Position, CacheVertex> cache_cells_located_behind_table;
+    // Сбрасывает формулу и всех зависящих от неё; возвращает число сброшенных
+    uint64_t Invalidate(std::shared_ptr<struct DefaultCell> const & cell_ptr);
+    // Вершина ячейки за таблицей, попавшей в удалённые строки или столбцы:
+    // удаляется сразу или вместе с последним ребром к ней
+    void Detach(std::shared_ptr<struct DefaultCell> const & cell_ptr);
+
+    FlatMap<std::shared_ptr<struct DefaultCell>, Edges> vertexes;
+    FlatMap<PositionKey, CacheVertex> cache_cells_located_behind_table;
 
-    std::unordered_map<int, Edge> outcoming;
-    std::unordered_map<int, Edge> incoming;
+    FlatMap<int, Edge> outcoming;
+    FlatMap<int, Edge> incoming;
     int c = 0;
 
     ISheet & sheet;
-
-    void CheckAcyclicity(std::shared_ptr<struct DefaultCell> cell_ptr);
-    void CheckAcylicityImpl(std::shared_ptr<struct DefaultCell> cell_ptr, std::unordered_set<std::shared_ptr<struct DefaultCell>> & cols);
+    StatsCollector * stats;
 };
 
 #endif //SPREADSHEET_GRAPH_H
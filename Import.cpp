@@ -0,0 +1,117 @@
+#include "Import.h"
+#include "Engine.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace {
+    // При автоматическом выборе числа потоков куски меньше этого не выделяются
+    constexpr size_t kMinChunkSize = 1 << 20;
+
+    struct Chunk {
+        std::string_view data;
+        int rows = 0;
+        std::vector<CellEntry> entries;
+        std::exception_ptr error;
+    };
+
+    std::vector<Chunk> SplitRows(std::string_view data, size_t count) {
+        std::vector<Chunk> chunks;
+        size_t begin = 0;
+        for (size_t i = 1; i <= count && begin < data.size(); i++) {
+            size_t end = std::max(begin, data.size() / count * i);
+            if (i == count || end >= data.size()) {
+                end = data.size();
+            } else {
+                end = data.find('\n', end);
+                end = (end == std::string_view::npos) ? data.size() : end + 1;
+            }
+            chunks.emplace_back().data = data.substr(begin, end - begin);
+            begin = end;
+        }
+        return chunks;
+    }
+
+    void ParseChunk(Chunk & chunk, char delimiter, SpreadSheet const & sheet) {
+        auto syntax = sheet.GetNumberSyntax();
+        auto data = chunk.data;
+        int row = 0;
+        while (!data.empty()) {
+            auto eol = data.find('\n');
+            auto line = data.substr(0, eol);
+            data.remove_prefix(eol == std::string_view::npos ? data.size() : eol + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            int col = 0;
+            size_t start = 0;
+            while (true) {
+                auto end = line.find(delimiter, start);
+                auto field = line.substr(start, end - start);
+                if (!field.empty()) {
+                    auto literal = ClassifyLiteral(field, syntax);
+                    chunk.entries.push_back({Position{row, col}, std::make_shared<DefaultCell>(field, literal, &sheet)});
+                }
+                if (end == std::string_view::npos)
+                    break;
+                start = end + 1;
+                col++;
+            }
+            row++;
+        }
+        chunk.rows = row;
+    }
+}
+
+void ImportTexts(SpreadSheet & sheet, std::string_view data, ImportOptions const & options) {
+    size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::clamp<size_t>(data.size() / kMinChunkSize, 1, threads);
+    }
+
+    auto chunks = SplitRows(data, threads);
+    auto parse = [&](Chunk & chunk) {
+        try {
+            ParseChunk(chunk, options.delimiter, sheet);
+        } catch (...) {
+            chunk.error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        workers.emplace_back(parse, std::ref(chunks[i]));
+    }
+    if (!chunks.empty())
+        parse(chunks.front());
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    size_t total = 0;
+    for (auto & chunk : chunks) {
+        if (chunk.error)
+            std::rethrow_exception(chunk.error);
+        total += chunk.entries.size();
+    }
+
+    std::vector<CellEntry> entries;
+    entries.reserve(total);
+    int first_row = 0;
+    for (auto & chunk : chunks) {
+        for (auto & entry : chunk.entries) {
+            entry.pos.row += first_row;
+            entries.push_back(std::move(entry));
+        }
+        first_row += chunk.rows;
+    }
+    sheet.LoadCells(std::move(entries));
+}
+
+void ImportFile(SpreadSheet & sheet, std::string const & path, ImportOptions const & options) {
+    MappedFile file(path);
+    ImportTexts(sheet, file.GetData(), options);
+}
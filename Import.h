@@ -0,0 +1,22 @@
+#ifndef SPREADSHEET_IMPORT_H
+#define SPREADSHEET_IMPORT_H
+
+#include <string>
+#include <string_view>
+
+struct SpreadSheet;
+
+struct ImportOptions {
+    char delimiter = '\t';  // ',' для CSV; кавычки не поддерживаются
+    unsigned threads = 0;   // 0 - по числу ядер и размеру данных
+};
+
+// Загружает текст в формате PrintTexts: строки таблицы разделены '\n', ячейки -
+// delimiter, пустое поле означает пустую ячейку. Данные делятся на куски по
+// границам строк, которые разбираются параллельно (включая построение AST
+// формул), а затем добавляются в таблицу одним вызовом SpreadSheet::LoadCells.
+// Исключения разбора и проверки циклов пробрасываются, таблица не меняется
+void ImportTexts(SpreadSheet & sheet, std::string_view data, ImportOptions const & options = {});
+void ImportFile(SpreadSheet & sheet, std::string const & path, ImportOptions const & options = {});
+
+#endif //SPREADSHEET_IMPORT_H
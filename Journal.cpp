@@ -0,0 +1,310 @@
+#include "Journal.h"
+#include "Engine.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kJournalMagic[8] = {'S', 'P', 'J', 'O', 'U', 'R', 'N', 'L'};
+    constexpr uint32_t kJournalVersion = 1;
+    constexpr uint32_t kJournalByteOrder = 0x01020304;
+
+    struct JournalHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t base_sequence;     // номер, с которого продолжается нумерация
+    };
+
+    struct RecordHeader {
+        uint32_t text_size;
+        uint32_t checksum;          // от sequence до конца текста
+        uint64_t sequence;
+        uint8_t op;
+        uint8_t reserved[3];
+        int32_t row;
+        int32_t col;
+        int32_t first;
+        int32_t count;
+        int32_t pad;
+    };
+
+    static_assert(sizeof(JournalHeader) == 24);
+    static_assert(sizeof(RecordHeader) == 40);
+
+    uint32_t Checksum(RecordHeader const & header, std::string_view text) {
+        uint32_t hash = 2166136261u;
+        auto append = [&hash](char const * data, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+            }
+        };
+        constexpr size_t offset = offsetof(RecordHeader, sequence);
+        append(reinterpret_cast<char const *>(&header) + offset, sizeof(header) - offset);
+        append(text.data(), text.size());
+        return hash;
+    }
+
+    // Разбирает журнал; возвращает длину части, состоящей из целых записей
+    size_t Parse(std::string_view data, std::vector<JournalRecord> * records, uint64_t & base_sequence, uint64_t & last_sequence) {
+        JournalHeader header{};
+        if (data.size() < sizeof(header))
+            throw std::runtime_error("journal is truncated");
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, kJournalMagic, sizeof(header.magic)) != 0)
+            throw std::runtime_error("not a spreadsheet journal");
+        if (header.version != kJournalVersion || header.byte_order != kJournalByteOrder)
+            throw std::runtime_error("unsupported journal version");
+
+        base_sequence = last_sequence = header.base_sequence;
+        size_t offset = sizeof(header);
+        while (data.size() - offset >= sizeof(RecordHeader)) {
+            RecordHeader record{};
+            std::memcpy(&record, data.data() + offset, sizeof(record));
+            if (record.text_size > data.size() - offset - sizeof(record))
+                break;
+            std::string_view text = data.substr(offset + sizeof(record), record.text_size);
+            if (record.checksum != Checksum(record, text) || record.sequence <= last_sequence
+                || record.op > static_cast<uint8_t>(JournalOp::DeleteCols))
+                break;
+
+            if (records) {
+                auto & result = records->emplace_back();
+                result.sequence = record.sequence;
+                result.op = static_cast<JournalOp>(record.op);
+                result.pos = {record.row, record.col};
+                result.first = record.first;
+                result.count = record.count;
+                result.text = text;
+            }
+            last_sequence = record.sequence;
+            offset += sizeof(record) + record.text_size;
+        }
+        return offset;
+    }
+
+    // Атомарно заменяет path пустым журналом
+    void CreateEmpty(std::string const & path, uint64_t base_sequence, bool sync) {
+        JournalHeader header{};
+        std::memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+        header.version = kJournalVersion;
+        header.byte_order = kJournalByteOrder;
+        header.base_sequence = base_sequence;
+
+        auto temp_path = path + ".tmp";
+        std::FILE * file = std::fopen(temp_path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("can't create journal " + path);
+        bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fflush(file) == 0;
+        if (written && sync)
+            SyncFile(file);
+        std::fclose(file);
+        if (!written)
+            throw std::runtime_error("can't write journal " + path);
+        std::filesystem::rename(temp_path, path);
+    }
+}
+
+void SyncFile(std::FILE * file) {
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+Journal::Journal(std::string path, JournalOptions const & options) : path_(std::move(path)), options_(options) {
+    Open();
+}
+
+Journal::~Journal() {
+    try {
+        WriteGroup();
+    } catch (...) {
+    }
+    if (file_)
+        std::fclose(file_);
+}
+
+void Journal::Open() {
+    std::error_code error;
+    if (std::filesystem::file_size(path_, error) == 0 || error) {
+        CreateEmpty(path_, 0, options_.sync);
+        last_sequence_ = 0;
+    } else {
+        size_t valid_size, file_size;
+        {
+            MappedFile file(path_);
+            uint64_t base_sequence;
+            file_size = file.GetData().size();
+            valid_size = Parse(file.GetData(), nullptr, base_sequence, last_sequence_);
+        }
+        // оборванный хвост отрезается, чтобы новые записи шли за целыми
+        if (valid_size < file_size)
+            std::filesystem::resize_file(path_, valid_size);
+    }
+
+    file_ = std::fopen(path_.c_str(), "ab");
+    if (!file_)
+        throw std::runtime_error("can't open journal " + path_);
+}
+
+uint64_t Journal::Append(JournalOp op, Position pos, int first, int count, std::string_view text) {
+    RecordHeader record{};
+    record.text_size = static_cast<uint32_t>(text.size());
+    record.sequence = ++last_sequence_;
+    record.op = static_cast<uint8_t>(op);
+    record.row = pos.row;
+    record.col = pos.col;
+    record.first = first;
+    record.count = count;
+    record.checksum = Checksum(record, text);
+
+    group_.append(reinterpret_cast<char const *>(&record), sizeof(record));
+    group_ += text;
+    if (++group_records_ >= options_.group_records || group_.size() >= options_.group_bytes)
+        WriteGroup();
+    return record.sequence;
+}
+
+void Journal::WriteGroup() {
+    if (group_.empty())
+        return;
+    if (std::fwrite(group_.data(), 1, group_.size(), file_) != group_.size() || std::fflush(file_) != 0)
+        throw std::runtime_error("can't write journal " + path_);
+    if (options_.sync)
+        SyncFile(file_);
+    group_.clear();
+    group_records_ = 0;
+}
+
+void Journal::Commit() {
+    WriteGroup();
+}
+
+void Journal::Truncate(uint64_t sequence) {
+    group_.clear();
+    group_records_ = 0;
+    std::fclose(file_);
+    file_ = nullptr;
+
+    CreateEmpty(path_, sequence, options_.sync);
+    last_sequence_ = sequence;
+    file_ = std::fopen(path_.c_str(), "ab");
+    if (!file_)
+        throw std::runtime_error("can't open journal " + path_);
+}
+
+std::vector<JournalRecord> Journal::Read(std::string const & path, uint64_t * base_sequence) {
+    std::vector<JournalRecord> records;
+    uint64_t base = 0, last = 0;
+    std::error_code error;
+    if (std::filesystem::file_size(path, error) > 0 && !error) {
+        MappedFile file(path);
+        Parse(file.GetData(), &records, base, last);
+    }
+    if (base_sequence)
+        *base_sequence = base;
+    return records;
+}
+
+void SpreadSheet::SetJournal(Journal * new_journal) {
+    if (new_journal && new_journal->GetLastSequence() > journal_sequence)
+        throw std::logic_error("journal has operations missing from the sheet");
+    // записи с номерами не больше journal_sequence уже есть в таблице, и
+    // Replay их пропускает: новые записи нумеруются после journal_sequence
+    if (new_journal && new_journal->GetLastSequence() < journal_sequence)
+        new_journal->Truncate(journal_sequence);
+    journal = new_journal;
+}
+
+uint64_t SpreadSheet::GetJournalSequence() const {
+    return journal_sequence;
+}
+
+void SpreadSheet::Log(JournalOp op, Position pos, int first, int count, std::string_view text) {
+    if (journal)
+        journal_sequence = journal->Append(op, pos, first, count, text);
+}
+
+void SpreadSheet::LogSetCell(Position pos, DefaultCell const & cell) {
+    if (journal)
+        Log(JournalOp::SetCell, pos, 0, 0, cell.GetExactText());
+}
+
+void SpreadSheet::Checkpoint(std::string const & snapshot_path) {
+    Save(snapshot_path);
+    if (journal)
+        journal->Truncate(journal_sequence);
+}
+
+void SpreadSheet::Replay(std::string const & journal_path) {
+    CheckNoBatch();
+    auto records = Journal::Read(journal_path);
+    auto attached = std::exchange(journal, nullptr);
+
+    // Подряд идущие SetCell/ClearCell сворачиваются до последнего изменения
+    // каждой позиции и применяются одним ApplyCells
+    std::map<Position, std::optional<std::string>> pending;
+    auto apply_pending = [&]() {
+        std::map<Position, std::shared_ptr<DefaultCell>> staged;
+        for (auto & [pos, text] : pending) {
+            std::shared_ptr<DefaultCell> cell;
+            if (text) {
+                auto literal = ClassifyLiteral(*text, number_syntax);
+                cell = std::make_shared<DefaultCell>(std::move(*text), literal, this);
+            }
+            staged.emplace_hint(staged.end(), pos, std::move(cell));
+        }
+        pending.clear();
+        ApplyCells(std::move(staged));
+    };
+
+    try {
+        for (auto & record : records) {
+            if (record.sequence <= journal_sequence)
+                continue;
+            switch (record.op) {
+                case JournalOp::SetCell:
+                    pending[record.pos] = std::move(record.text);
+                    break;
+                case JournalOp::ClearCell:
+                    pending[record.pos] = std::nullopt;
+                    break;
+                case JournalOp::InsertRows:
+                    apply_pending();
+                    InsertRows(record.first, record.count);
+                    break;
+                case JournalOp::InsertCols:
+                    apply_pending();
+                    InsertCols(record.first, record.count);
+                    break;
+                case JournalOp::DeleteRows:
+                    apply_pending();
+                    DeleteRows(record.first, record.count);
+                    break;
+                case JournalOp::DeleteCols:
+                    apply_pending();
+                    DeleteCols(record.first, record.count);
+                    break;
+            }
+            journal_sequence = record.sequence;
+        }
+        apply_pending();
+    } catch (...) {
+        journal = attached;
+        throw;
+    }
+    journal = attached;
+}
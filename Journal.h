@@ -0,0 +1,78 @@
+#ifndef SPREADSHEET_JOURNAL_H
+#define SPREADSHEET_JOURNAL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.h"
+
+// Журнал изменяющих операций ISheet. Файл начинается с заголовка, за ним идут
+// записи с контрольной суммой и возрастающим номером (sequence). Оборванная
+// последняя запись (сбой посреди записи) при чтении отбрасывается
+enum class JournalOp : uint8_t {
+    SetCell,
+    ClearCell,
+    InsertRows,
+    InsertCols,
+    DeleteRows,
+    DeleteCols
+};
+
+struct JournalRecord {
+    uint64_t sequence = 0;
+    JournalOp op = JournalOp::SetCell;
+    Position pos {0, 0};    // SetCell, ClearCell
+    int first = 0;          // Insert*: before, Delete*: first
+    int count = 0;
+    std::string text;       // SetCell
+};
+
+struct JournalOptions {
+    size_t group_records = 256;     // группа пишется и синхронизируется, набрав столько записей
+    size_t group_bytes = 1 << 20;   // или столько байт
+    bool sync = true;               // false - без fsync, только запись в файл
+};
+
+// Сбрасывает на диск файл, открытый через stdio (fsync)
+void SyncFile(std::FILE * file);
+
+// Записи копятся в группе и попадают на диск одной записью и одним fsync
+// (group commit). До Commit или заполнения группы последние записи при сбое
+// теряются, но журнал остаётся согласованным
+struct Journal {
+public:
+    explicit Journal(std::string path, JournalOptions const & options = {});
+    ~Journal();
+
+    Journal(Journal const &) = delete;
+    Journal & operator=(Journal const &) = delete;
+
+    // Возвращает номер записи
+    uint64_t Append(JournalOp op, Position pos, int first, int count, std::string_view text = {});
+    void Commit();
+    // После сохранения снимка с номером sequence: журнал атомарно заменяется
+    // пустым, нумерация продолжается с sequence
+    void Truncate(uint64_t sequence);
+
+    [[nodiscard]] uint64_t GetLastSequence() const {
+        return last_sequence_;
+    }
+
+    // Все целые записи журнала; отсутствующий файл - пустой журнал
+    static std::vector<JournalRecord> Read(std::string const & path, uint64_t * base_sequence = nullptr);
+private:
+    void Open();
+    void WriteGroup();
+
+    std::string path_;
+    JournalOptions options_;
+    std::FILE * file_ = nullptr;
+    std::string group_;
+    size_t group_records_ = 0;
+    uint64_t last_sequence_ = 0;
+};
+
+#endif //SPREADSHEET_JOURNAL_H
@@ -0,0 +1,57 @@
+#include "Literal.h"
+#include "common.h"
+
+#include <charconv>
+
+namespace {
+    bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    bool ParseNumber(std::string_view text, NumberSyntax syntax, double & number) {
+        const char * first = text.data();
+        const char * last = text.data() + text.size();
+
+        // from_chars не принимает '+', а '-' разбирает сам
+        const char * digits = first;
+        if (*digits == '+' || *digits == '-')
+            digits++;
+        if (digits == last)
+            return false;
+        if (*first == '+')
+            first++;
+
+        // отсекаем "inf", "nan" и прочее, что from_chars считает числом
+        if (!IsDigit(*digits) && !(syntax == NumberSyntax::Decimal && *digits == '.'))
+            return false;
+
+        if (syntax == NumberSyntax::Integer) {
+            for (auto it = digits; it != last; it++) {
+                if (!IsDigit(*it))
+                    return false;
+            }
+        }
+
+        auto [ptr, ec] = std::from_chars(first, last, number, std::chars_format::general);
+        return ec == std::errc() && ptr == last;
+    }
+}
+
+Literal ClassifyLiteral(std::string_view text, NumberSyntax syntax) {
+    if (text.empty())
+        return {Literal::Kind::Empty, 0.0};
+    if (text.front() == kFormulaSign && text.size() > 1)
+        return {Literal::Kind::Formula, 0.0};
+
+    Literal literal{Literal::Kind::Number, 0.0};
+    if (!ParseNumber(text, syntax, literal.number))
+        return {Literal::Kind::Text, 0.0};
+    return literal;
+}
+
+void ClassifyLiterals(std::vector<std::string_view> const & texts, std::vector<Literal> & out, NumberSyntax syntax) {
+    out.resize(texts.size());
+    for (size_t i = 0; i < texts.size(); i++) {
+        out[i] = ClassifyLiteral(texts[i], syntax);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef SPREADSHEET_LITERAL_H
+#define SPREADSHEET_LITERAL_H
+
+#include <string_view>
+#include <vector>
+
+// Какие тексты ячеек трактуются как числа
+enum class NumberSyntax {
+    Integer,    // только целые со знаком: "42", "-7" (прежнее поведение)
+    Decimal     // целые, десятичные дроби и экспонента: "3.14", ".5", "1e-3"
+};
+
+struct Literal {
+    enum class Kind {
+        Empty,
+        Number,
+        Text,
+        Formula
+    } kind = Kind::Empty;
+    double number = 0.0;    // значение для Number и Empty
+};
+
+// Определяет тип содержимого ячейки за один проход по тексту
+Literal ClassifyLiteral(std::string_view text, NumberSyntax syntax = NumberSyntax::Decimal);
+
+// Пакетный вариант для загрузки целого столбца: out[i] соответствует texts[i]
+void ClassifyLiterals(std::vector<std::string_view> const & texts, std::vector<Literal> & out,
+                      NumberSyntax syntax = NumberSyntax::Decimal);
+
+#endif //SPREADSHEET_LITERAL_H
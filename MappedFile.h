@@ -0,0 +1,26 @@
+#ifndef SPREADSHEET_MAPPEDFILE_H
+#define SPREADSHEET_MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+// Файл, отображённый в память только для чтения. Там, где mmap недоступен,
+// содержимое читается в буфер целиком
+struct MappedFile {
+public:
+    explicit MappedFile(std::string const & path);
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+
+    [[nodiscard]] std::string_view GetData() const {
+        return {data_, size_};
+    }
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+    std::string buffer_;
+};
+
+#endif //SPREADSHEET_MAPPEDFILE_H
@@ -0,0 +1,43 @@
+#include "Memory.h"
+#include "Engine.h"
+
+void DefaultFormula::AddMemoryUsage(SheetMemoryUsage & usage) const {
+    usage.formulas += memory::SharedBytes<DefaultFormula>();
+    if (as_tree)
+        usage.formulas += memory::SharedBytes<AST::ASTree>() + as_tree->MemoryUsage();
+    std::lock_guard lock(expression_mutex_);
+    usage.texts += memory::StringBytes(expression_);
+}
+
+void DefaultCell::AddMemoryUsage(SheetMemoryUsage & usage) const {
+    usage.cells += memory::SharedBytes<DefaultCell>();
+    usage.texts += text_.HeapBytes();
+    if (formula_)
+        formula_->AddMemoryUsage(usage);
+}
+
+void DependencyGraph::AddMemoryUsage(SheetMemoryUsage & usage) const {
+    usage.graph_vertexes += vertexes.MemoryUsage();
+    usage.graph_edges += outcoming.MemoryUsage() + incoming.MemoryUsage();
+    usage.graph_cache += cache_cells_located_behind_table.MemoryUsage();
+    for (auto & [cell, edges] : vertexes) {
+        usage.graph_edges += memory::VectorBytes(edges.incoming_ids) + memory::VectorBytes(edges.outcoming_ids);
+        cell->AddMemoryUsage(usage);
+    }
+}
+
+SheetMemoryUsage SpreadSheet::MemoryUsage() const {
+    if (memory_usage && memory_usage_version == change_version)
+        return *memory_usage;
+
+    SheetMemoryUsage usage;
+    usage.grid = memory::VectorBytes(cells);
+    usage.texts = text_pool.MemoryUsage();
+    for (auto & row : cells)
+        usage.grid += memory::VectorBytes(row);
+    dep_graph.AddMemoryUsage(usage);
+
+    memory_usage = usage;
+    memory_usage_version = change_version;
+    return usage;
+}
@@ -0,0 +1,43 @@
+#ifndef SPREADSHEET_MEMORY_H
+#define SPREADSHEET_MEMORY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Оценка памяти таблицы по подсистемам (SpreadSheet::MemoryUsage). Байты
+// считаются по размерам и ёмкостям контейнеров, без служебных заголовков
+// malloc
+struct SheetMemoryUsage {
+    size_t grid = 0;            // строки сетки вместе с неровными хвостами
+    size_t cells = 0;           // объекты DefaultCell
+    size_t texts = 0;           // пул текстов ячеек, тексты чисел и выражений формул вне SSO
+    size_t formulas = 0;        // DefaultFormula и деревья выражений
+    size_t graph_vertexes = 0;
+    size_t graph_edges = 0;
+    size_t graph_cache = 0;     // карта ячеек за пределами таблицы
+
+    [[nodiscard]] size_t Total() const {
+        return grid + cells + texts + formulas + graph_vertexes + graph_edges + graph_cache;
+    }
+};
+
+namespace memory {
+    // Объект из std::make_shared: блок счётчиков и сам объект
+    template <typename T>
+    constexpr size_t SharedBytes() {
+        return sizeof(T) + 2 * sizeof(int) + sizeof(void *);
+    }
+
+    template <typename T>
+    size_t VectorBytes(std::vector<T> const & vector) {
+        return vector.capacity() * sizeof(T);
+    }
+
+    // Буфер строки, если она не уместилась в сам объект
+    inline size_t StringBytes(std::string const & text) {
+        return text.capacity() > std::string().capacity() ? text.capacity() + 1 : 0;
+    }
+}
+
+#endif //SPREADSHEET_MEMORY_H
@@ -0,0 +1,250 @@
+#include "Recalc.h"
+#include "Allocations.h"
+#include "Engine.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+    std::vector<Position> ReferencesOf(FrozenCell const * cell) {
+        if (cell && cell->tree)
+            return cell->tree->GetCellsPos();
+        return {};
+    }
+}
+
+RecalcWorker::RecalcWorker(Notifier * notifier) : notifier_(notifier), thread_(&RecalcWorker::Run, this) {}
+
+RecalcWorker::~RecalcWorker() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    job_ready_.notify_one();
+    thread_.join();
+}
+
+void RecalcWorker::Submit(CellTrie cells, Size size, NumberFormat format, uint64_t version, std::vector<Position> changed, bool full) {
+    {
+        std::lock_guard lock(mutex_);
+        if (!pending_) {
+            pending_ = Job{std::move(cells), size, format, version, std::move(changed), full};
+        } else {
+            // непрочитанное задание поглощается: нужны только последние ячейки
+            // и все изменённые с прошлого пересчёта позиции
+            pending_->cells = std::move(cells);
+            pending_->size = size;
+            pending_->format = format;
+            pending_->version = version;
+            pending_->full = pending_->full || full;
+            if (pending_->full)
+                pending_->changed.clear();
+            else
+                pending_->changed.insert(pending_->changed.end(), changed.begin(), changed.end());
+        }
+    }
+    job_ready_.notify_one();
+}
+
+std::shared_ptr<const SheetSnapshot> RecalcWorker::GetView() const {
+    std::lock_guard lock(mutex_);
+    return view_;
+}
+
+uint64_t RecalcWorker::GetVersion() const {
+    std::lock_guard lock(mutex_);
+    return view_version_;
+}
+
+void RecalcWorker::Wait(uint64_t version) const {
+    std::unique_lock lock(mutex_);
+    view_ready_.wait(lock, [&] { return view_ && view_version_ >= version; });
+}
+
+std::shared_future<ICell::Value> RecalcWorker::GetValue(Position pos, uint64_t version) {
+    std::promise<ICell::Value> promise;
+    std::shared_future<ICell::Value> future = promise.get_future().share();
+    std::shared_ptr<const SheetSnapshot> view;
+    {
+        std::lock_guard lock(mutex_);
+        if (!view_ || view_version_ < version) {
+            waiters_.push_back({pos, version, std::move(promise)});
+            return future;
+        }
+        view = view_;
+    }
+    promise.set_value(ValueOf(*view, pos));
+    return future;
+}
+
+ICell::Value RecalcWorker::ValueOf(SheetSnapshot const & view, Position pos) {
+    if (auto cell = view.GetCell(pos); cell)
+        return cell->GetValue();
+    return ICell::Value(std::string());
+}
+
+void RecalcWorker::Run() {
+    SetTraceThreadName("recalc");
+    // всё, что выделяет поток пересчёта, относится к вычислению
+    AllocScope allocations(AllocSubsystem::Eval);
+    std::unique_lock lock(mutex_);
+    while (true) {
+        job_ready_.wait(lock, [&] { return stop_ || pending_; });
+        if (stop_)
+            return;
+        Job job = std::move(*pending_);
+        pending_.reset();
+        lock.unlock();
+
+        std::vector<Position> dirty;
+        TraceSpan span("Recalculate", "recalc");
+        auto view = Recalculate(job, dirty);
+        span.SetCount(static_cast<int64_t>(dirty.size()));
+        span.Close();
+
+        // Новые подписчики берут начальные значения из view_, поэтому он
+        // публикуется раньше рассылки, а версия - после неё
+        lock.lock();
+        view_ = view;
+        lock.unlock();
+        if (notifier_ && !notifier_->Empty()) {
+            TraceSpan notify_span("Notify", "recalc");
+            if (job.full)
+                notifier_->Publish(job.version, *view, [](int, int) { return true; });
+            else
+                notifier_->Publish(job.version, *view, dirty);
+        }
+
+        std::vector<Waiter> ready;
+        lock.lock();
+        view_version_ = job.version;
+        for (auto it = waiters_.begin(); it != waiters_.end();) {
+            if (it->version <= job.version) {
+                ready.push_back(std::move(*it));
+                it = waiters_.erase(it);
+            } else {
+                it++;
+            }
+        }
+        view_ready_.notify_all();
+        lock.unlock();
+
+        for (auto & waiter : ready) {
+            waiter.promise.set_value(ValueOf(*view, waiter.pos));
+        }
+        lock.lock();
+    }
+}
+
+std::shared_ptr<const SheetSnapshot> RecalcWorker::Recalculate(Job & job, std::vector<Position> & dirty) {
+    if (job.full) {
+        dependents_.clear();
+        values_.Clear();
+        job.cells.ForEach([&](Position pos, FrozenCell const & cell) {
+            if (!cell.tree)
+                return;
+            for (auto & ref : cell.tree->GetCellsPos()) {
+                dependents_[PositionKey(ref)].push_back(pos);
+            }
+            dirty.push_back(pos);
+        });
+    } else {
+        std::unordered_set<PositionKey> seen;
+        for (auto & pos : job.changed) {
+            if (!seen.insert(PositionKey(pos)).second)
+                continue;
+            auto before = cells_.Get(pos);
+            auto after = job.cells.Get(pos);
+            if (before == after)
+                continue;
+            for (auto & ref : ReferencesOf(before)) {
+                auto & list = dependents_[PositionKey(ref)];
+                list.erase(std::remove(list.begin(), list.end(), pos), list.end());
+            }
+            for (auto & ref : ReferencesOf(after)) {
+                dependents_[PositionKey(ref)].push_back(pos);
+            }
+            dirty.push_back(pos);
+        }
+        // конус зависимых формул
+        for (size_t i = 0; i < dirty.size(); i++) {
+            if (auto it = dependents_.find(PositionKey(dirty[i])); it != dependents_.end()) {
+                for (auto & dependent : it->second) {
+                    if (seen.insert(PositionKey(dependent)).second)
+                        dirty.push_back(dependent);
+                }
+            }
+        }
+        for (auto & pos : dirty) {
+            values_.Set(pos, nullptr);
+        }
+    }
+    cells_ = job.cells;
+
+    auto view = std::make_shared<SheetSnapshot>(job.cells, job.size, values_, job.format);
+    for (auto & pos : dirty) {
+        auto frozen = job.cells.Get(pos);
+        auto cell = view->GetCell(pos);
+        if (frozen && frozen->tree && cell) {
+            TraceSpan span("Evaluate", "recalc", pos, TraceSpan::Sampled{});
+            values_.Set(pos, std::make_shared<const ICell::Value>(cell->GetValue()));
+        }
+    }
+    return view;
+}
+
+void SpreadSheet::SetRecalcMode(RecalcMode mode) {
+    if (mode == GetRecalcMode())
+        return;
+    if (mode == RecalcMode::Lazy) {
+        // изменения после последнего пересчёта подписчики получат уже отсюда
+        notified_version = recalc->GetVersion();
+        recalc.reset();
+        recalc_changes.clear();
+        NotifySubscribers();
+        return;
+    }
+    (void)Snapshot();
+    recalc = std::make_unique<RecalcWorker>(&notifier);
+    recalc_full = true;
+    PublishChanges();
+}
+
+RecalcMode SpreadSheet::GetRecalcMode() const {
+    return recalc ? RecalcMode::Async : RecalcMode::Lazy;
+}
+
+std::shared_ptr<const SheetSnapshot> SpreadSheet::GetConsistentView() const {
+    if (!recalc)
+        return Snapshot();
+    // первый пересчёт ещё мог не закончиться
+    recalc->Wait(0);
+    return recalc->GetView();
+}
+
+std::shared_future<ICell::Value> SpreadSheet::GetValueAsync(Position pos) const {
+    if (recalc)
+        return recalc->GetValue(pos, recalc_version);
+    std::promise<ICell::Value> promise;
+    auto cell = GetCell(pos);
+    promise.set_value(cell ? cell->GetValue() : ICell::Value(std::string()));
+    return promise.get_future().share();
+}
+
+void SpreadSheet::WaitForRecalc() const {
+    if (recalc)
+        recalc->Wait(recalc_version);
+}
+
+void SpreadSheet::PublishChanges() {
+    if (recalc_hold)
+        return;
+    if (!recalc) {
+        NotifySubscribers();
+        return;
+    }
+    recalc_version = change_version;
+    recalc->Submit(frozen_cells, size, number_format, change_version, std::move(recalc_changes), std::exchange(recalc_full, false));
+    recalc_changes.clear();
+}
@@ -0,0 +1,87 @@
+#ifndef SPREADSHEET_RECALC_H
+#define SPREADSHEET_RECALC_H
+
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "FlatMap.h"
+#include "Snapshot.h"
+#include "Subscriptions.h"
+#include "common.h"
+
+enum class RecalcMode {
+    Lazy,   // формулы вычисляются при чтении (по умолчанию)
+    Async   // изменения пересчитывает фоновый поток
+};
+
+// Фоновый пересчёт для RecalcMode::Async. Таблица передаёт в Submit дерево
+// ячеек и позиции, изменённые после прошлой передачи; поток сводит
+// накопившиеся передачи в одну, по своему индексу обратных ссылок находит
+// зависящие от изменений формулы, вычисляет только их и публикует снимок, в
+// котором значения всех формул уже известны. Значения остальных формул
+// переходят из прошлого снимка без копирования (ValueTrie)
+class RecalcWorker {
+public:
+    // notifier получает каждый пересчёт до того, как его дождётся Wait
+    explicit RecalcWorker(Notifier * notifier = nullptr);
+    ~RecalcWorker();
+
+    RecalcWorker(RecalcWorker const &) = delete;
+    RecalcWorker & operator=(RecalcWorker const &) = delete;
+
+    // full - позиции ячеек изменились, пересчитывается всё; format - формат
+    // чисел таблицы для снимков
+    void Submit(CellTrie cells, Size size, NumberFormat format, uint64_t version, std::vector<Position> changed, bool full);
+
+    // Последний полностью пересчитанный снимок и его версия
+    [[nodiscard]] std::shared_ptr<const SheetSnapshot> GetView() const;
+    [[nodiscard]] uint64_t GetVersion() const;
+    // Ждёт публикации снимка с версией не меньше version
+    void Wait(uint64_t version) const;
+    // Значение pos в первом снимке с версией не меньше version
+    [[nodiscard]] std::shared_future<ICell::Value> GetValue(Position pos, uint64_t version);
+private:
+    struct Job {
+        CellTrie cells;
+        Size size;
+        NumberFormat format = NumberFormat::Shortest;
+        uint64_t version = 0;
+        std::vector<Position> changed;
+        bool full = false;
+    };
+    struct Waiter {
+        Position pos;
+        uint64_t version;
+        std::promise<ICell::Value> promise;
+    };
+
+    void Run();
+    // dirty - позиции, значения которых могли измениться
+    std::shared_ptr<const SheetSnapshot> Recalculate(Job & job, std::vector<Position> & dirty);
+    static ICell::Value ValueOf(SheetSnapshot const & view, Position pos);
+
+    mutable std::mutex mutex_;
+    std::condition_variable job_ready_;
+    mutable std::condition_variable view_ready_;
+    std::optional<Job> pending_;
+    bool stop_ = false;
+    std::shared_ptr<const SheetSnapshot> view_;
+    uint64_t view_version_ = 0;
+    std::vector<Waiter> waiters_;
+    Notifier * notifier_;
+
+    // Состояние потока пересчёта: ячейки последнего обработанного задания,
+    // значения формул и формулы, ссылающиеся на каждую позицию
+    CellTrie cells_;
+    ValueTrie values_;
+    FlatMap<PositionKey, std::vector<Position>> dependents_;
+
+    std::thread thread_;
+};
+
+#endif //SPREADSHEET_RECALC_H
@@ -0,0 +1,203 @@
+#include "Snapshot.h"
+#include "Allocations.h"
+#include "Engine.h"
+#include "Format.h"
+
+namespace {
+    constexpr size_t kFlushSize = 1 << 20;
+}
+
+std::shared_ptr<const FrozenCell> FrozenCell::From(DefaultCell const & cell) {
+    auto frozen = std::make_shared<FrozenCell>();
+    frozen->kind = cell.GetKind();
+    if (auto formula = cell.GetFormula(); formula) {
+        frozen->tree = formula->GetAST();
+    } else {
+        frozen->text = cell.GetRawText();
+        frozen->value = cell.GetValue();
+    }
+    return frozen;
+}
+
+SheetSnapshot::SheetSnapshot(CellTrie cells, Size size, ValueTrie values, NumberFormat format)
+    : cells_(std::move(cells)), size_(size), values_(std::move(values)), format_(format) {}
+
+SheetSnapshot::Cell::Cell(FrozenCell const & frozen, SheetSnapshot const & sheet, ICell::Value const * computed)
+    : frozen_(frozen), sheet_(sheet) {
+    if (computed) {
+        value_ = *computed;
+        evaluated_.store(true, std::memory_order_relaxed);
+    }
+}
+
+ICell::Value SheetSnapshot::Cell::GetValue() const {
+    if (!frozen_.tree)
+        return frozen_.value;
+    if (!evaluated_.load(std::memory_order_acquire)) {
+        std::lock_guard lock(mutex_);
+        if (!evaluated_.load(std::memory_order_relaxed)) {
+            BoxedValue value;
+            try {
+                value = frozen_.tree->Evaluate(sheet_);
+            } catch (FormulaError & fe) {
+                value = fe;
+            }
+            value_ = value.IsError() ? Value(value.AsError()) : Value(value.AsNumber());
+            evaluated_.store(true, std::memory_order_release);
+        }
+    }
+    return value_;
+}
+
+std::string SheetSnapshot::Cell::GetText() const {
+    if (!frozen_.tree)
+        return frozen_.text;
+    std::string text(1, kFormulaSign);
+    frozen_.tree->AppendExpression(text, sheet_.format_);
+    return text;
+}
+
+std::vector<Position> SheetSnapshot::Cell::GetReferencedCells() const {
+    if (frozen_.tree)
+        return frozen_.tree->GetCellsPos();
+    return {};
+}
+
+SheetSnapshot::Cell * SheetSnapshot::Find(Position pos) const {
+    if (!pos.IsValid() || pos.row >= size_.rows || pos.col >= size_.cols)
+        return nullptr;
+    auto frozen = cells_.Get(pos);
+    if (!frozen)
+        return nullptr;
+
+    std::lock_guard lock(views_mutex_);
+    auto & view = views_[frozen];
+    if (!view)
+        view = std::make_unique<Cell>(*frozen, *this, frozen->tree ? values_.Get(pos) : nullptr);
+    return view.get();
+}
+
+const ICell* SheetSnapshot::GetCell(Position pos) const {
+    return Find(pos);
+}
+
+ICell* SheetSnapshot::GetCell(Position pos) {
+    return Find(pos);
+}
+
+void SheetSnapshot::SetCell(Position, std::string) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+void SheetSnapshot::ClearCell(Position) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+void SheetSnapshot::InsertRows(int, int) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+void SheetSnapshot::InsertCols(int, int) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+void SheetSnapshot::DeleteRows(int, int) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+void SheetSnapshot::DeleteCols(int, int) {
+    throw std::logic_error("snapshot is read-only");
+}
+
+Size SheetSnapshot::GetPrintableSize() const {
+    return size_;
+}
+
+// Формат тот же, что у SpreadSheet::PrintValues/PrintTexts: ячейки строки
+// разделены табуляциями, пустые позиции остаются пустыми
+template <typename Append>
+void SheetSnapshot::Print(std::ostream & output, Append append) const {
+    std::string out;
+    int row = 0, col = 0;
+    auto finish_row = [&] {
+        for (; col < size_.cols; col++) {
+            if (col > 0)
+                out += '\t';
+        }
+        out += '\n';
+        row++;
+        col = 0;
+    };
+    cells_.ForEach([&](Position pos, FrozenCell const & cell) {
+        if (pos.row >= size_.rows || pos.col >= size_.cols)
+            return;
+        while (row < pos.row)
+            finish_row();
+        for (; col <= pos.col; col++) {
+            if (col > 0)
+                out += '\t';
+        }
+        append(pos, cell, out);
+        if (out.size() >= kFlushSize) {
+            output.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    });
+    while (row < size_.rows)
+        finish_row();
+    output.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+void SheetSnapshot::PrintValues(std::ostream & output) const {
+    NumberFormatter formatter(format_);
+    auto append_value = [&](ICell::Value const & value, std::string & out) {
+        if (std::holds_alternative<std::string>(value))
+            out += std::get<std::string>(value);
+        else if (std::holds_alternative<double>(value))
+            formatter.Append(std::get<double>(value), out);
+        else
+            out += std::get<FormulaError>(value).ToString();
+    };
+    Print(output, [&](Position pos, FrozenCell const & cell, std::string & out) {
+        if (cell.tree)
+            append_value(Find(pos)->GetValue(), out);
+        else
+            append_value(cell.value, out);
+    });
+}
+
+void SheetSnapshot::PrintTexts(std::ostream & output) const {
+    Print(output, [this](Position, FrozenCell const & cell, std::string & out) {
+        if (cell.tree) {
+            out += kFormulaSign;
+            cell.tree->AppendExpression(out, format_);
+        } else {
+            out += cell.text;
+        }
+    });
+}
+
+std::shared_ptr<const SheetSnapshot> SpreadSheet::Snapshot() const {
+    AllocScope allocations(AllocSubsystem::Storage);
+    if (!frozen) {
+        frozen = true;
+        for (int row = 0; row < static_cast<int>(cells.size()); row++) {
+            for (int col = 0; col < static_cast<int>(cells[row].size()); col++) {
+                if (auto cell = cells[row][col].lock(); cell)
+                    frozen_cells.Set({row, col}, FrozenCell::From(*cell));
+            }
+        }
+    }
+    return std::make_shared<SheetSnapshot>(frozen_cells, size, ValueTrie{}, number_format);
+}
+
+void SpreadSheet::FreezeCell(Position pos) {
+    if (!frozen)
+        return;
+    std::shared_ptr<DefaultCell> cell;
+    if (pos.row < static_cast<int>(cells.size()) && pos.col < static_cast<int>(cells[pos.row].size()))
+        cell = cells[pos.row][pos.col].lock();
+    frozen_cells.Set(pos, cell ? FrozenCell::From(*cell) : nullptr);
+    if (recalc)
+        recalc_changes.push_back(pos);
+}
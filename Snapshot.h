@@ -0,0 +1,185 @@
+#ifndef SPREADSHEET_SNAPSHOT_H
+#define SPREADSHEET_SNAPSHOT_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "Literal.h"
+#include "common.h"
+
+struct DefaultCell;
+
+// Содержимое ячейки на момент изменения; после создания не меняется.
+// AST формулы разделяется с живой таблицей, которая копирует его перед
+// структурными изменениями (см. DefaultFormula::Handle*)
+struct FrozenCell {
+    Literal::Kind kind = Literal::Kind::Empty;
+    std::string text;                           // как задан; для формул пуст
+    ICell::Value value;                         // для всех, кроме формул
+    std::shared_ptr<const AST::ASTree> tree;    // для формул
+
+    static std::shared_ptr<const FrozenCell> From(DefaultCell const & cell);
+};
+
+// Число значащих битов value
+constexpr int BitWidth(unsigned long long value) {
+    return value ? 1 + BitWidth(value >> 1) : 0;
+}
+
+// Персистентное отображение позиций в неизменяемые T: префиксное дерево по
+// ключу row * kMaxCols + col с ветвлением 32. Копирование - O(1), Set копирует
+// только те узлы на пути к ключу, которые разделены с другими копиями.
+// Изменяет дерево один поток; копии можно читать из любых потоков
+template <typename T>
+struct PersistentGrid {
+public:
+    [[nodiscard]] T const * Get(Position pos) const {
+        auto key = Key(pos);
+        Node const * node = root_.get();
+        for (int level = kLevels - 1; node && level > 0; level--) {
+            node = static_cast<Inner const *>(node)->children[(key >> (level * kBits)) & (kFanout - 1)].get();
+        }
+        return node ? static_cast<Leaf const *>(node)->items[key & (kFanout - 1)].get() : nullptr;
+    }
+
+    void Set(Position pos, std::shared_ptr<const T> item) {
+        if (!item && !Get(pos))
+            return;
+        auto key = Key(pos);
+        std::shared_ptr<Node> * slot = &root_;
+        for (int level = kLevels - 1; level > 0; level--) {
+            slot = &Own<Inner>(*slot).children[(key >> (level * kBits)) & (kFanout - 1)];
+        }
+        Own<Leaf>(*slot).items[key & (kFanout - 1)] = std::move(item);
+    }
+
+    void Clear() {
+        root_.reset();
+    }
+
+    // Обходит непустые позиции по строкам, слева направо
+    template <typename Func>
+    void ForEach(Func func) const {
+        if (root_)
+            Visit(*root_, kLevels - 1, 0, func);
+    }
+private:
+    static constexpr int kBits = 5;
+    static constexpr uint64_t kFanout = uint64_t(1) << kBits;
+    static constexpr int kColBits = BitWidth(Position::kMaxCols - 1);
+    static constexpr int kLevels = (kColBits + BitWidth(Position::kMaxRows - 1) + kBits - 1) / kBits;
+
+    struct Node {};
+    struct Inner : Node {
+        std::array<std::shared_ptr<Node>, kFanout> children;
+    };
+    struct Leaf : Node {
+        std::array<std::shared_ptr<const T>, kFanout> items;
+    };
+
+    static uint64_t Key(Position pos) {
+        return static_cast<uint64_t>(pos.row) << kColBits | static_cast<uint64_t>(pos.col);
+    }
+    // Узел, который можно менять: создаётся или копируется, если разделён.
+    // Копия могла быть освобождена в другом потоке: барьер упорядочивает её
+    // последние чтения узла до записи в него
+    template <typename N>
+    static N & Own(std::shared_ptr<Node> & slot) {
+        if (!slot)
+            slot = std::make_shared<N>();
+        else if (slot.use_count() > 1)
+            slot = std::make_shared<N>(static_cast<N const &>(*slot));
+        else
+            std::atomic_thread_fence(std::memory_order_acquire);
+        return static_cast<N &>(*slot);
+    }
+
+    template <typename Func>
+    static void Visit(Node const & node, int level, uint64_t prefix, Func & func) {
+        if (level == 0) {
+            auto & leaf = static_cast<Leaf const &>(node);
+            for (uint64_t i = 0; i < kFanout; i++) {
+                if (leaf.items[i]) {
+                    uint64_t key = prefix << kBits | i;
+                    func(Position{static_cast<int>(key >> kColBits), static_cast<int>(key & ((uint64_t(1) << kColBits) - 1))}, *leaf.items[i]);
+                }
+            }
+            return;
+        }
+        auto & inner = static_cast<Inner const &>(node);
+        for (uint64_t i = 0; i < kFanout; i++) {
+            if (inner.children[i])
+                Visit(*inner.children[i], level - 1, prefix << kBits | i, func);
+        }
+    }
+
+    std::shared_ptr<Node> root_;
+};
+
+using CellTrie = PersistentGrid<FrozenCell>;
+// Вычисленные значения формул
+using ValueTrie = PersistentGrid<ICell::Value>;
+
+// Неизменяемое представление таблицы на момент SpreadSheet::Snapshot().
+// Значения формул берутся из values, а отсутствующие там вычисляются лениво,
+// по данным снимка, и кешируются в нём; читать снимок можно из нескольких
+// потоков, пока таблица продолжает меняться. Числа выводятся в формате
+// таблицы на момент снимка. Изменяющие методы бросают std::logic_error
+struct SheetSnapshot : public ISheet {
+public:
+    SheetSnapshot(CellTrie cells, Size size, ValueTrie values = {}, NumberFormat format = NumberFormat::Shortest);
+
+    void SetCell(Position pos, std::string text) override;
+
+    const ICell* GetCell(Position pos) const override;
+    ICell* GetCell(Position pos) override;
+
+    void ClearCell(Position pos) override;
+
+    void InsertRows(int before, int count = 1) override;
+    void InsertCols(int before, int count = 1) override;
+
+    void DeleteRows(int first, int count = 1) override;
+    void DeleteCols(int first, int count = 1) override;
+
+    [[nodiscard]] Size GetPrintableSize() const override;
+
+    void PrintValues(std::ostream& output) const override;
+    void PrintTexts(std::ostream& output) const override;
+private:
+    struct Cell : public ICell {
+    public:
+        Cell(FrozenCell const & frozen, SheetSnapshot const & sheet, ICell::Value const * computed);
+
+        [[nodiscard]] Value GetValue() const override;
+        [[nodiscard]] std::string GetText() const override;
+        [[nodiscard]] std::vector<Position> GetReferencedCells() const override;
+    private:
+        FrozenCell const & frozen_;
+        SheetSnapshot const & sheet_;
+        mutable std::atomic<bool> evaluated_ {false};
+        mutable std::mutex mutex_;
+        mutable Value value_;
+    };
+
+    Cell * Find(Position pos) const;
+    template <typename Append>
+    void Print(std::ostream & output, Append append) const;
+
+    CellTrie cells_;
+    Size size_;
+    ValueTrie values_;
+    NumberFormat format_;
+
+    mutable std::mutex views_mutex_;
+    mutable std::unordered_map<FrozenCell const *, std::unique_ptr<Cell>> views_;
+};
+
+#endif //SPREADSHEET_SNAPSHOT_H
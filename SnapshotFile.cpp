@@ -0,0 +1,283 @@
+#include "SnapshotFile.h"
+#include "Engine.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+
+// FNV-1a по 8-байтным словам, хвост добивается побайтно
+uint64_t SnapshotChecksum(char const * data, size_t size) {
+    constexpr uint64_t kPrime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    while (size >= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        hash = (hash ^ word) * kPrime;
+        data += sizeof(word);
+        size -= sizeof(word);
+    }
+    for (; size > 0; data++, size--) {
+        hash = (hash ^ static_cast<unsigned char>(*data)) * kPrime;
+    }
+    return hash;
+}
+
+namespace {
+    template <typename T>
+    void Append(std::string & payload, std::vector<T> const & section) {
+        payload.append(reinterpret_cast<char const *>(section.data()), section.size() * sizeof(T));
+    }
+
+    // Размер секции из count элементов size байт без переполнения
+    uint64_t SectionSize(uint64_t count, uint64_t size, uint64_t limit) {
+        if (count > limit / size)
+            throw std::runtime_error("snapshot is corrupted");
+        return count * size;
+    }
+
+    // Формулы снимка не должны образовывать цикл: рёбра графа при загрузке
+    // добавляются без проверки. index - позиции записей с их номерами,
+    // упорядоченные по позиции
+    void CheckAcyclicity(std::vector<SnapshotCell> const & records, std::vector<SnapshotRef> const & refs,
+                         std::vector<std::pair<Position, size_t>> const & index) {
+        enum class Color : uint8_t {
+            New,
+            InProgress,
+            Done
+        };
+        auto is_formula = [&](size_t record) {
+            return records[record].kind == static_cast<uint8_t>(Literal::Kind::Formula);
+        };
+        auto record_at = [&](SnapshotRef ref) -> std::optional<size_t> {
+            Position pos{ref.row, ref.col};
+            auto it = std::lower_bound(index.begin(), index.end(), pos, [](auto & entry, Position pos) { return entry.first < pos; });
+            if (it == index.end() || !(it->first == pos))
+                return std::nullopt;
+            return it->second;
+        };
+
+        std::vector<Color> colors(records.size(), Color::New);
+        // запись и следующая из её ссылок
+        std::vector<std::pair<size_t, uint64_t>> path;
+        for (size_t root = 0; root < records.size(); root++) {
+            if (colors[root] != Color::New || !is_formula(root))
+                continue;
+            colors[root] = Color::InProgress;
+            path.emplace_back(root, records[root].refs_offset);
+            while (!path.empty()) {
+                auto & [record, ref] = path.back();
+                if (ref == records[record].refs_offset + records[record].refs_count) {
+                    colors[record] = Color::Done;
+                    path.pop_back();
+                    continue;
+                }
+                auto next = record_at(refs[ref++]);
+                if (!next || !is_formula(*next) || colors[*next] == Color::Done)
+                    continue;
+                if (colors[*next] == Color::InProgress)
+                    throw std::runtime_error("snapshot is corrupted");
+                colors[*next] = Color::InProgress;
+                path.emplace_back(*next, records[*next].refs_offset);
+            }
+        }
+    }
+}
+
+void SpreadSheet::Save(std::string const & path) const {
+    std::vector<SnapshotCell> records;
+    std::vector<SnapshotRef> refs;
+    AST::Program code;
+    std::string texts;
+
+    for (int row = 0; row < size.rows; row++) {
+        for (int col = 0; col < static_cast<int>(cells[row].size()); col++) {
+            auto cell = cells[row][col].lock();
+            // пустые ячейки, на которые ссылаются формулы, восстановятся из рёбер
+            if (!cell || dep_graph.IsExist({row, col}))
+                continue;
+
+            SnapshotCell record{};
+            record.row = row;
+            record.col = col;
+            record.kind = static_cast<uint8_t>(cell->GetKind());
+
+            if (auto formula = cell->GetFormula(); formula) {
+                record.data_offset = code.size();
+                formula->GetAST()->Compile(code);
+                record.data_size = code.size() - record.data_offset;
+
+                record.refs_offset = refs.size();
+                for (auto & ref : formula->GetReferencedCells()) {
+                    refs.push_back({ref.row, ref.col});
+                }
+                record.refs_count = static_cast<uint32_t>(refs.size() - record.refs_offset);
+
+                if (formula->status == DefaultFormula::Status::Valid) {
+                    auto value = cell->GetBoxedValue();
+                    if (value.IsNumber()) {
+                        record.value_kind = static_cast<uint8_t>(SnapshotValue::Number);
+                        record.value = value.AsNumber();
+                    } else if (value.IsError()) {
+                        record.value_kind = static_cast<uint8_t>(SnapshotValue::Error);
+                        record.error = static_cast<uint8_t>(value.AsError().GetCategory());
+                    }
+                }
+            } else {
+                record.data_offset = texts.size();
+                record.data_size = cell->GetRawText().size();
+                texts += cell->GetRawText();
+                if (cell->GetKind() == Literal::Kind::Number)
+                    record.value = cell->GetBoxedValue().AsNumber();
+            }
+            records.push_back(record);
+        }
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.byte_order = kSnapshotByteOrder;
+    header.rows = size.rows;
+    header.cols = size.cols;
+    header.cell_count = records.size();
+    header.ref_count = refs.size();
+    header.code_size = code.size();
+    header.text_size = texts.size();
+    header.journal_sequence = journal_sequence;
+
+    std::string payload;
+    payload.reserve(records.size() * sizeof(SnapshotCell) + refs.size() * sizeof(SnapshotRef) + code.size() + texts.size());
+    Append(payload, records);
+    Append(payload, refs);
+    Append(payload, code);
+    payload += texts;
+    header.checksum = SnapshotChecksum(payload.data(), payload.size());
+
+    // Снимок пишется рядом и подменяет старый целиком: при сбое на диске
+    // остаётся прежний
+    auto temp_path = path + ".tmp";
+    std::FILE * output = std::fopen(temp_path.c_str(), "wb");
+    if (!output)
+        throw std::runtime_error("can't write snapshot " + path);
+    bool written = std::fwrite(&header, sizeof(header), 1, output) == 1
+        && std::fwrite(payload.data(), 1, payload.size(), output) == payload.size()
+        && std::fflush(output) == 0;
+    if (written)
+        SyncFile(output);
+    std::fclose(output);
+    if (!written)
+        throw std::runtime_error("can't write snapshot " + path);
+    std::filesystem::rename(temp_path, path);
+}
+
+void SpreadSheet::Load(std::string const & path) {
+    CheckNoBatch();
+    MappedFile file(path);
+    auto data = file.GetData();
+
+    SnapshotHeader header{};
+    if (data.size() < sizeof(header))
+        throw std::runtime_error("snapshot is truncated");
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0)
+        throw std::runtime_error("not a spreadsheet snapshot");
+    if (header.version != kSnapshotVersion || header.byte_order != kSnapshotByteOrder)
+        throw std::runtime_error("unsupported snapshot version");
+    if (header.rows < 0 || header.rows > Position::kMaxRows || header.cols < 0 || header.cols > Position::kMaxCols)
+        throw std::runtime_error("snapshot is corrupted");
+
+    uint64_t payload = data.size() - sizeof(header);
+    uint64_t cells_size = SectionSize(header.cell_count, sizeof(SnapshotCell), payload);
+    uint64_t refs_size = SectionSize(header.ref_count, sizeof(SnapshotRef), payload);
+    if (cells_size + refs_size > payload || header.code_size > payload - cells_size - refs_size
+        || header.text_size != payload - cells_size - refs_size - header.code_size)
+        throw std::runtime_error("snapshot is corrupted");
+
+    char const * cells_data = data.data() + sizeof(header);
+    char const * refs_data = cells_data + cells_size;
+    auto code_data = reinterpret_cast<uint8_t const *>(refs_data + refs_size);
+    char const * texts_data = refs_data + refs_size + header.code_size;
+    if (SnapshotChecksum(cells_data, payload) != header.checksum)
+        throw std::runtime_error("snapshot checksum mismatch");
+
+    // Сначала строятся все ячейки: при повреждённых данных таблица не меняется
+    std::vector<SnapshotCell> records(header.cell_count);
+    std::memcpy(records.data(), cells_data, cells_size);
+    std::vector<SnapshotRef> refs(header.ref_count);
+    std::memcpy(refs.data(), refs_data, refs_size);
+
+    std::vector<CellEntry> entries;
+    entries.reserve(records.size());
+    for (auto & record : records) {
+        Position pos{record.row, record.col};
+        if (!pos.IsValid() || record.kind > static_cast<uint8_t>(Literal::Kind::Formula)
+            || record.value_kind > static_cast<uint8_t>(SnapshotValue::Error)
+            || (record.value_kind == static_cast<uint8_t>(SnapshotValue::Error)
+                && record.error > static_cast<uint8_t>(FormulaError::Category::Div0)))
+            throw std::runtime_error("snapshot is corrupted");
+
+        auto kind = static_cast<Literal::Kind>(record.kind);
+        std::shared_ptr<DefaultCell> cell;
+        if (kind == Literal::Kind::Formula) {
+            if (record.data_offset > header.code_size || record.data_size > header.code_size - record.data_offset
+                || record.refs_offset > header.ref_count || record.refs_count > header.ref_count - record.refs_offset)
+                throw std::runtime_error("snapshot is corrupted");
+            auto tree = std::make_shared<AST::ASTree>(AST::ASTree::FromProgram(code_data + record.data_offset, record.data_size));
+            // рёбра строятся по списку ссылок, поэтому он обязан совпадать со
+            // ссылками программы
+            auto cells_pos = tree->GetCellsPos();
+            auto refs_begin = refs.begin() + static_cast<ptrdiff_t>(record.refs_offset);
+            if (!std::equal(cells_pos.begin(), cells_pos.end(), refs_begin, refs_begin + record.refs_count,
+                            [](Position pos, SnapshotRef ref) { return pos.row == ref.row && pos.col == ref.col; }))
+                throw std::runtime_error("snapshot is corrupted");
+            cell = std::make_shared<DefaultCell>(std::make_shared<DefaultFormula>(std::move(tree), this));
+        } else {
+            if (record.data_offset > header.text_size || record.data_size > header.text_size - record.data_offset)
+                throw std::runtime_error("snapshot is corrupted");
+            std::string text(texts_data + record.data_offset, record.data_size);
+            cell = std::make_shared<DefaultCell>(std::move(text), Literal{kind, record.value}, this);
+        }
+        entries.push_back({pos, std::move(cell)});
+    }
+
+    std::vector<std::pair<Position, size_t>> index;
+    index.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+        index.emplace_back(entries[i].pos, i);
+    std::sort(index.begin(), index.end());
+    if (std::adjacent_find(index.begin(), index.end(), [](auto & lhs, auto & rhs) { return lhs.first == rhs.first; }) != index.end())
+        throw std::runtime_error("snapshot is corrupted");
+    CheckAcyclicity(records, refs, index);
+
+    Clear();
+    for (auto & [pos, cell] : entries) {
+        CheckSizeCorrectly(pos);
+        cells[pos.row][pos.col] = dep_graph.AddVertex(pos, cell);
+    }
+
+    // Ссылки и отсутствие циклов проверены выше, поэтому рёбра добавляются без проверки
+    for (size_t i = 0; i < records.size(); i++) {
+        auto & record = records[i];
+        if (static_cast<Literal::Kind>(record.kind) != Literal::Kind::Formula)
+            continue;
+        for (uint64_t ref = record.refs_offset; ref < record.refs_offset + record.refs_count; ref++) {
+            dep_graph.AddEdge(entries[i].pos, {refs[ref].row, refs[ref].col}, false);
+        }
+
+        auto & cell = entries[i].cell;
+        if (record.value_kind == static_cast<uint8_t>(SnapshotValue::Number))
+            cell->RestoreValue(record.value);
+        else if (record.value_kind == static_cast<uint8_t>(SnapshotValue::Error))
+            cell->RestoreValue(FormulaError(static_cast<FormulaError::Category>(record.error)));
+    }
+
+    if (size.rows < header.rows) {
+        size.rows = header.rows;
+        cells.resize(size.rows);
+    }
+    size.cols = std::max(size.cols, header.cols);
+    journal_sequence = header.journal_sequence;
+    ResetPositions();
+}
@@ -0,0 +1,66 @@
+#ifndef SPREADSHEET_SNAPSHOTFILE_H
+#define SPREADSHEET_SNAPSHOTFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Двоичный снимок таблицы (SpreadSheet::Save/Load). Порядок байт - родной для
+// машины, совпадение проверяется по byte_order. Файл состоит из заголовка и
+// четырёх секций, идущих подряд:
+//   SnapshotCell[cell_count] - ячейки в порядке строк
+//   SnapshotRef[ref_count]   - ссылки формул (списки смежности графа)
+//   uint8_t[code_size]       - программы формул (AST::Program)
+//   char[text_size]          - тексты ячеек без формул
+// checksum покрывает все секции.
+
+inline constexpr char kSnapshotMagic[8] = {'S', 'P', 'S', 'H', 'E', 'E', 'T', '\0'};
+inline constexpr uint32_t kSnapshotVersion = 2;
+inline constexpr uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t rows;
+    int32_t cols;
+    uint64_t cell_count;
+    uint64_t ref_count;
+    uint64_t code_size;
+    uint64_t text_size;
+    uint64_t checksum;
+    uint64_t journal_sequence;  // последняя операция журнала, вошедшая в снимок
+};
+
+enum class SnapshotValue : uint8_t {
+    None,       // формула ещё не вычислялась
+    Number,
+    Error
+};
+
+struct SnapshotCell {
+    int32_t row;
+    int32_t col;
+    uint8_t kind;           // Literal::Kind
+    uint8_t value_kind;     // SnapshotValue
+    uint8_t error;          // FormulaError::Category
+    uint8_t reserved;
+    uint32_t refs_count;
+    uint64_t refs_offset;   // в SnapshotRef
+    uint64_t data_offset;   // в секции программ для формул, иначе в секции текстов
+    uint64_t data_size;
+    double value;           // число или последнее значение формулы
+};
+
+struct SnapshotRef {
+    int32_t row;
+    int32_t col;
+};
+
+static_assert(sizeof(SnapshotHeader) == 72);
+static_assert(sizeof(SnapshotCell) == 48);
+static_assert(sizeof(SnapshotRef) == 8);
+
+// Контрольная сумма секций, хранящаяся в SnapshotHeader::checksum
+uint64_t SnapshotChecksum(char const * data, size_t size);
+
+#endif //SPREADSHEET_SNAPSHOTFILE_H
@@ -0,0 +1,122 @@
+#include "Stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr std::array<std::string_view, kStatCounters> kCounterNames {
+        "formula_evaluations", "cache_hits", "cache_misses", "cells_invalidated",
+        "writes", "edges_visited", "parser_invocations", "structure_cells_touched"
+    };
+    constexpr std::array<std::string_view, kSheetMethods> kMethodNames {
+        "SetCell", "GetCell", "ClearCell", "InsertRows", "InsertCols",
+        "DeleteRows", "DeleteCols", "GetPrintableSize", "PrintValues", "PrintTexts"
+    };
+
+    int HighestBit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1)
+            bit++;
+        return bit;
+    }
+}
+
+std::string_view StatCounterName(StatCounter counter) {
+    return kCounterNames[static_cast<int>(counter)];
+}
+
+std::string_view SheetMethodName(SheetMethod method) {
+    return kMethodNames[static_cast<int>(method)];
+}
+
+int LatencyHistogram::BucketOf(uint64_t value) {
+    if (value < kSubBuckets)
+        return static_cast<int>(value);
+    int bit = HighestBit(value);
+    auto sub = static_cast<int>((value >> (bit - kSubBits)) & (kSubBuckets - 1));
+    return (bit - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int bucket) {
+    if (bucket < kSubBuckets)
+        return static_cast<uint64_t>(bucket);
+    int shift = bucket / kSubBuckets - 1;
+    auto lower = static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value, uint64_t count) {
+    counts_[BucketOf(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Merge(LatencyHistogram const & other) {
+    for (int i = 0; i < kBuckets; i++)
+        counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+double LatencyHistogram::Mean() const {
+    return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0;
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const {
+    if (!count_)
+        return 0;
+    auto rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_))), 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += counts_[i];
+        if (seen >= rank)
+            return std::min(BucketUpperBound(i), max_);
+    }
+    return max_;
+}
+
+void StatsCollector::RecordLatency(SheetMethod method, uint64_t ns) {
+#ifdef SPREADSHEET_STATS
+    auto & histogram = latency_[static_cast<int>(method)];
+    histogram.counts[LatencyHistogram::BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    histogram.sum.fetch_add(ns, std::memory_order_relaxed);
+    auto max = histogram.max.load(std::memory_order_relaxed);
+    while (ns > max && !histogram.max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+#endif
+}
+
+SheetStats StatsCollector::Get() const {
+    SheetStats stats;
+#ifdef SPREADSHEET_STATS
+    for (int i = 0; i < kStatCounters; i++)
+        stats.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    for (int method = 0; method < kSheetMethods; method++) {
+        auto & live = latency_[method];
+        auto & histogram = stats.latency_ns[method];
+        // счётчики читаются по одному: сумма и максимум могут учитывать
+        // запись, которой ещё нет в интервалах, и наоборот
+        for (int i = 0; i < LatencyHistogram::kBuckets; i++) {
+            histogram.counts_[i] = live.counts[i].load(std::memory_order_relaxed);
+            histogram.count_ += histogram.counts_[i];
+        }
+        histogram.sum_ = live.sum.load(std::memory_order_relaxed);
+        histogram.max_ = live.max.load(std::memory_order_relaxed);
+    }
+#endif
+    return stats;
+}
+
+void StatsCollector::Reset() {
+#ifdef SPREADSHEET_STATS
+    for (auto & counter : counters_)
+        counter.store(0, std::memory_order_relaxed);
+    for (auto & histogram : latency_) {
+        for (auto & count : histogram.counts)
+            count.store(0, std::memory_order_relaxed);
+        histogram.sum.store(0, std::memory_order_relaxed);
+        histogram.max.store(0, std::memory_order_relaxed);
+    }
+#endif
+}
@@ -0,0 +1,172 @@
+#ifndef SPREADSHEET_STATS_H
+#define SPREADSHEET_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Счётчики горячих путей и гистограммы задержек таблицы. Собираются, только
+// если определён SPREADSHEET_STATS (опция CMake, по умолчанию выключена);
+// иначе вызовы ниже пусты, а GetStats возвращает нули. Счётчики атомарны:
+// значения формул вычисляются и параллельными читателями
+
+enum class StatCounter {
+    FormulaEvaluations,     // вычисления значений формул
+    CacheHits,              // чтения формулы, заставшие Status::Valid
+    CacheMisses,            // чтения, после которых значение пришлось вычислять
+    CellsInvalidated,       // формулы, сброшенные в Status::Invalid
+    Writes,                 // изменённые ячейки и структурные правки
+    EdgesVisited,           // рёбра, пройденные CheckAcyclicity
+    ParserInvocations,      // разборы текста формулы
+    StructureCellsTouched   // ячейки, обойдённые вставкой и удалением строк и столбцов
+};
+inline constexpr int kStatCounters = static_cast<int>(StatCounter::StructureCellsTouched) + 1;
+
+// Публичные методы ISheet, задержки которых собираются в гистограммы
+enum class SheetMethod {
+    SetCell,
+    GetCell,
+    ClearCell,
+    InsertRows,
+    InsertCols,
+    DeleteRows,
+    DeleteCols,
+    GetPrintableSize,
+    PrintValues,
+    PrintTexts
+};
+inline constexpr int kSheetMethods = static_cast<int>(SheetMethod::PrintTexts) + 1;
+
+std::string_view StatCounterName(StatCounter counter);
+std::string_view SheetMethodName(SheetMethod method);
+
+// Гистограмма в духе HDR: значения до 2^kSubBits хранятся точно, дальше
+// каждая степень двойки делится на 2^kSubBits интервалов, так что
+// относительная погрешность не больше 1/16 при фиксированных 976 счётчиках
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    static int BucketOf(uint64_t value);
+    // Наибольшее значение, попадающее в интервал
+    static uint64_t BucketUpperBound(int bucket);
+
+    void Record(uint64_t value, uint64_t count = 1);
+    void Merge(LatencyHistogram const & other);
+
+    [[nodiscard]] uint64_t Count() const {
+        return count_;
+    }
+    [[nodiscard]] uint64_t Max() const {
+        return max_;
+    }
+    [[nodiscard]] double Mean() const;
+    // Значение, не меньше которого доля fraction записей; с точностью интервала
+    [[nodiscard]] uint64_t Percentile(double fraction) const;
+    [[nodiscard]] uint64_t BucketCount(int bucket) const {
+        return counts_[bucket];
+    }
+private:
+    friend class StatsCollector;
+
+    std::array<uint64_t, kBuckets> counts_ {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct SheetStats {
+    std::array<uint64_t, kStatCounters> counters {};
+    std::array<LatencyHistogram, kSheetMethods> latency_ns;   // наносекунды
+
+    [[nodiscard]] uint64_t operator[](StatCounter counter) const {
+        return counters[static_cast<int>(counter)];
+    }
+    [[nodiscard]] LatencyHistogram const & operator[](SheetMethod method) const {
+        return latency_ns[static_cast<int>(method)];
+    }
+};
+
+// Живые счётчики таблицы; запись из любых потоков
+class StatsCollector {
+public:
+    void Add(StatCounter counter, uint64_t count = 1) {
+#ifdef SPREADSHEET_STATS
+        counters_[static_cast<int>(counter)].fetch_add(count, std::memory_order_relaxed);
+#endif
+    }
+    void RecordLatency(SheetMethod method, uint64_t ns);
+
+    [[nodiscard]] SheetStats Get() const;
+    void Reset();
+private:
+#ifdef SPREADSHEET_STATS
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> counts {};
+        std::atomic<uint64_t> sum {0};
+        std::atomic<uint64_t> max {0};
+    };
+    std::array<std::atomic<uint64_t>, kStatCounters> counters_ {};
+    std::array<Histogram, kSheetMethods> latency_ {};
+#endif
+};
+
+// Для мест, где таблицы может не быть (формулы вне SpreadSheet)
+inline void AddStat(StatsCollector * stats, StatCounter counter, uint64_t count = 1) {
+#ifdef SPREADSHEET_STATS
+    if (stats)
+        stats->Add(counter, count);
+#endif
+}
+
+// Замеряет время от создания до выхода из области видимости. Замеряются
+// только внешние вызовы: GetCell изнутри другого метода или вычисления
+// формулы (Nested) входит в их время и часы не читает
+class LatencyScope {
+public:
+#ifdef SPREADSHEET_STATS
+    LatencyScope(StatsCollector & stats, SheetMethod method) : stats_(depth_++ ? nullptr : &stats), method_(method) {
+        if (stats_)
+            start_ = std::chrono::steady_clock::now();
+    }
+    ~LatencyScope() {
+        depth_--;
+        if (!stats_)
+            return;
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        stats_->RecordLatency(method_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+#else
+    LatencyScope(StatsCollector &, SheetMethod) {}
+#endif
+    LatencyScope(LatencyScope const &) = delete;
+    LatencyScope & operator=(LatencyScope const &) = delete;
+
+    struct Nested {
+#ifdef SPREADSHEET_STATS
+        Nested() {
+            depth_++;
+        }
+        ~Nested() {
+            depth_--;
+        }
+#else
+        Nested() {}
+#endif
+        Nested(Nested const &) = delete;
+        Nested & operator=(Nested const &) = delete;
+    };
+private:
+#ifdef SPREADSHEET_STATS
+    static inline thread_local int depth_ = 0;
+    StatsCollector * stats_;
+    SheetMethod method_;
+    std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+#endif //SPREADSHEET_STATS_H
@@ -0,0 +1,189 @@
+#include "Subscriptions.h"
+#include "Engine.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+    ICell::Value ValueAt(ISheet const & sheet, Position pos) {
+        if (auto cell = sheet.GetCell(pos); cell)
+            return cell->GetValue();
+        return ICell::Value(std::string());
+    }
+
+    bool IsEmpty(ICell::Value const & value) {
+        auto text = std::get_if<std::string>(&value);
+        return text && text->empty();
+    }
+
+    bool Contains(CellRange const & range, Position pos) {
+        return pos.row >= range.first.row && pos.row < range.first.row + range.size.rows &&
+               pos.col >= range.first.col && pos.col < range.first.col + range.size.cols;
+    }
+}
+
+uint64_t Notifier::Subscribe(CellRange range, NotificationCallback callback, std::shared_ptr<NotificationQueue> queue, SheetSource const & source) {
+    if (!range.first.IsValid() || range.size.rows <= 0 || range.size.cols <= 0)
+        throw InvalidPositionException("invalid range");
+    range.size.rows = std::min(range.size.rows, Position::kMaxRows - range.first.row);
+    range.size.cols = std::min(range.size.cols, Position::kMaxCols - range.first.col);
+
+    Subscription subscription {range, std::move(callback), std::move(queue), {}, {0, 0}, {}};
+    std::lock_guard lock(mutex_);
+    auto & sheet = source();
+    // пустые значения не запоминаются, поэтому хватает печатной области
+    auto size = sheet.GetPrintableSize();
+    for (int row = range.first.row; row < std::min(range.first.row + range.size.rows, size.rows); row++) {
+        for (int col = range.first.col; col < std::min(range.first.col + range.size.cols, size.cols); col++) {
+            auto value = ValueAt(sheet, {row, col});
+            if (IsEmpty(value))
+                continue;
+            subscription.values.emplace(Position{row, col}, std::move(value));
+            subscription.extent.rows = std::max(subscription.extent.rows, row + 1);
+            subscription.extent.cols = std::max(subscription.extent.cols, col + 1);
+        }
+    }
+    auto id = next_id_++;
+    subscriptions_.emplace(id, std::move(subscription));
+    count_.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+bool Notifier::Unsubscribe(uint64_t id) {
+    std::lock_guard lock(mutex_);
+    if (!subscriptions_.erase(id))
+        return false;
+    count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Notifier::Check(Subscription & subscription, Position pos, ISheet const & sheet, Changes & changes) {
+    auto value = ValueAt(sheet, pos);
+    auto it = subscription.values.find(pos);
+    if (IsEmpty(value)) {
+        if (it == subscription.values.end())
+            return;
+        subscription.values.erase(it);
+    } else if (it != subscription.values.end()) {
+        if (it->second == value)
+            return;
+        it->second = value;
+    } else {
+        subscription.values.emplace(pos, value);
+        subscription.extent.rows = std::max(subscription.extent.rows, pos.row + 1);
+        subscription.extent.cols = std::max(subscription.extent.cols, pos.col + 1);
+    }
+    changes[pos] = std::move(value);
+}
+
+void Notifier::Publish(uint64_t version, ISheet const & sheet, TileChanged const & tile_changed) {
+    std::unique_lock lock(mutex_);
+    auto size = sheet.GetPrintableSize();
+    std::map<uint64_t, Changes> changes;
+    for (auto & [id, subscription] : subscriptions_) {
+        auto & range = subscription.range;
+        // очищенные ячейки могут лежать и за нынешней печатной областью
+        int last_row = std::min(range.first.row + range.size.rows, std::max(size.rows, subscription.extent.rows));
+        int last_col = std::min(range.first.col + range.size.cols, std::max(size.cols, subscription.extent.cols));
+        for (int tile_row = range.first.row / kTileSize; tile_row * kTileSize < last_row; tile_row++) {
+            for (int tile_col = range.first.col / kTileSize; tile_col * kTileSize < last_col; tile_col++) {
+                if (!tile_changed(tile_row, tile_col))
+                    continue;
+                int first_row = std::max(tile_row * kTileSize, range.first.row);
+                int first_col = std::max(tile_col * kTileSize, range.first.col);
+                for (int row = first_row; row < std::min((tile_row + 1) * kTileSize, last_row); row++) {
+                    for (int col = first_col; col < std::min((tile_col + 1) * kTileSize, last_col); col++) {
+                        Check(subscription, {row, col}, sheet, changes[id]);
+                    }
+                }
+            }
+        }
+    }
+    Deliver(version, changes, lock);
+}
+
+void Notifier::Publish(uint64_t version, ISheet const & sheet, std::vector<Position> const & positions) {
+    std::unique_lock lock(mutex_);
+    std::map<uint64_t, Changes> changes;
+    for (auto & [id, subscription] : subscriptions_) {
+        for (auto & pos : positions) {
+            if (Contains(subscription.range, pos))
+                Check(subscription, pos, sheet, changes[id]);
+        }
+    }
+    Deliver(version, changes, lock);
+}
+
+void Notifier::Deliver(uint64_t version, std::map<uint64_t, Changes> & changes, std::unique_lock<std::mutex> & lock) {
+    // Очереди пополняются под блокировкой, она же оставляет у очереди одного
+    // писателя. Функции вызываются уже без неё и могут отписываться
+    std::vector<std::pair<NotificationCallback, ValueNotification>> calls;
+    for (auto & [id, cells] : changes) {
+        auto & subscription = subscriptions_.at(id);
+        if (subscription.queue) {
+            for (auto & [pos, value] : cells) {
+                subscription.pending[pos] = std::move(value);
+            }
+            if (subscription.pending.empty())
+                continue;
+            ValueNotification notification {version, {}};
+            notification.cells.reserve(subscription.pending.size());
+            for (auto & [pos, value] : subscription.pending) {
+                notification.cells.push_back({pos, value});
+            }
+            if (subscription.queue->TryPush(std::move(notification)))
+                subscription.pending.clear();
+        } else if (subscription.callback && !cells.empty()) {
+            ValueNotification notification {version, {}};
+            notification.cells.reserve(cells.size());
+            for (auto & [pos, value] : cells) {
+                notification.cells.push_back({pos, std::move(value)});
+            }
+            calls.emplace_back(subscription.callback, std::move(notification));
+        }
+    }
+    lock.unlock();
+    for (auto & [callback, notification] : calls) {
+        callback(notification);
+    }
+}
+
+uint64_t SpreadSheet::Subscribe(CellRange range, NotificationCallback callback) {
+    return Subscribe(range, std::move(callback), nullptr);
+}
+
+uint64_t SpreadSheet::Subscribe(CellRange range, std::shared_ptr<NotificationQueue> queue) {
+    return Subscribe(range, nullptr, std::move(queue));
+}
+
+uint64_t SpreadSheet::Subscribe(CellRange range, NotificationCallback callback, std::shared_ptr<NotificationQueue> queue) {
+    if (!recalc)
+        return notifier.Subscribe(range, std::move(callback), std::move(queue), [this]() -> ISheet const & { return *this; });
+    // Начальные значения берутся из последнего опубликованного вида под
+    // блокировкой подписок: следующий пересчёт сверится уже с ними
+    recalc->Wait(0);
+    std::shared_ptr<const SheetSnapshot> view;
+    return notifier.Subscribe(range, std::move(callback), std::move(queue), [&]() -> ISheet const & {
+        view = recalc->GetView();
+        return *view;
+    });
+}
+
+bool SpreadSheet::Unsubscribe(uint64_t id) {
+    return notifier.Unsubscribe(id);
+}
+
+void SpreadSheet::NotifySubscribers() {
+    auto since = std::exchange(notified_version, change_version);
+    if (since == change_version || notifier.Empty())
+        return;
+    bool full = since < structure_version;
+    notifier.Publish(change_version, *this, [&](int tile_row, int tile_col) {
+        if (full)
+            return true;
+        // плитки меняют и читатели, пересчитывающие формулы
+        std::lock_guard lock(change_mutex);
+        auto it = tiles.find(TileIndex(tile_row, tile_col));
+        return it != tiles.end() && (it->second.changed > since || it->second.invalidated > since);
+    });
+}
@@ -0,0 +1,137 @@
+#ifndef SPREADSHEET_SUBSCRIPTIONS_H
+#define SPREADSHEET_SUBSCRIPTIONS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ChangeSet.h"
+#include "common.h"
+
+// Прямоугольник [first, first + size)
+struct CellRange {
+    Position first {0, 0};
+    Size size {1, 1};
+};
+
+// Значения, изменившиеся за один пересчёт. Каждая ячейка входит один раз,
+// в порядке позиций
+struct ValueNotification {
+    uint64_t version = 0;       // версия таблицы, для которой посчитаны значения
+    std::vector<CellChange> cells;
+};
+
+// Ограниченная очередь без блокировок: пишет один поток, читают любые.
+// Ячейка кольца хранит номер, по которому писатель и читатели узнают, свободна
+// ли она и заполнена ли (очередь Вьюкова)
+template<typename T>
+class SpmcQueue {
+public:
+    // Ёмкость округляется вверх до степени двойки, не меньше двух
+    explicit SpmcQueue(size_t capacity = 1024) {
+        size_t rounded = 2;
+        while (rounded < capacity)
+            rounded *= 2;
+        slots_ = std::make_unique<Slot[]>(rounded);
+        mask_ = rounded - 1;
+        for (size_t i = 0; i < rounded; i++) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SpmcQueue(SpmcQueue const &) = delete;
+    SpmcQueue & operator=(SpmcQueue const &) = delete;
+
+    // Только из потока-писателя. false - очередь заполнена
+    bool TryPush(T && value) {
+        Slot & slot = slots_[tail_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != tail_)
+            return false;
+        slot.value = std::move(value);
+        slot.sequence.store(tail_ + 1, std::memory_order_release);
+        tail_++;
+        return true;
+    }
+
+    // false - очередь пуста
+    bool TryPop(T & value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot & slot = slots_[pos & mask_];
+            auto diff = static_cast<std::ptrdiff_t>(slot.sequence.load(std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+private:
+    struct Slot {
+        std::atomic<size_t> sequence {0};
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_ {0};
+    alignas(64) size_t tail_ = 0;
+};
+
+using NotificationQueue = SpmcQueue<ValueNotification>;
+using NotificationCallback = std::function<void(ValueNotification const &)>;
+
+// Подписки таблицы. Хранит последние сообщённые значения подписанных ячеек и
+// после каждого пересчёта сравнивает с ними значения позиций, которые могли
+// измениться: подписчик узнаёт только о действительно изменившихся значениях.
+// Уведомление, не поместившееся в очередь, сливается со следующим
+class Notifier {
+public:
+    // Таблица с начальными значениями, запрашивается под блокировкой подписок
+    using SheetSource = std::function<ISheet const &()>;
+    // Плитка kTileSize x kTileSize могла измениться
+    using TileChanged = std::function<bool(int tile_row, int tile_col)>;
+
+    uint64_t Subscribe(CellRange range, NotificationCallback callback, std::shared_ptr<NotificationQueue> queue, SheetSource const & source);
+    bool Unsubscribe(uint64_t id);
+    [[nodiscard]] bool Empty() const {
+        return count_.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Сверяет с sheet подписанные позиции в изменившихся плитках
+    void Publish(uint64_t version, ISheet const & sheet, TileChanged const & tile_changed);
+    // Сверяет с sheet только перечисленные позиции
+    void Publish(uint64_t version, ISheet const & sheet, std::vector<Position> const & positions);
+private:
+    struct Subscription {
+        CellRange range;
+        NotificationCallback callback;
+        std::shared_ptr<NotificationQueue> queue;
+        std::map<Position, ICell::Value> values;    // непустые
+        Size extent;                                // охватывает позиции values
+        std::map<Position, ICell::Value> pending;   // не поместились в очередь
+    };
+    using Changes = std::map<Position, ICell::Value>;
+
+    static void Check(Subscription & subscription, Position pos, ISheet const & sheet, Changes & changes);
+    // Отпускает lock перед вызовом функций подписчиков
+    void Deliver(uint64_t version, std::map<uint64_t, Changes> & changes, std::unique_lock<std::mutex> & lock);
+
+    mutable std::mutex mutex_;
+    std::map<uint64_t, Subscription> subscriptions_;
+    uint64_t next_id_ = 1;
+    std::atomic<size_t> count_ {0};
+};
+
+#endif //SPREADSHEET_SUBSCRIPTIONS_H
@@ -0,0 +1,167 @@
+#include "TextPool.h"
+#include "Memory.h"
+
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t kMinCapacity = 8;
+    // наибольшая заполненность индекса 3/4
+    constexpr size_t kMaxLoad = 3;
+    constexpr size_t kLoadDenominator = 4;
+}
+
+TextPool::TextPool() : entries_(1) {}
+
+TextPool::Handle TextPool::Intern(std::string_view text, uint64_t hash) {
+    if (text.empty())
+        return kNoText;
+    std::lock_guard lock(mutex_);
+    if (!index_.empty()) {
+        auto fragment = Slot(hash, 0);
+        for (auto slot = Home(hash); index_[slot] != 0; slot = (slot + 1) & Mask()) {
+            if ((index_[slot] ^ fragment) >> 32)
+                continue;
+            auto & entry = entries_[HandleOf(index_[slot])];
+            if (entry.hash == hash && entry.text == text) {
+                entry.refs++;
+                return HandleOf(index_[slot]);
+            }
+        }
+    }
+
+    if ((size_ + 1) * kLoadDenominator > index_.size() * kMaxLoad)
+        Rehash(index_.empty() ? kMinCapacity : index_.size() * 2);
+    Handle handle;
+    if (!free_.empty()) {
+        handle = free_.back();
+        free_.pop_back();
+    } else {
+        if (entries_.size() > std::numeric_limits<Handle>::max())
+            throw std::length_error("too many distinct texts");
+        handle = static_cast<Handle>(entries_.size());
+        entries_.emplace_back();
+    }
+    entries_[handle] = Entry{std::string(text), hash, 1};
+    Insert(handle);
+    size_++;
+    return handle;
+}
+
+void TextPool::AddRef(Handle handle) {
+    std::lock_guard lock(mutex_);
+    entries_[handle].refs++;
+}
+
+void TextPool::Release(Handle handle) {
+    std::lock_guard lock(mutex_);
+    if (--entries_[handle].refs > 0)
+        return;
+    Erase(handle);
+    // присваивание пустой строки оставило бы буфер
+    std::string().swap(entries_[handle].text);
+    free_.push_back(handle);
+    size_--;
+}
+
+size_t TextPool::size() const {
+    std::lock_guard lock(mutex_);
+    return size_;
+}
+
+size_t TextPool::MemoryUsage() const {
+    std::lock_guard lock(mutex_);
+    size_t bytes = memory::VectorBytes(entries_) + memory::VectorBytes(free_) + memory::VectorBytes(index_);
+    for (auto & entry : entries_)
+        bytes += memory::StringBytes(entry.text);
+    return bytes;
+}
+
+TextPool & TextPool::Detached() {
+    static TextPool pool;
+    return pool;
+}
+
+// Фибоначчиево хеширование, как в FlatMap
+size_t TextPool::Home(uint64_t hash) const {
+    return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift_);
+}
+
+void TextPool::Insert(Handle handle) {
+    auto hash = entries_[handle].hash;
+    auto slot = Home(hash);
+    while (index_[slot] != 0)
+        slot = (slot + 1) & Mask();
+    index_[slot] = Slot(hash, handle);
+}
+
+// Сдвиг следующих за освободившейся ячейкой назад, как в FlatMap::EraseIndex
+void TextPool::Erase(Handle handle) {
+    auto hole = Home(entries_[handle].hash);
+    while (HandleOf(index_[hole]) != handle)
+        hole = (hole + 1) & Mask();
+    index_[hole] = 0;
+    for (auto slot = (hole + 1) & Mask(); index_[slot] != 0; slot = (slot + 1) & Mask()) {
+        auto home = Home(entries_[HandleOf(index_[slot])].hash);
+        bool stays = hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot);
+        if (stays)
+            continue;
+        index_[hole] = index_[slot];
+        index_[slot] = 0;
+        hole = slot;
+    }
+}
+
+void TextPool::Rehash(size_t capacity) {
+    index_.assign(capacity, 0);
+    shift_ = 64;
+    for (size_t bits = capacity; bits > 1; bits >>= 1)
+        shift_--;
+    for (size_t handle = 1; handle < entries_.size(); handle++) {
+        if (entries_[handle].refs > 0)
+            Insert(static_cast<Handle>(handle));
+    }
+}
+
+CellText::CellText(TextPool & pool, std::string_view text, uint64_t hash) {
+    if (text.empty())
+        return;
+    Store(0, &pool);
+    Store(8, pool.Intern(text, hash));
+    bytes_[kTagByte] = kPooled;
+}
+
+CellText::CellText(std::string_view text) {
+    Assign(text);
+}
+
+CellText::CellText(CellText const & other) {
+    if (other.IsPooled()) {
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        Load<TextPool *>(0)->AddRef(Load<TextPool::Handle>(8));
+    } else {
+        Assign(other.View());
+    }
+}
+
+void CellText::Assign(std::string_view text) {
+    if (text.size() <= kInlineSize) {
+        std::memcpy(bytes_, text.data(), text.size());
+        bytes_[kTagByte] = static_cast<unsigned char>(text.size());
+        return;
+    }
+    if (text.size() > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("cell text is too long");
+    auto data = new char[text.size()];
+    std::memcpy(data, text.data(), text.size());
+    Store<char const *>(0, data);
+    Store(8, static_cast<uint32_t>(text.size()));
+    bytes_[kTagByte] = kHeap;
+}
+
+void CellText::Free() {
+    if (IsPooled())
+        Load<TextPool *>(0)->Release(Load<TextPool::Handle>(8));
+    else
+        delete[] Load<char const *>(0);
+}
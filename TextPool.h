@@ -0,0 +1,162 @@
+#ifndef SPREADSHEET_TEXT_POOL_H
+#define SPREADSHEET_TEXT_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Словарь текстов ячеек таблицы: каждый различный текст хранится один раз,
+// ячейки держат его номер. У текста есть счётчик ссылок, номер
+// освободившегося текста отдаётся следующему новому. Изменения пула
+// защищены мьютексом, потому что ячейки создаются и потоками импорта;
+// View и Hash блокировок не берут и, как чтение ячеек, допустимы, пока
+// таблица не изменяется
+class TextPool {
+public:
+    using Handle = uint32_t;
+    // Пустой текст, в пуле не хранится
+    static constexpr Handle kNoText = 0;
+
+    TextPool();
+    TextPool(TextPool const &) = delete;
+    TextPool & operator=(TextPool const &) = delete;
+
+    // Номер text со ссылкой на него; hash - DefaultCell::HashText(text)
+    Handle Intern(std::string_view text, uint64_t hash);
+    void AddRef(Handle handle);
+    void Release(Handle handle);
+
+    [[nodiscard]] std::string_view View(Handle handle) const {
+        return entries_[handle].text;
+    }
+    [[nodiscard]] uint64_t Hash(Handle handle) const {
+        return entries_[handle].hash;
+    }
+    // Число различных текстов
+    [[nodiscard]] size_t size() const;
+    // Байты записей, строк вне SSO и индекса
+    [[nodiscard]] size_t MemoryUsage() const;
+
+    // Пул ячеек, созданных без таблицы
+    static TextPool & Detached();
+private:
+    struct Entry {
+        std::string text;
+        uint64_t hash = 0;
+        uint32_t refs = 0;
+    };
+
+    [[nodiscard]] size_t Mask() const {
+        return index_.size() - 1;
+    }
+    [[nodiscard]] size_t Home(uint64_t hash) const;
+    static uint64_t Slot(uint64_t hash, Handle handle) {
+        return (hash >> 32) << 32 | handle;
+    }
+    static Handle HandleOf(uint64_t slot) {
+        return static_cast<Handle>(slot);
+    }
+    void Insert(Handle handle);
+    void Erase(Handle handle);
+    void Rehash(size_t capacity);
+
+    std::vector<Entry> entries_;    // entries_[kNoText] не используется
+    std::vector<Handle> free_;
+    // Открытая адресация по хешу текста: в ячейке старшие 32 бита хеша и
+    // номер, 0 - свободная. Часть хеша в индексе позволяет пропускать чужие
+    // ячейки, не читая записи
+    std::vector<uint64_t> index_;
+    int shift_ = 64;
+    size_t size_ = 0;
+    mutable std::mutex mutex_;
+};
+
+// Текст ячейки в 16 байтах. Текст текстовой ячейки - ссылка на текст пула:
+// копия добавляет ссылку, деструктор её снимает. Остальные тексты (числа)
+// ячейка хранит сама, чтобы не платить за вставку в пул уникальными
+// значениями: до kInlineSize символов - в самом объекте, длиннее - в куче
+class CellText {
+public:
+    static constexpr size_t kInlineSize = 15;
+
+    CellText() = default;
+    // Текст в пуле; hash - DefaultCell::HashText(text)
+    CellText(TextPool & pool, std::string_view text, uint64_t hash);
+    // Собственный текст ячейки
+    explicit CellText(std::string_view text);
+    CellText(CellText const & other);
+    CellText(CellText && other) noexcept {
+        std::memcpy(bytes_, other.bytes_, sizeof(bytes_));
+        std::memset(other.bytes_, 0, sizeof(other.bytes_));
+    }
+    CellText & operator=(CellText other) noexcept {
+        std::swap(bytes_, other.bytes_);
+        return *this;
+    }
+    ~CellText() {
+        if (Tag() >= kPooled)
+            Free();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return Tag() == 0;
+    }
+    [[nodiscard]] bool IsPooled() const {
+        return Tag() == kPooled;
+    }
+    [[nodiscard]] std::string_view View() const {
+        switch (Tag()) {
+            case kPooled:
+                return Load<TextPool *>(0)->View(Load<TextPool::Handle>(8));
+            case kHeap:
+                return {Load<char const *>(0), Load<uint32_t>(8)};
+            default:
+                return {reinterpret_cast<char const *>(bytes_), Tag()};
+        }
+    }
+    // Только для текста в пуле
+    [[nodiscard]] uint64_t Hash() const {
+        return Load<TextPool *>(0)->Hash(Load<TextPool::Handle>(8));
+    }
+    // Номер в пуле, для остальных текстов TextPool::kNoText
+    [[nodiscard]] TextPool::Handle GetHandle() const {
+        return IsPooled() ? Load<TextPool::Handle>(8) : TextPool::kNoText;
+    }
+    // Байты собственного текста в куче
+    [[nodiscard]] size_t HeapBytes() const {
+        return Tag() == kHeap ? Load<uint32_t>(8) : 0;
+    }
+private:
+    // Последний байт: длина текста в объекте, или kPooled - указатель на
+    // пул и номер, или kHeap - указатель на текст в куче и длина
+    static constexpr size_t kTagByte = kInlineSize;
+    static constexpr unsigned char kPooled = 0xFE;
+    static constexpr unsigned char kHeap = 0xFF;
+
+    [[nodiscard]] unsigned char Tag() const {
+        return bytes_[kTagByte];
+    }
+    template <typename T>
+    [[nodiscard]] T Load(size_t offset) const {
+        T result;
+        std::memcpy(&result, bytes_ + offset, sizeof(T));
+        return result;
+    }
+    template <typename T>
+    void Store(size_t offset, T value) {
+        std::memcpy(bytes_ + offset, &value, sizeof(T));
+    }
+    void Assign(std::string_view text);
+    void Free();
+
+    alignas(8) unsigned char bytes_[kInlineSize + 1] {};
+};
+
+static_assert(sizeof(CellText) == 16, "CellText must stay as small as a pool reference");
+
+#endif //SPREADSHEET_TEXT_POOL_H
@@ -0,0 +1,181 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // Буфер потока; mutex берёт только сам поток при записи и WriteTrace
+    struct ThreadBuffer {
+        std::mutex mutex;
+        std::vector<TraceEvent> events;     // выделяется при первой записи
+        size_t next = 0;
+        bool wrapped = false;
+        int tid = 0;
+        std::string name;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        int next_tid = 1;
+    };
+
+    Registry & GetRegistry() {
+        static Registry registry;
+        return registry;
+    }
+
+    std::atomic<size_t> capacity {TraceOptions{}.events_per_thread};
+    std::atomic<int> evaluation_sample {TraceOptions{}.evaluation_sample};
+    thread_local std::shared_ptr<ThreadBuffer> local_buffer;
+    thread_local uint64_t sample_counter = 0;
+
+    ThreadBuffer & LocalBuffer() {
+        if (!local_buffer) {
+            auto & registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            local_buffer = std::make_shared<ThreadBuffer>();
+            local_buffer->tid = registry.next_tid++;
+            registry.buffers.push_back(local_buffer);
+        }
+        return *local_buffer;
+    }
+
+    uint64_t NowNs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void WriteString(std::ostream & output, std::string_view text) {
+        output << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                output << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                output << ' ';
+            else
+                output << c;
+        }
+        output << '"';
+    }
+
+    void WriteEvent(std::ostream & output, TraceEvent const & event, int tid) {
+        char times[64];
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                      static_cast<double>(event.start_ns) / 1000.0, static_cast<double>(event.duration_ns) / 1000.0);
+        output << "{\"name\":";
+        WriteString(output, event.name);
+        output << ",\"cat\":";
+        WriteString(output, event.category);
+        output << ",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << tid << ",\"args\":{";
+        bool comma = false;
+        if (event.pos.IsValid()) {
+            output << "\"cell\":\"" << event.pos.ToString() << '"';
+            comma = true;
+        }
+        if (event.count >= 0)
+            output << (comma ? "," : "") << "\"count\":" << event.count;
+        output << "}}";
+    }
+}
+
+void StartTracing(TraceOptions options) {
+    auto & registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    tracing::enabled.store(false, std::memory_order_relaxed);
+    capacity.store(options.events_per_thread, std::memory_order_relaxed);
+    evaluation_sample.store(std::max(options.evaluation_sample, 1), std::memory_order_relaxed);
+
+    // буферы завершившихся потоков больше никому не нужны
+    std::vector<std::shared_ptr<ThreadBuffer>> alive;
+    for (auto & buffer : registry.buffers) {
+        if (buffer.use_count() == 1)
+            continue;
+        std::lock_guard buffer_lock(buffer->mutex);
+        std::vector<TraceEvent>().swap(buffer->events);
+        buffer->next = 0;
+        buffer->wrapped = false;
+        alive.push_back(buffer);
+    }
+    registry.buffers = std::move(alive);
+    tracing::enabled.store(true, std::memory_order_relaxed);
+}
+
+void StopTracing() {
+    tracing::enabled.store(false, std::memory_order_relaxed);
+}
+
+void WriteTrace(std::ostream & output) {
+    auto & registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto separate = [&] {
+        output << (first ? "\n" : ",\n");
+        first = false;
+    };
+    for (auto & buffer : registry.buffers) {
+        std::lock_guard buffer_lock(buffer->mutex);
+        if (!buffer->name.empty()) {
+            separate();
+            output << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+            WriteString(output, buffer->name);
+            output << "}}";
+        }
+        // в заполненном кольце самое старое событие стоит на месте next
+        size_t size = buffer->wrapped ? buffer->events.size() : buffer->next;
+        size_t start = buffer->wrapped ? buffer->next : 0;
+        for (size_t i = 0; i < size; i++) {
+            separate();
+            WriteEvent(output, buffer->events[(start + i) % buffer->events.size()], buffer->tid);
+        }
+    }
+    output << "\n]}\n";
+}
+
+void WriteTrace(std::string const & path) {
+    std::ofstream output(path, std::ios::binary);
+    if (!output)
+        throw std::runtime_error("cannot open " + path);
+    WriteTrace(output);
+}
+
+void SetTraceThreadName(std::string name) {
+    auto & buffer = LocalBuffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.name = std::move(name);
+}
+
+void TraceSpan::Begin(char const * name, char const * category) {
+    active_ = true;
+    event_.name = name;
+    event_.category = category;
+    event_.start_ns = NowNs();
+}
+
+void TraceSpan::End() {
+    event_.duration_ns = NowNs() - event_.start_ns;
+    auto & buffer = LocalBuffer();
+    std::lock_guard lock(buffer.mutex);
+    if (buffer.events.empty()) {
+        auto size = capacity.load(std::memory_order_relaxed);
+        if (!size)
+            return;
+        buffer.events.resize(size);
+    }
+    buffer.events[buffer.next] = event_;
+    if (++buffer.next == buffer.events.size()) {
+        buffer.next = 0;
+        buffer.wrapped = true;
+    }
+}
+
+bool TraceSpan::TakeSample() {
+    return sample_counter++ % static_cast<uint64_t>(evaluation_sample.load(std::memory_order_relaxed)) == 0;
+}
@@ -0,0 +1,103 @@
+#ifndef SPREADSHEET_TRACING_H
+#define SPREADSHEET_TRACING_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "common.h"
+
+// Трассировка операций таблицы в формате Chrome trace_event (открывается в
+// Perfetto и chrome://tracing). Каждый поток пишет завершённые интервалы в
+// свой кольцевой буфер, при переполнении затираются самые старые. Пока
+// трассировка выключена, TraceSpan стоит одну загрузку флага
+
+struct TraceOptions {
+    size_t events_per_thread = 1 << 16;
+    // Вычисления формул записываются через одно на evaluation_sample
+    int evaluation_sample = 64;
+};
+
+// Очищает буферы и включает запись
+void StartTracing(TraceOptions options = {});
+void StopTracing();
+// JSON {"traceEvents": [...]} с интервалами всех потоков, в том числе
+// завершившихся; можно вызывать во время записи
+void WriteTrace(std::ostream & output);
+void WriteTrace(std::string const & path);
+// Имя текущего потока в трассе
+void SetTraceThreadName(std::string name);
+
+namespace tracing {
+    inline std::atomic<bool> enabled {false};
+}
+
+inline bool TracingEnabled() {
+    return tracing::enabled.load(std::memory_order_relaxed);
+}
+
+struct TraceEvent {
+    char const * name = nullptr;
+    char const * category = nullptr;
+    uint64_t start_ns = 0;
+    uint64_t duration_ns = 0;
+    Position pos {-1, -1};      // ячейка, если есть
+    int64_t count = -1;         // число строк, рёбер, ячеек, если есть
+};
+
+// Интервал от создания до выхода из области видимости. name и category -
+// строковые литералы
+class TraceSpan {
+public:
+    TraceSpan(char const * name, char const * category) {
+        if (TracingEnabled())
+            Begin(name, category);
+    }
+    TraceSpan(char const * name, char const * category, Position pos) {
+        if (TracingEnabled()) {
+            Begin(name, category);
+            event_.pos = pos;
+        }
+    }
+    TraceSpan(char const * name, char const * category, int64_t count) {
+        if (TracingEnabled()) {
+            Begin(name, category);
+            event_.count = count;
+        }
+    }
+    // Выборочный интервал: записывается один из TraceOptions::evaluation_sample
+    struct Sampled {};
+    TraceSpan(char const * name, char const * category, Position pos, Sampled) {
+        if (TracingEnabled() && TakeSample()) {
+            Begin(name, category);
+            event_.pos = pos;
+        }
+    }
+    ~TraceSpan() {
+        if (active_)
+            End();
+    }
+    TraceSpan(TraceSpan const &) = delete;
+    TraceSpan & operator=(TraceSpan const &) = delete;
+
+    // Число, известное только к концу интервала
+    void SetCount(int64_t count) {
+        event_.count = count;
+    }
+    // Завершает интервал раньше выхода из области видимости
+    void Close() {
+        if (active_)
+            End();
+        active_ = false;
+    }
+private:
+    void Begin(char const * name, char const * category);
+    void End();
+    static bool TakeSample();
+
+    bool active_ = false;
+    TraceEvent event_;
+};
+
+#endif //SPREADSHEET_TRACING_H
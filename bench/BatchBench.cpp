@@ -0,0 +1,49 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Обновление cells ячеек по одной и одним пакетом. Чётные столбцы
+// заполняются сверху вниз цепочками формул, каждая ссылается на ячейку над
+// ней: при вставке по одной проверка на циклы обходит всю цепочку выше
+BENCHMARK(Batch) {
+    auto rows = static_cast<int>(args.Get("rows", 2000));
+    auto cols = static_cast<int>(args.Get("cols", 20));
+    auto cells = args.Get("cells", 10000);
+
+    auto fill = [&](SpreadSheet & sheet) {
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                sheet.SetCell({row, col}, col % 2 ? "=" + Position{row, col - 1}.ToString() + "+1" : std::to_string(row));
+            }
+        }
+    };
+    std::vector<std::pair<Position, std::string>> updates;
+    for (long long i = 0; i < cells; i++) {
+        Position pos{static_cast<int>(i % rows), static_cast<int>(i / rows % ((cols + 1) / 2) * 2)};
+        updates.emplace_back(pos, pos.row ? "=" + Position{pos.row - 1, pos.col}.ToString() + "+1" : std::to_string(i));
+    }
+
+    SpreadSheet single;
+    fill(single);
+    bench::Timer single_timer;
+    for (auto & [pos, text] : updates) {
+        single.SetCell(pos, text);
+    }
+    double single_seconds = single_timer.Seconds();
+
+    SpreadSheet batched;
+    fill(batched);
+    bench::Timer batch_timer;
+    batched.BeginBatch();
+    for (auto & [pos, text] : updates) {
+        batched.SetCell(pos, text);
+    }
+    batched.Commit();
+    double batch_seconds = batch_timer.Seconds();
+
+    std::cout << "  " << rows << "x" << cols << ", " << cells << " cells: one by one " << single_seconds * 1e3
+              << " ms, batch " << batch_seconds * 1e3 << " ms" << std::endl;
+}
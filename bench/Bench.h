@@ -0,0 +1,105 @@
+#ifndef SPREADSHEET_BENCH_H
+#define SPREADSHEET_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Allocations.h"
+
+namespace bench {
+    // Параметры вида key=value из командной строки
+    struct Args {
+    public:
+        std::map<std::string, std::string> values;
+
+        [[nodiscard]] long long Get(std::string const & key, long long def) const;
+        [[nodiscard]] std::string Get(std::string const & key, std::string const & def) const;
+    };
+
+    using Function = std::function<void(Args const &)>;
+    std::map<std::string, Function> & Registry();
+
+    struct Registrar {
+        Registrar(std::string const & name, Function func) {
+            Registry().emplace(name, std::move(func));
+        }
+    };
+
+    struct Timer {
+    public:
+        Timer() : start_(std::chrono::steady_clock::now()) {}
+        [[nodiscard]] double Seconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        }
+    private:
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Выделения памяти через operator new с запуска программы
+    struct Allocations {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+    Allocations CountAllocations();
+    // Пиковый и текущий размер резидентной памяти процесса в байтах,
+    // 0 - неизвестен
+    size_t PeakRss();
+    size_t CurrentRss();
+
+    struct Result {
+        std::string name;                           // бенчмарк/случай
+        std::map<std::string, long long> params;
+        long long ops = 0;
+        double ns_per_op = 0;
+        double allocs_per_op = 0;
+        double bytes_per_op = 0;
+        size_t peak_rss = 0;                        // процесса, после случая
+        std::map<std::string, double> metrics;      // дополнительные, например перцентили
+    };
+    // Результаты Measure за запуск: main пишет их в JSON (json=path)
+    std::vector<Result> & Results();
+    void Report(Result result);
+    void WriteJson(std::ostream & out);
+
+    // Выполняет body, делающее ops операций, печатает и сохраняет ns/op,
+    // выделения на операцию (всего и по подсистемам: allocs/parse, B/parse, ...)
+    // и пиковый RSS. Подготовка делается до вызова
+    template<typename Body>
+    void Measure(std::string name, std::map<std::string, long long> params, long long ops, Body && body) {
+        auto before = GetAllocationStats();
+        Timer timer;
+        body();
+        double seconds = timer.Seconds();
+        auto after = GetAllocationStats();
+        double divisor = static_cast<double>(ops > 0 ? ops : 1);
+        Result result;
+        result.name = std::move(name);
+        result.params = std::move(params);
+        result.ops = ops;
+        result.ns_per_op = seconds * 1e9 / divisor;
+        result.allocs_per_op = static_cast<double>(after.Total().count - before.Total().count) / divisor;
+        result.bytes_per_op = static_cast<double>(after.Total().bytes - before.Total().bytes) / divisor;
+        for (int i = 0; i < kAllocSubsystems; i++) {
+            auto count = after.by_subsystem[i].count - before.by_subsystem[i].count;
+            if (!count)
+                continue;
+            auto subsystem = std::string(AllocSubsystemName(static_cast<AllocSubsystem>(i)));
+            result.metrics["allocs/" + subsystem] = static_cast<double>(count) / divisor;
+            result.metrics["B/" + subsystem] = static_cast<double>(after.by_subsystem[i].bytes - before.by_subsystem[i].bytes) / divisor;
+        }
+        result.peak_rss = PeakRss();
+        Report(std::move(result));
+    }
+}
+
+#define BENCHMARK(name) \
+    static void name(bench::Args const &); \
+    static bench::Registrar name##_registrar(#name, name); \
+    static void name(bench::Args const & args)
+
+#endif //SPREADSHEET_BENCH_H
@@ -0,0 +1,48 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Export.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+// Опрос изменений после edits правок против полной выгрузки значений
+BENCHMARK(ChangeSet) {
+    auto path = args.Get("path", std::string("changeset_bench.tsv"));
+    auto size = args.Get("size_mb", 16) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto edits = args.Get("edits", 100);
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    SpreadSheet sheet;
+    ImportFile(sheet, path);
+    auto since = sheet.GetChangesSince(0).version;
+    auto printable = sheet.GetPrintableSize();
+
+    bench::Timer idle_timer;
+    auto idle = sheet.GetChangesSince(since);
+    double idle_seconds = idle_timer.Seconds();
+
+    std::mt19937 random(1);
+    for (long long i = 0; i < edits; i++) {
+        // текстовые столбцы (col % 4 == 2), на которые не ссылаются формулы
+        Position pos{static_cast<int>(random() % printable.rows), static_cast<int>(random() % printable.cols) / 4 * 4 + 2};
+        sheet.SetCell(pos, "edit" + std::to_string(i));
+    }
+
+    bench::Timer changes_timer;
+    auto changes = sheet.GetChangesSince(since);
+    double changes_seconds = changes_timer.Seconds();
+
+    std::ostringstream dump;
+    bench::Timer dump_timer;
+    Exporter().WriteValues(sheet, dump);
+    double dump_seconds = dump_timer.Seconds();
+
+    std::cout << "  " << printable.rows << "x" << printable.cols << ": idle poll " << idle_seconds * 1e6 << " us ("
+              << idle.cells.size() << " cells), poll after " << edits << " edits " << changes_seconds * 1e3 << " ms ("
+              << changes.cells.size() << " cells), full dump " << dump_seconds * 1e3 << " ms" << std::endl;
+}
@@ -0,0 +1,105 @@
+#include "Data.h"
+#include "Trace.h"
+#include "common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+namespace bench {
+    void GenerateTsv(std::string const & path, long long size, int cols) {
+        std::ofstream out(path, std::ios::binary);
+        std::string line;
+        long long written = 0;
+        for (int row = 0; written < size && row < Position::kMaxRows; row++) {
+            line.clear();
+            for (int col = 0; col < cols; col++) {
+                if (col)
+                    line += '\t';
+                switch (col % 4) {
+                    case 0:
+                        line += std::to_string(row * 7 + col);
+                        break;
+                    case 1:
+                        line += std::to_string(row) + ".25";
+                        break;
+                    case 2:
+                        line += "item" + std::to_string(row % 100);
+                        break;
+                    default:
+                        if (row == 0)
+                            line += "=1";
+                        else
+                            line += '=' + Position{row - 1, col}.ToString() + '+' + Position{row, col - 3}.ToString();
+                }
+            }
+            line += '\n';
+            out << line;
+            written += static_cast<long long>(line.size());
+        }
+    }
+
+    void GenerateTrace(std::string const & path, long long ops, int rows, int cols, unsigned seed) {
+        std::ofstream out(path, std::ios::binary);
+        std::mt19937 random(seed);
+        auto below = [&](int bound) { return static_cast<int>(random() % static_cast<unsigned>(bound)); };
+        int current_rows = rows;
+        int current_cols = cols;
+        out << "# " << ops << " operations, " << rows << "x" << cols << '\n';
+        for (long long i = 0; i < ops; i++) {
+            TraceRecord record;
+            Position pos {below(current_rows), below(current_cols)};
+            auto kind = below(1000);
+            if (kind < 500) {
+                record.pos = pos;
+                if (kind < 200) {
+                    record.text = std::to_string(below(10000));
+                } else if (kind < 250) {
+                    record.text = "item" + std::to_string(below(100));
+                } else if (pos.row == 0) {
+                    record.text = "=" + std::to_string(below(100)) + "/4";
+                } else {
+                    record.text = "=" + Position{below(pos.row), below(current_cols)}.ToString();
+                    for (int refs = below(3); refs > 0; refs--)
+                        record.text += "+" + Position{below(pos.row), below(current_cols)}.ToString();
+                }
+            } else if (kind < 850) {
+                record.op = TraceOp::GetValue;
+                record.pos = pos;
+            } else if (kind < 900) {
+                record.op = TraceOp::GetText;
+                record.pos = pos;
+            } else if (kind < 950) {
+                record.op = TraceOp::ClearCell;
+                record.pos = pos;
+            } else if (kind < 990) {
+                record.op = TraceOp::GetSize;
+            } else if (kind < 992) {
+                record.op = TraceOp::InsertRows;
+                record.first = pos.row;
+                record.count = 1 + below(3);
+                current_rows += record.count;
+            } else if (kind < 994) {
+                record.op = TraceOp::InsertCols;
+                record.first = pos.col;
+                record.count = 1 + below(2);
+                current_cols += record.count;
+            } else if (kind < 996 && current_rows > rows) {
+                record.op = TraceOp::DeleteRows;
+                record.first = pos.row;
+                record.count = std::min(current_rows - rows, 1 + below(3));
+                current_rows -= record.count;
+            } else if (kind < 998 && current_cols > cols) {
+                record.op = TraceOp::DeleteCols;
+                record.first = pos.col;
+                record.count = std::min(current_cols - cols, 1 + below(2));
+                current_cols -= record.count;
+            } else if (kind < 999) {
+                record.op = TraceOp::PrintValues;
+            } else {
+                record.op = TraceOp::PrintTexts;
+            }
+            out << FormatTraceRecord(record) << '\n';
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef SPREADSHEET_BENCH_DATA_H
+#define SPREADSHEET_BENCH_DATA_H
+
+#include <string>
+
+namespace bench {
+    // Таблица из cols столбцов: числа, текст и формулы со ссылками на
+    // предыдущую строку. Пишет строки, пока файл не достигнет size байт
+    void GenerateTsv(std::string const & path, long long size, int cols);
+
+    // Трасса из ops операций над таблицей около rows x cols: в основном правки
+    // и чтения значений, реже очистки, печать и вставка и удаление строк и
+    // столбцов. Формулы ссылаются только на строки выше, поэтому циклов нет
+    void GenerateTrace(std::string const & path, long long ops, int rows, int cols, unsigned seed = 1);
+}
+
+#endif //SPREADSHEET_BENCH_DATA_H
@@ -0,0 +1,113 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Export.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    // Печать через ICell, как PrintValues до появления Exporter
+    void PrintValuesByCell(SpreadSheet const & sheet, std::ostream & output) {
+        auto size = sheet.GetPrintableSize();
+        for (int i = 0; i < size.rows; i++) {
+            for (int j = 0; j < size.cols; j++) {
+                if (auto cell = sheet.GetCell({i, j}); cell) {
+                    if (std::holds_alternative<double>(cell->GetValue()))
+                        output << std::get<double>(cell->GetValue());
+                    else if (std::holds_alternative<FormulaError>(cell->GetValue()))
+                        output << std::get<FormulaError>(cell->GetValue()).ToString();
+                    else
+                        output << std::get<std::string>(cell->GetValue());
+                }
+                if (j != size.cols - 1)
+                    output << '\t';
+            }
+            output << '\n';
+        }
+    }
+}
+
+// Значения всей таблицы и окна window_rows x window_cols; out - куда писать
+BENCHMARK(Export) {
+    auto path = args.Get("path", std::string("export_bench.tsv"));
+    auto out_path = args.Get("out", std::string("/dev/null"));
+    auto size = args.Get("size_mb", 16) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto window_rows = static_cast<int>(args.Get("window_rows", 50));
+    auto window_cols = static_cast<int>(args.Get("window_cols", 20));
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    SpreadSheet sheet;
+    ImportFile(sheet, path);
+    // формулы вычисляются заранее, чтобы сравнивать только вывод
+    std::ofstream output(out_path, std::ios::binary);
+    sheet.PrintValues(output);
+
+    bench::Timer by_cell_timer;
+    PrintValuesByCell(sheet, output);
+    double by_cell_seconds = by_cell_timer.Seconds();
+
+    Exporter exporter;
+    bench::Timer exporter_timer;
+    exporter.WriteValues(sheet, output);
+    double exporter_seconds = exporter_timer.Seconds();
+
+    auto printable = sheet.GetPrintableSize();
+    const int windows = 1000;
+    bench::Timer window_timer;
+    for (int i = 0; i < windows; i++) {
+        Position first{(i * 97) % std::max(printable.rows - window_rows, 1), 0};
+        exporter.WriteValues(sheet, output, ExportRange{first, {window_rows, window_cols}});
+    }
+    double window_seconds = window_timer.Seconds() / windows;
+
+    double cells = static_cast<double>(printable.rows) * printable.cols;
+    std::cout << "  " << printable.rows << "x" << printable.cols << ": by cell " << by_cell_seconds
+              << " s, exporter " << exporter_seconds << " s (" << cells / exporter_seconds / 1e6 << " M cells/s, "
+              << by_cell_seconds / exporter_seconds << "x), " << window_rows << "x" << window_cols
+              << " window " << window_seconds * 1e6 << " us" << std::endl;
+}
+
+// Масштабирование параллельного вывода по числу потоков (1..max_threads).
+// verify=1 сравнивает результат с последовательным PrintValues
+BENCHMARK(ExportParallel) {
+    auto path = args.Get("path", std::string("export_bench.tsv"));
+    auto out_path = args.Get("out", std::string("/dev/null"));
+    auto size = args.Get("size_mb", 16) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto max_threads = static_cast<unsigned>(args.Get("max_threads", 32));
+    auto verify = args.Get("verify", 1);
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    SpreadSheet sheet;
+    ImportFile(sheet, path);
+
+    std::ostringstream expected;
+    sheet.PrintValues(expected);
+
+    std::ofstream output(out_path, std::ios::binary);
+    double serial_seconds = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        Exporter exporter(ExportOptions{1 << 20, threads});
+        bench::Timer timer;
+        exporter.WriteValues(sheet, output);
+        double seconds = timer.Seconds();
+        if (threads == 1)
+            serial_seconds = seconds;
+
+        if (verify) {
+            std::ostringstream actual;
+            exporter.WriteValues(sheet, actual);
+            if (actual.str() != expected.str())
+                throw std::runtime_error("parallel export differs from PrintValues");
+        }
+        double megabytes = static_cast<double>(expected.str().size()) / (1 << 20);
+        std::cout << "  threads=" << threads << ": " << seconds << " s, " << megabytes / seconds
+                  << " MB/s, speedup " << serial_seconds / seconds << std::endl;
+    }
+}
@@ -0,0 +1,107 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    void Evaluate(SpreadSheet const & sheet, Position pos) {
+        auto cell = sheet.GetCell(pos);
+        if (!cell)
+            throw std::runtime_error("no cell at " + pos.ToString());
+        (void)cell->GetValue();
+    }
+}
+
+// Цепочка depth формул, каждая ссылается на ячейку над ней: построение,
+// первое вычисление конца и updates правок начала с чтением конца
+BENCHMARK(Chain) {
+    auto depth = static_cast<int>(args.Get("depth", 5000));
+    auto updates = args.Get("updates", 200);
+    std::map<std::string, long long> params {{"depth", depth}};
+
+    SpreadSheet sheet;
+    Position last {depth - 1, 0};
+    bench::Measure("Chain/build", params, depth, [&] {
+        sheet.SetCell({0, 0}, "0");
+        for (int row = 1; row < depth; row++) {
+            sheet.SetCell({row, 0}, "=" + Position{row - 1, 0}.ToString() + "+1");
+        }
+    });
+    bench::Measure("Chain/evaluate", params, depth, [&] { Evaluate(sheet, last); });
+    bench::Measure("Chain/update", params, updates, [&] {
+        for (long long i = 0; i < updates; i++) {
+            sheet.SetCell({0, 0}, std::to_string(i));
+            Evaluate(sheet, last);
+        }
+    });
+}
+
+// Треугольник Паскаля size x size: каждая ячейка - сумма левой и верхней
+BENCHMARK(Pascal) {
+    auto size = static_cast<int>(args.Get("size", 200));
+    auto updates = args.Get("updates", 20);
+    long long cells = static_cast<long long>(size) * size;
+    std::map<std::string, long long> params {{"size", size}};
+
+    SpreadSheet sheet;
+    Position last {size - 1, size - 1};
+    bench::Measure("Pascal/build", params, cells, [&] {
+        for (int row = 0; row < size; row++) {
+            for (int col = 0; col < size; col++) {
+                if (!row || !col)
+                    sheet.SetCell({row, col}, "1");
+                else
+                    sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+" + Position{row - 1, col}.ToString());
+            }
+        }
+    });
+    bench::Measure("Pascal/evaluate", params, cells, [&] { Evaluate(sheet, last); });
+    bench::Measure("Pascal/update", params, updates * (cells - size), [&] {
+        for (long long i = 0; i < updates; i++) {
+            // от B1 зависят все ячейки правее первого столбца
+            sheet.SetCell({0, 1}, std::to_string(i % 2));
+            Evaluate(sheet, last);
+        }
+    });
+}
+
+// Одна формула, складывающая width ячеек (fan-in), и width формул,
+// ссылающихся на одну ячейку (fan-out). Правка аргумента и чтение зависимых
+BENCHMARK(Fan) {
+    auto width = static_cast<int>(args.Get("width", 1000));
+    auto updates = args.Get("updates", 1000);
+    std::map<std::string, long long> params {{"width", width}};
+
+    SpreadSheet in;
+    std::string sum = "=";
+    for (int row = 0; row < width; row++) {
+        in.SetCell({row, 0}, std::to_string(row));
+        sum += (row ? "+" : "") + Position{row, 0}.ToString();
+    }
+    Position total {0, 1};
+    bench::Measure("FanIn/build", params, 1, [&] { in.SetCell(total, sum); });
+    bench::Measure("FanIn/update", params, updates, [&] {
+        for (long long i = 0; i < updates; i++) {
+            in.SetCell({static_cast<int>(i % width), 0}, std::to_string(i));
+            Evaluate(in, total);
+        }
+    });
+
+    SpreadSheet out;
+    out.SetCell({0, 0}, "1");
+    bench::Measure("FanOut/build", params, width, [&] {
+        for (int row = 0; row < width; row++) {
+            out.SetCell({row, 1}, "=A1+" + std::to_string(row));
+        }
+    });
+    bench::Measure("FanOut/update", params, updates * width, [&] {
+        for (long long i = 0; i < updates; i++) {
+            out.SetCell({0, 0}, std::to_string(i));
+            for (int row = 0; row < width; row++) {
+                Evaluate(out, {row, 1});
+            }
+        }
+    });
+}
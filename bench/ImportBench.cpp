@@ -0,0 +1,31 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// size_mb=1024 для замера на 1 ГБ; threads=0 - по числу ядер. Без cols
+// ширина подбирается так, чтобы size поместился в kMaxRows строк
+BENCHMARK(ImportTsv) {
+    auto path = args.Get("path", std::string("import_bench.tsv"));
+    auto size = args.Get("size_mb", 64) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto threads = static_cast<unsigned>(args.Get("threads", 0));
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    size = static_cast<long long>(std::filesystem::file_size(path));
+
+    SpreadSheet sheet;
+    bench::Timer timer;
+    ImportFile(sheet, path, ImportOptions{'\t', threads});
+    double seconds = timer.Seconds();
+
+    auto printable = sheet.GetPrintableSize();
+    double megabytes = static_cast<double>(size) / (1 << 20);
+    std::cout << "  " << megabytes << " MB, " << printable.rows << "x" << printable.cols
+              << " cells in " << seconds << " s, " << megabytes / seconds << " MB/s" << std::endl;
+}
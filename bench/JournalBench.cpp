@@ -0,0 +1,79 @@
+#include "Bench.h"
+#include "Engine.h"
+#include "Journal.h"
+
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+namespace {
+    // Поток правок: числа и формулы со ссылками на соседние ячейки выше
+    void Edit(SpreadSheet & sheet, std::mt19937 & random, int rows, int cols) {
+        int row = static_cast<int>(random() % rows), col = static_cast<int>(random() % cols);
+        if (row > 0 && random() % 4 == 0)
+            sheet.SetCell({row, col}, "=" + Position{row - 1, col}.ToString() + "+1");
+        else
+            sheet.SetCell({row, col}, std::to_string(random() % 1000));
+    }
+}
+
+// Пропускная способность журнала при разном размере группы (group=1 - fsync
+// на каждую операцию) и время восстановления через Replay
+BENCHMARK(JournalThroughput) {
+    auto path = args.Get("path", std::string("journal_bench.log"));
+    auto ops = args.Get("ops", 200000);
+    auto rows = static_cast<int>(args.Get("rows", 1000));
+    auto cols = static_cast<int>(args.Get("cols", 26));
+    auto sync = args.Get("sync", 1) != 0;
+
+    {
+        SpreadSheet sheet;
+        std::mt19937 random(1);
+        bench::Timer timer;
+        for (long long i = 0; i < ops; i++) {
+            Edit(sheet, random, rows, cols);
+        }
+        std::cout << "  no journal: " << ops / timer.Seconds() << " ops/s" << std::endl;
+    }
+
+    for (size_t group : {size_t{1}, size_t{16}, size_t{256}, size_t{4096}}) {
+        // fsync на каждую операцию медленный, поэтому для group=1 операций меньше
+        long long group_ops = group == 1 ? std::min(ops, 2000ll) : ops;
+        std::filesystem::remove(path);
+        SpreadSheet sheet;
+        std::mt19937 random(1);
+        Journal journal(path, JournalOptions{group, 1 << 20, sync});
+        sheet.SetJournal(&journal);
+
+        bench::Timer timer;
+        for (long long i = 0; i < group_ops; i++) {
+            Edit(sheet, random, rows, cols);
+        }
+        journal.Commit();
+        double seconds = timer.Seconds();
+        std::cout << "  group=" << group << ": " << group_ops / seconds << " ops/s, "
+                  << std::filesystem::file_size(path) / group_ops << " bytes/op" << std::endl;
+    }
+
+    std::ostringstream expected;
+    {
+        SpreadSheet sheet;
+        std::mt19937 random(1);
+        for (long long i = 0; i < ops; i++) {
+            Edit(sheet, random, rows, cols);
+        }
+        sheet.PrintTexts(expected);
+    }
+
+    SpreadSheet recovered;
+    bench::Timer replay_timer;
+    recovered.Replay(path);
+    double replay_seconds = replay_timer.Seconds();
+
+    std::ostringstream actual;
+    recovered.PrintTexts(actual);
+    if (actual.str() != expected.str())
+        throw std::runtime_error("replayed sheet differs from the original");
+    std::cout << "  replay: " << ops << " ops in " << replay_seconds << " s, " << ops / replay_seconds << " ops/s" << std::endl;
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,139 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// SetCell в пустую таблицу rows x cols: числа, текст, формулы со ссылками на
+// ячейку слева и перезапись уже заполненных ячеек
+BENCHMARK(SetCell) {
+    auto rows = static_cast<int>(args.Get("rows", 1000));
+    auto cols = static_cast<int>(args.Get("cols", 100));
+    long long ops = static_cast<long long>(rows) * cols;
+    std::map<std::string, long long> params {{"rows", rows}, {"cols", cols}};
+
+    auto measure = [&](std::string const & name, auto text_of) {
+        std::vector<std::string> texts;
+        texts.reserve(ops);
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                texts.push_back(text_of(row, col));
+            }
+        }
+        SpreadSheet sheet;
+        bench::Measure(name, params, ops, [&] {
+            size_t i = 0;
+            for (int row = 0; row < rows; row++) {
+                for (int col = 0; col < cols; col++) {
+                    sheet.SetCell({row, col}, std::move(texts[i++]));
+                }
+            }
+        });
+    };
+    measure("SetCell/number", [](int row, int col) { return std::to_string(row * 7 + col); });
+    measure("SetCell/text", [](int row, int col) { return "item" + std::to_string(row + col); });
+    measure("SetCell/formula", [](int row, int col) {
+        return col ? "=" + Position{row, col - 1}.ToString() + "*2+1" : std::to_string(row);
+    });
+
+    SpreadSheet sheet;
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+            sheet.SetCell({row, col}, std::to_string(row + col));
+        }
+    }
+    std::vector<std::string> texts;
+    texts.reserve(ops);
+    for (long long i = 0; i < ops; i++) {
+        texts.push_back(std::to_string(i));
+    }
+    bench::Measure("SetCell/overwrite", params, ops, [&] {
+        size_t i = 0;
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                sheet.SetCell({row, col}, std::move(texts[i++]));
+            }
+        }
+    });
+}
+
+// Position::ToString и FromString на случайных позициях
+BENCHMARK(Positions) {
+    auto count = args.Get("count", 1000000);
+    std::map<std::string, long long> params {{"count", count}};
+
+    std::mt19937 random(1);
+    std::vector<Position> positions;
+    positions.reserve(count);
+    for (long long i = 0; i < count; i++) {
+        positions.push_back({static_cast<int>(random() % Position::kMaxRows), static_cast<int>(random() % Position::kMaxCols)});
+    }
+
+    std::vector<std::string> names;
+    names.reserve(count);
+    bench::Measure("Position/ToString", params, count, [&] {
+        for (auto & pos : positions) {
+            names.push_back(pos.ToString());
+        }
+    });
+
+    long long checksum = 0;
+    bench::Measure("Position/FromString", params, count, [&] {
+        for (auto & name : names) {
+            checksum += Position::FromString(name).row;
+        }
+    });
+    if (checksum < 0)
+        throw std::runtime_error("unexpected checksum");
+}
+
+// rows x cols текстовых ячеек из distinct различных значений, как столбцы
+// тикеров и регионов: заполнение, чтение значений через ICell и сырого
+// текста, память текстов и ячеек на ячейку
+BENCHMARK(TextCells) {
+    auto rows = static_cast<int>(args.Get("rows", 100000));
+    auto cols = static_cast<int>(args.Get("cols", 10));
+    auto distinct = static_cast<size_t>(args.Get("distinct", 64));
+    long long ops = static_cast<long long>(rows) * cols;
+    std::map<std::string, long long> params {{"rows", rows}, {"cols", cols}, {"distinct", static_cast<long long>(distinct)}};
+
+    std::vector<std::string> values;
+    for (size_t i = 0; i < distinct; i++) {
+        values.push_back("region-" + std::to_string(i) + "-north-east");
+    }
+
+    SpreadSheet sheet;
+    bench::Measure("TextCells/fill", params, ops, [&] {
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                sheet.SetCell({row, col}, values[(static_cast<size_t>(row) * cols + col) % distinct]);
+            }
+        }
+    });
+
+    size_t checksum = 0;
+    bench::Measure("TextCells/value", params, ops, [&] {
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                checksum += std::get<std::string>(sheet.GetCell({row, col})->GetValue()).size();
+            }
+        }
+    });
+    bench::Measure("TextCells/raw", params, ops, [&] {
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                checksum += dynamic_cast<DefaultCell const &>(*sheet.GetCell({row, col})).GetRawText().size();
+            }
+        }
+    });
+    if (checksum == 0)
+        throw std::runtime_error("unexpected checksum");
+
+    auto memory = sheet.MemoryUsage();
+    std::cout << "  texts " << memory.texts << " B, cells " << memory.cells << " B, "
+              << static_cast<double>(memory.texts + memory.cells) / static_cast<double>(ops) << " B/cell" << std::endl;
+}
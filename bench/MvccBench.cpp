@@ -0,0 +1,57 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+// Правки вперемешку со снимками: каждые every правок берётся новый снимок,
+// предыдущий остаётся живым, пока его выгружает читатель
+BENCHMARK(MvccSnapshot) {
+    auto path = args.Get("path", std::string("mvcc_bench.tsv"));
+    auto size = args.Get("size_mb", 16) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto edits = args.Get("edits", 100000);
+    auto every = std::max(args.Get("every", 1000), 1LL);
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    SpreadSheet sheet;
+    ImportFile(sheet, path);
+    auto printable = sheet.GetPrintableSize();
+
+    // snapshots=0 - те же правки без снимков, для сравнения
+    bool snapshots = args.Get("snapshots", 1);
+    bench::Timer first_timer;
+    auto snapshot = snapshots ? sheet.Snapshot() : nullptr;
+    double first_seconds = first_timer.Seconds();
+
+    std::mt19937 random(1);
+    double snapshot_seconds = 0;
+    bench::Timer edits_timer;
+    for (long long i = 0; i < edits; i++) {
+        // текстовые столбцы (col % 4 == 2), на которые не ссылаются формулы
+        Position pos{static_cast<int>(random() % printable.rows), static_cast<int>(random() % printable.cols) / 4 * 4 + 2};
+        sheet.SetCell(pos, "edit" + std::to_string(i));
+        if (snapshots && i % every == every - 1) {
+            bench::Timer timer;
+            auto next = sheet.Snapshot();
+            snapshot_seconds += timer.Seconds();
+            snapshot = std::move(next);
+        }
+    }
+    double edits_seconds = edits_timer.Seconds() - snapshot_seconds;
+
+    std::ostringstream dump;
+    bench::Timer dump_timer;
+    if (snapshot)
+        snapshot->PrintValues(dump);
+    double dump_seconds = dump_timer.Seconds();
+
+    std::cout << "  " << printable.rows << "x" << printable.cols << ": first snapshot " << first_seconds * 1e3 << " ms, "
+              << edits << " edits " << edits_seconds / edits * 1e9 << " ns/edit, snapshot "
+              << snapshot_seconds / std::max(edits / every, 1LL) * 1e9 << " ns, snapshot dump " << dump_seconds * 1e3 << " ms" << std::endl;
+}
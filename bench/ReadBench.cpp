@@ -0,0 +1,54 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Чтение значений случайных ячеек из threads потоков: сначала формулы
+// вычисляются (холодный проход), затем берутся готовые значения
+BENCHMARK(ConcurrentReads) {
+    auto path = args.Get("path", std::string("reads_bench.tsv"));
+    auto size = args.Get("size_mb", 16) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto threads = static_cast<int>(args.Get("threads", std::max(1u, std::thread::hardware_concurrency())));
+    auto reads = args.Get("reads", 1000000);
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(path, size, cols);
+    SpreadSheet sheet;
+    ImportFile(sheet, path);
+    auto printable = sheet.GetPrintableSize();
+
+    auto run = [&] {
+        std::atomic<long long> numbers {0};
+        std::vector<std::thread> readers;
+        bench::Timer timer;
+        for (int t = 0; t < threads; t++) {
+            readers.emplace_back([&, t] {
+                std::mt19937 random(t + 1);
+                long long local = 0;
+                for (long long i = 0; i < reads / threads; i++) {
+                    Position pos{static_cast<int>(random() % printable.rows), static_cast<int>(random() % printable.cols)};
+                    if (auto cell = sheet.GetCell(pos); cell && std::holds_alternative<double>(cell->GetValue()))
+                        local++;
+                }
+                numbers += local;
+            });
+        }
+        for (auto & reader : readers)
+            reader.join();
+        return std::make_pair(timer.Seconds(), numbers.load());
+    };
+
+    auto cold = run();
+    auto warm = run();
+    std::cout << "  " << printable.rows << "x" << printable.cols << ", " << threads << " threads, " << reads << " reads: cold "
+              << reads / cold.first / 1e6 << " M/s, warm " << reads / warm.first / 1e6 << " M/s ("
+              << warm.second << " numbers)" << std::endl;
+}
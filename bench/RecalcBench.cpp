@@ -0,0 +1,43 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <iostream>
+#include <string>
+
+// Правки начала цепочки формул глубины depth, после каждой читается её конец.
+// В ленивом режиме правка сбрасывает всю цепочку, а чтение пересчитывает её;
+// в фоновом правка только передаёт изменение, а читается последний
+// пересчитанный вид
+BENCHMARK(AsyncRecalc) {
+    auto depth = static_cast<int>(args.Get("depth", 2000));
+    auto edits = args.Get("edits", 2000);
+
+    auto run = [&](RecalcMode mode) {
+        SpreadSheet sheet;
+        sheet.SetCell({0, 0}, "0");
+        for (int row = 1; row < depth; row++) {
+            sheet.SetCell({row, 0}, "=" + Position{row - 1, 0}.ToString() + "+1");
+        }
+        Position last{depth - 1, 0};
+        sheet.SetRecalcMode(mode);
+        sheet.WaitForRecalc();
+
+        double edit_seconds = 0;
+        bench::Timer total_timer;
+        for (long long i = 0; i < edits; i++) {
+            bench::Timer timer;
+            sheet.SetCell({0, 0}, std::to_string(i));
+            edit_seconds += timer.Seconds();
+            (void)sheet.GetConsistentView()->GetCell(last)->GetValue();
+            if (mode == RecalcMode::Lazy)
+                (void)sheet.GetCell(last)->GetValue();
+        }
+        sheet.WaitForRecalc();
+        double total_seconds = total_timer.Seconds();
+        std::cout << "  " << (mode == RecalcMode::Lazy ? "lazy" : "async") << ": edit "
+                  << edit_seconds / edits * 1e9 << " ns, total " << total_seconds * 1e3 << " ms" << std::endl;
+    };
+    std::cout << "  depth " << depth << ", " << edits << " edits" << std::endl;
+    run(RecalcMode::Lazy);
+    run(RecalcMode::Async);
+}
@@ -0,0 +1,251 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    std::string Describe(ICell::Value const & value) {
+        std::ostringstream out;
+        std::visit([&](auto const & item) { out << item; }, value);
+        return out.str();
+    }
+
+    // Конфигурация движка, на которой проигрывается трасса:
+    //   lazy  - CreateSheet(), формулы вычисляются при чтении
+    //   async - RecalcMode::Async, значения читаются после фонового пересчёта
+    class Replayer {
+    public:
+        explicit Replayer(std::string const & config) : sheet_(CreateSheet()) {
+            if (config == "async") {
+                async_ = dynamic_cast<SpreadSheet *>(sheet_.get());
+                async_->SetRecalcMode(RecalcMode::Async);
+            } else if (config != "lazy") {
+                throw std::runtime_error("unknown engine configuration: " + config);
+            }
+        }
+
+        // Выполняет операцию; возвращает наблюдаемый результат для сверки
+        std::string Apply(bench::TraceRecord const & record) {
+            try {
+                return Execute(record);
+            } catch (CircularDependencyException &) {
+                return "#circular";
+            } catch (FormulaException &) {
+                return "#formula";
+            } catch (TableTooBigException &) {
+                return "#too big";
+            } catch (InvalidPositionException &) {
+                return "#invalid position";
+            } catch (std::exception & error) {
+                // сбой движка: трасса проигрывается дальше, расхождение видно при сверке
+                errors_++;
+                return std::string("#error ") + error.what();
+            }
+        }
+
+        // Операции, упавшие с неожиданным исключением
+        [[nodiscard]] size_t Errors() const {
+            return errors_;
+        }
+
+        [[nodiscard]] SheetMemoryUsage MemoryUsage() const {
+            return dynamic_cast<SpreadSheet const &>(*sheet_).MemoryUsage();
+        }
+    private:
+        std::string Execute(bench::TraceRecord const & record) {
+            using bench::TraceOp;
+            switch (record.op) {
+                case TraceOp::SetCell:
+                    sheet_->SetCell(record.pos, record.text);
+                    return {};
+                case TraceOp::ClearCell:
+                    sheet_->ClearCell(record.pos);
+                    return {};
+                case TraceOp::InsertRows:
+                    sheet_->InsertRows(record.first, record.count);
+                    return {};
+                case TraceOp::InsertCols:
+                    sheet_->InsertCols(record.first, record.count);
+                    return {};
+                case TraceOp::DeleteRows:
+                    sheet_->DeleteRows(record.first, record.count);
+                    return {};
+                case TraceOp::DeleteCols:
+                    sheet_->DeleteCols(record.first, record.count);
+                    return {};
+                case TraceOp::GetValue: {
+                    // пустая ячейка, на которую ссылаются формулы, видна со
+                    // значением 0 или отсутствует в зависимости от пути чтения
+                    auto cell = sheet_->GetCell(record.pos);
+                    if (!cell || cell->GetText().empty())
+                        return {};
+                    return Describe(async_ ? async_->GetValueAsync(record.pos).get() : cell->GetValue());
+                }
+                case TraceOp::GetText: {
+                    auto cell = sheet_->GetCell(record.pos);
+                    return cell ? cell->GetText() : std::string();
+                }
+                case TraceOp::GetSize: {
+                    auto size = sheet_->GetPrintableSize();
+                    return std::to_string(size.rows) + "x" + std::to_string(size.cols);
+                }
+                case TraceOp::PrintValues: {
+                    std::ostringstream out;
+                    if (async_) {
+                        async_->WaitForRecalc();
+                        async_->GetConsistentView()->PrintValues(out);
+                    } else {
+                        sheet_->PrintValues(out);
+                    }
+                    return Digest(out.str());
+                }
+                case TraceOp::PrintTexts: {
+                    std::ostringstream out;
+                    sheet_->PrintTexts(out);
+                    return Digest(out.str());
+                }
+            }
+            return {};
+        }
+
+        static std::string Digest(std::string const & output) {
+            return std::to_string(output.size()) + ":" + std::to_string(std::hash<std::string>()(output));
+        }
+
+        std::unique_ptr<ISheet> sheet_;
+        SpreadSheet * async_ = nullptr;
+        size_t errors_ = 0;
+    };
+
+    double Percentile(std::vector<uint64_t> const & sorted, double fraction) {
+        auto index = static_cast<size_t>(fraction * static_cast<double>(sorted.size()));
+        return static_cast<double>(sorted[std::min(index, sorted.size() - 1)]);
+    }
+}
+
+// Проигрывает трассу операций (формат в Trace.h) на CreateSheet() и печатает
+// задержки каждого типа операций (p50/p99/p999), пропускную способность,
+// память по ходу проигрывания и MemoryUsage() таблицы в конце.
+//   trace=path      файл трассы
+//   generate=N      сначала записать в path синтетическую трассу из N операций
+//   config=lazy|async
+//   check=lazy|async  проиграть ту же трассу на второй конфигурации и сверить
+//                     результаты каждой операции; расхождения - ошибка
+//   samples=20      сколько раз за проигрывание замерить память
+BENCHMARK(Replay) {
+    auto path = args.Get("trace", std::string("replay_bench.trace"));
+    auto config = args.Get("config", std::string("lazy"));
+    auto check = args.Get("check", std::string());
+    auto samples = std::max(args.Get("samples", 20), 1LL);
+    if (auto generate = args.Get("generate", 0); generate > 0)
+        bench::GenerateTrace(path, generate, static_cast<int>(args.Get("rows", 1000)), static_cast<int>(args.Get("cols", 20)));
+
+    std::vector<bench::TraceRecord> records;
+    std::vector<size_t> lines;
+    {
+        std::ifstream input(path, std::ios::binary);
+        if (!input)
+            throw std::runtime_error("cannot open trace " + path);
+        std::string line;
+        for (size_t number = 1; std::getline(input, line); number++) {
+            if (auto record = bench::ParseTraceLine(line); record) {
+                records.push_back(std::move(*record));
+                lines.push_back(number);
+            }
+        }
+    }
+
+    Replayer primary(config);
+    std::optional<Replayer> checker;
+    if (!check.empty())
+        checker.emplace(check);
+
+    std::array<std::vector<uint64_t>, bench::kTraceOps> latencies;
+    std::array<bench::Allocations, bench::kTraceOps> allocations {};
+    size_t sample_every = std::max<size_t>(records.size() / samples, 1);
+    size_t mismatches = 0;
+    double busy_seconds = 0;
+    bench::Timer wall_timer;
+    std::cout << "  " << records.size() << " operations from " << path << ", config " << config << std::endl;
+    for (size_t i = 0; i < records.size(); i++) {
+        auto & record = records[i];
+        auto op = static_cast<size_t>(record.op);
+        auto before = bench::CountAllocations();
+        auto start = std::chrono::steady_clock::now();
+        auto result = primary.Apply(record);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        auto after = bench::CountAllocations();
+        latencies[op].push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        allocations[op].count += after.count - before.count;
+        allocations[op].bytes += after.bytes - before.bytes;
+        busy_seconds += std::chrono::duration<double>(elapsed).count();
+
+        if (checker) {
+            if (auto expected = checker->Apply(record); expected != result && mismatches++ < 5)
+                std::cout << "  mismatch at line " << lines[i] << " (" << bench::FormatTraceRecord(record) << "): "
+                          << config << " '" << result << "', " << check << " '" << expected << "'" << std::endl;
+        }
+        if ((i + 1) % sample_every == 0 || i + 1 == records.size())
+            std::cout << "  memory after " << i + 1 << " operations (" << wall_timer.Seconds() << " s): RSS "
+                      << static_cast<double>(bench::CurrentRss()) / (1 << 20) << " MB" << std::endl;
+    }
+
+    for (int op = 0; op < bench::kTraceOps; op++) {
+        auto & sorted = latencies[op];
+        if (sorted.empty())
+            continue;
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t total = 0;
+        for (auto latency : sorted)
+            total += latency;
+        double count = static_cast<double>(sorted.size());
+        bench::Result result;
+        result.name = "Replay/" + std::string(bench::TraceOpName(static_cast<bench::TraceOp>(op)));
+        result.ops = static_cast<long long>(sorted.size());
+        result.ns_per_op = static_cast<double>(total) / count;
+        result.allocs_per_op = static_cast<double>(allocations[op].count) / count;
+        result.bytes_per_op = static_cast<double>(allocations[op].bytes) / count;
+        result.peak_rss = bench::PeakRss();
+        result.metrics = {{"p50_ns", Percentile(sorted, 0.5)}, {"p99_ns", Percentile(sorted, 0.99)},
+                          {"p999_ns", Percentile(sorted, 0.999)}, {"max_ns", static_cast<double>(sorted.back())}};
+        bench::Report(std::move(result));
+    }
+
+    bench::Result total;
+    total.name = "Replay/total";
+    total.ops = static_cast<long long>(records.size());
+    total.ns_per_op = busy_seconds * 1e9 / static_cast<double>(std::max<size_t>(records.size(), 1));
+    total.peak_rss = bench::PeakRss();
+    total.metrics = {{"ops_per_second", static_cast<double>(records.size()) / std::max(busy_seconds, 1e-9)}};
+    total.metrics["errors"] = static_cast<double>(primary.Errors());
+    if (checker)
+        total.metrics["mismatches"] = static_cast<double>(mismatches);
+    // память таблицы в конце трассы и цена первого, полного обхода
+    auto memory_start = std::chrono::steady_clock::now();
+    auto memory = primary.MemoryUsage();
+    total.metrics["memory_usage_ns"] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - memory_start).count());
+    total.metrics["mem/grid"] = static_cast<double>(memory.grid);
+    total.metrics["mem/cells"] = static_cast<double>(memory.cells);
+    total.metrics["mem/texts"] = static_cast<double>(memory.texts);
+    total.metrics["mem/formulas"] = static_cast<double>(memory.formulas);
+    total.metrics["mem/graph_vertexes"] = static_cast<double>(memory.graph_vertexes);
+    total.metrics["mem/graph_edges"] = static_cast<double>(memory.graph_edges);
+    total.metrics["mem/graph_cache"] = static_cast<double>(memory.graph_cache);
+    bench::Report(std::move(total));
+    if (primary.Errors())
+        throw std::runtime_error(std::to_string(primary.Errors()) + " operations failed with unexpected exceptions");
+    if (mismatches)
+        throw std::runtime_error(std::to_string(mismatches) + " results differ between " + config + " and " + check);
+}
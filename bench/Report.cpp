@@ -0,0 +1,112 @@
+#include "Bench.h"
+#include "AllocationHook.h"
+
+#include <fstream>
+#include <iostream>
+#include <ostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    void WriteString(std::ostream & out, std::string const & text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+}
+
+namespace bench {
+    Allocations CountAllocations() {
+        auto total = GetAllocationStats().Total();
+        return {total.count, total.bytes};
+    }
+
+    size_t PeakRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        rusage usage {};
+        if (getrusage(RUSAGE_SELF, &usage))
+            return 0;
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    size_t CurrentRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.WorkingSetSize;
+        return 0;
+#else
+        // второе поле - резидентные страницы; есть только в Linux
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        if (!(statm >> pages >> resident))
+            return 0;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    std::vector<Result> & Results() {
+        static std::vector<Result> results;
+        return results;
+    }
+
+    void Report(Result result) {
+        std::cout << "  " << result.name;
+        for (auto & [key, value] : result.params)
+            std::cout << ' ' << key << '=' << value;
+        std::cout << ": " << result.ns_per_op << " ns/op, " << result.allocs_per_op << " allocs/op, "
+                  << result.bytes_per_op << " B/op, peak RSS " << result.peak_rss / (1 << 20) << " MB";
+        for (auto & [key, value] : result.metrics)
+            std::cout << ", " << key << ' ' << value;
+        std::cout << std::endl;
+        Results().push_back(std::move(result));
+    }
+
+    void WriteJson(std::ostream & out) {
+        out << "{\n  \"benchmarks\": [";
+        bool first = true;
+        for (auto & result : Results()) {
+            out << (first ? "\n" : ",\n") << "    {\"name\": ";
+            first = false;
+            WriteString(out, result.name);
+            out << ", \"params\": {";
+            bool first_param = true;
+            for (auto & [key, value] : result.params) {
+                out << (first_param ? "" : ", ");
+                first_param = false;
+                WriteString(out, key);
+                out << ": " << value;
+            }
+            out << "}, \"ops\": " << result.ops << ", \"ns_per_op\": " << result.ns_per_op
+                << ", \"allocs_per_op\": " << result.allocs_per_op << ", \"bytes_per_op\": " << result.bytes_per_op
+                << ", \"peak_rss_bytes\": " << result.peak_rss;
+            for (auto & [key, value] : result.metrics) {
+                out << ", ";
+                WriteString(out, key);
+                out << ": " << value;
+            }
+            out << '}';
+        }
+        out << "\n  ]\n}\n";
+    }
+}
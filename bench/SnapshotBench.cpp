@@ -0,0 +1,46 @@
+#include "Bench.h"
+#include "Data.h"
+#include "Engine.h"
+#include "Import.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// Сравнивает загрузку снимка с повторным импортом того же TSV
+BENCHMARK(Snapshot) {
+    auto tsv_path = args.Get("path", std::string("snapshot_bench.tsv"));
+    auto snapshot_path = args.Get("snapshot", std::string("snapshot_bench.bin"));
+    auto size = args.Get("size_mb", 64) << 20;
+    auto cols = static_cast<int>(args.Get("cols", std::clamp<long long>(size / Position::kMaxRows / 8, 16, Position::kMaxCols)));
+    auto threads = static_cast<unsigned>(args.Get("threads", 0));
+
+    if (args.Get("generate", 1))
+        bench::GenerateTsv(tsv_path, size, cols);
+
+    SpreadSheet sheet;
+    bench::Timer import_timer;
+    ImportFile(sheet, tsv_path, ImportOptions{'\t', threads});
+    double import_seconds = import_timer.Seconds();
+
+    std::ostringstream values;
+    sheet.PrintValues(values);
+
+    bench::Timer save_timer;
+    sheet.Save(snapshot_path);
+    double save_seconds = save_timer.Seconds();
+
+    SpreadSheet loaded;
+    bench::Timer load_timer;
+    loaded.Load(snapshot_path);
+    double load_seconds = load_timer.Seconds();
+
+    std::ostringstream loaded_values;
+    loaded.PrintValues(loaded_values);
+    if (loaded_values.str() != values.str())
+        throw std::runtime_error("snapshot values differ from imported values");
+
+    double megabytes = static_cast<double>(std::filesystem::file_size(snapshot_path)) / (1 << 20);
+    std::cout << "  import " << import_seconds << " s, save " << save_seconds << " s, load " << load_seconds
+              << " s (" << megabytes << " MB snapshot, " << import_seconds / load_seconds << "x faster than import)" << std::endl;
+}
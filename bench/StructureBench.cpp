@@ -0,0 +1,70 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace {
+    // Таблица rows x cols: чётные столбцы - числа, нечётные - формулы со
+    // ссылками на ячейку слева и на строку выше
+    void Fill(SpreadSheet & sheet, int rows, int cols) {
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                if (col % 2 == 0)
+                    sheet.SetCell({row, col}, std::to_string(row * cols + col));
+                else if (row == 0)
+                    sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString());
+                else
+                    sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+" + Position{row - 1, col}.ToString());
+            }
+        }
+    }
+}
+
+// Вставка и удаление строк и столбцов посередине большой таблицы; каждая
+// операция сдвигает половину ячеек и переписывает ссылки формул
+BENCHMARK(Structure) {
+    auto rows = static_cast<int>(args.Get("rows", 5000));
+    auto cols = static_cast<int>(args.Get("cols", 40));
+    auto count = args.Get("repeat", 10);
+    std::map<std::string, long long> params {{"rows", rows}, {"cols", cols}};
+
+    SpreadSheet sheet;
+    Fill(sheet, rows, cols);
+    bench::Measure("Structure/InsertRows", params, count, [&] {
+        for (long long i = 0; i < count; i++)
+            sheet.InsertRows(rows / 2);
+    });
+    bench::Measure("Structure/DeleteRows", params, count, [&] {
+        for (long long i = 0; i < count; i++)
+            sheet.DeleteRows(rows / 2);
+    });
+    bench::Measure("Structure/InsertCols", params, count, [&] {
+        for (long long i = 0; i < count; i++)
+            sheet.InsertCols(cols / 2);
+    });
+    bench::Measure("Structure/DeleteCols", params, count, [&] {
+        for (long long i = 0; i < count; i++)
+            sheet.DeleteCols(cols / 2);
+    });
+}
+
+// PrintValues и PrintTexts той же таблицы; ops - ячейки. Первый вывод
+// значений вычисляет формулы
+BENCHMARK(Print) {
+    auto rows = static_cast<int>(args.Get("rows", 5000));
+    auto cols = static_cast<int>(args.Get("cols", 40));
+    long long cells = static_cast<long long>(rows) * cols;
+    std::map<std::string, long long> params {{"rows", rows}, {"cols", cols}};
+
+    SpreadSheet sheet;
+    Fill(sheet, rows, cols);
+    auto print = [&](std::string const & name, void (SpreadSheet::*method)(std::ostream &) const) {
+        std::ostringstream out;
+        bench::Measure(name, params, cells, [&] { (sheet.*method)(out); });
+    };
+    print("Print/ValuesCold", &SpreadSheet::PrintValues);
+    print("Print/Values", &SpreadSheet::PrintValues);
+    print("Print/Texts", &SpreadSheet::PrintTexts);
+}
@@ -0,0 +1,54 @@
+#include "Bench.h"
+#include "Engine.h"
+
+#include <iostream>
+#include <string>
+
+// Окно rows x cols формул над столбцом чисел, правится случайный аргумент.
+// Сравнивается опрос окна через GetChangesSince после каждой правки с
+// подпиской на окно
+BENCHMARK(Subscriptions) {
+    auto rows = static_cast<int>(args.Get("rows", 5000));
+    auto window = static_cast<int>(args.Get("window", 50));
+    auto edits = args.Get("edits", 5000);
+
+    auto fill = [&](SpreadSheet & sheet) {
+        for (int row = 0; row < rows; row++) {
+            sheet.SetCell({row, 0}, std::to_string(row));
+            sheet.SetCell({row, 1}, "=" + Position{row, 0}.ToString() + "*2");
+        }
+    };
+
+    SpreadSheet polled;
+    fill(polled);
+    size_t polled_changes = 0;
+    // первый запрос вычисляет все формулы
+    auto since = polled.GetChangesSince(0).version;
+    bench::Timer poll_timer;
+    for (long long i = 0; i < edits; i++) {
+        polled.SetCell({static_cast<int>(i * 7919 % rows), 0}, std::to_string(i));
+        auto changes = polled.GetChangesSince(since);
+        since = changes.version;
+        for (auto & change : changes.cells) {
+            if (change.pos.row < window && change.pos.col == 1)
+                polled_changes++;
+        }
+    }
+    double poll_seconds = poll_timer.Seconds();
+
+    SpreadSheet subscribed;
+    fill(subscribed);
+    size_t notified_changes = 0;
+    subscribed.Subscribe({{0, 1}, {window, 1}}, [&](ValueNotification const & notification) {
+        notified_changes += notification.cells.size();
+    });
+    bench::Timer subscribe_timer;
+    for (long long i = 0; i < edits; i++) {
+        subscribed.SetCell({static_cast<int>(i * 7919 % rows), 0}, std::to_string(i));
+    }
+    double subscribe_seconds = subscribe_timer.Seconds();
+
+    std::cout << "  " << rows << " rows, window " << window << ", " << edits << " edits: polling "
+              << poll_seconds * 1e3 << " ms (" << polled_changes << " changes), subscription "
+              << subscribe_seconds * 1e3 << " ms (" << notified_changes << " changes)" << std::endl;
+}
@@ -0,0 +1,134 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <stdexcept>
+
+namespace bench {
+    namespace {
+        constexpr std::array<std::string_view, kTraceOps> kNames {
+            "set", "clear", "insert_rows", "insert_cols", "delete_rows", "delete_cols",
+            "value", "text", "size", "print_values", "print_texts"
+        };
+
+        // Следующее слово до пробела; line сдвигается за него
+        std::string_view NextWord(std::string_view & line) {
+            auto end = line.find(' ');
+            auto word = line.substr(0, end);
+            line.remove_prefix(end == std::string_view::npos ? line.size() : end + 1);
+            return word;
+        }
+
+        int ParseInt(std::string_view word) {
+            int value = 0;
+            auto [ptr, ec] = std::from_chars(word.data(), word.data() + word.size(), value);
+            if (ec != std::errc() || ptr != word.data() + word.size())
+                throw std::runtime_error("bad number in trace: " + std::string(word));
+            return value;
+        }
+
+        Position ParsePosition(std::string_view word) {
+            auto pos = Position::FromString(word);
+            if (!pos.IsValid())
+                throw std::runtime_error("bad position in trace: " + std::string(word));
+            return pos;
+        }
+
+        std::string Unescape(std::string_view text) {
+            std::string result;
+            result.reserve(text.size());
+            for (size_t i = 0; i < text.size(); i++) {
+                if (text[i] != '\\' || i + 1 == text.size()) {
+                    result += text[i];
+                    continue;
+                }
+                switch (text[++i]) {
+                    case 'n': result += '\n'; break;
+                    case 'r': result += '\r'; break;
+                    case 't': result += '\t'; break;
+                    default: result += text[i];
+                }
+            }
+            return result;
+        }
+
+        std::string Escape(std::string_view text) {
+            std::string result;
+            result.reserve(text.size());
+            for (char c : text) {
+                switch (c) {
+                    case '\\': result += "\\\\"; break;
+                    case '\n': result += "\\n"; break;
+                    case '\r': result += "\\r"; break;
+                    case '\t': result += "\\t"; break;
+                    default: result += c;
+                }
+            }
+            return result;
+        }
+    }
+
+    std::string_view TraceOpName(TraceOp op) {
+        return kNames[static_cast<int>(op)];
+    }
+
+    std::optional<TraceRecord> ParseTraceLine(std::string_view line) {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (line.empty() || line.front() == '#')
+            return std::nullopt;
+
+        auto name = NextWord(line);
+        TraceRecord record;
+        auto it = std::find(kNames.begin(), kNames.end(), name);
+        if (it == kNames.end())
+            throw std::runtime_error("unknown trace operation: " + std::string(name));
+        record.op = static_cast<TraceOp>(it - kNames.begin());
+
+        switch (record.op) {
+            case TraceOp::SetCell:
+                record.pos = ParsePosition(NextWord(line));
+                record.text = Unescape(line);
+                break;
+            case TraceOp::ClearCell:
+            case TraceOp::GetValue:
+            case TraceOp::GetText:
+                record.pos = ParsePosition(NextWord(line));
+                break;
+            case TraceOp::InsertRows:
+            case TraceOp::InsertCols:
+            case TraceOp::DeleteRows:
+            case TraceOp::DeleteCols:
+                record.first = ParseInt(NextWord(line));
+                record.count = ParseInt(NextWord(line));
+                break;
+            default:
+                break;
+        }
+        return record;
+    }
+
+    std::string FormatTraceRecord(TraceRecord const & record) {
+        std::string line(TraceOpName(record.op));
+        switch (record.op) {
+            case TraceOp::SetCell:
+                line += ' ' + record.pos.ToString() + ' ' + Escape(record.text);
+                break;
+            case TraceOp::ClearCell:
+            case TraceOp::GetValue:
+            case TraceOp::GetText:
+                line += ' ' + record.pos.ToString();
+                break;
+            case TraceOp::InsertRows:
+            case TraceOp::InsertCols:
+            case TraceOp::DeleteRows:
+            case TraceOp::DeleteCols:
+                line += ' ' + std::to_string(record.first) + ' ' + std::to_string(record.count);
+                break;
+            default:
+                break;
+        }
+        return line;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SPREADSHEET_BENCH_TRACE_H
+#define SPREADSHEET_BENCH_TRACE_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "common.h"
+
+namespace bench {
+    // Трасса операций ISheet: одна операция на строку, пустые строки и строки
+    // с # пропускаются.
+    //   set A1 <текст>          SetCell, текст - весь остаток строки после пробела;
+    //                           \\, \n, \r, \t экранируются обратной косой чертой
+    //   clear A1                ClearCell
+    //   insert_rows <before> <count>, insert_cols ..., delete_rows <first> <count>, delete_cols ...
+    //   value A1, text A1       GetCell(pos)->GetValue() / GetText()
+    //   size                    GetPrintableSize()
+    //   print_values, print_texts
+    enum class TraceOp {
+        SetCell,
+        ClearCell,
+        InsertRows,
+        InsertCols,
+        DeleteRows,
+        DeleteCols,
+        GetValue,
+        GetText,
+        GetSize,
+        PrintValues,
+        PrintTexts
+    };
+    inline constexpr int kTraceOps = static_cast<int>(TraceOp::PrintTexts) + 1;
+
+    struct TraceRecord {
+        TraceOp op = TraceOp::SetCell;
+        Position pos {0, 0};    // SetCell, ClearCell, GetValue, GetText
+        int first = 0;          // Insert*: before, Delete*: first
+        int count = 0;
+        std::string text;       // SetCell
+    };
+
+    std::string_view TraceOpName(TraceOp op);
+    // nullopt для пустых строк и комментариев; std::runtime_error при ошибке
+    std::optional<TraceRecord> ParseTraceLine(std::string_view line);
+    // Строка трассы без перевода строки
+    std::string FormatTraceRecord(TraceRecord const & record);
+}
+
+#endif //SPREADSHEET_BENCH_TRACE_H
@@ -0,0 +1,73 @@
+#include "Bench.h"
+#include "Tracing.h"
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+namespace bench {
+    long long Args::Get(std::string const & key, long long def) const {
+        auto it = values.find(key);
+        return it == values.end() ? def : std::stoll(it->second);
+    }
+
+    std::string Args::Get(std::string const & key, std::string const & def) const {
+        auto it = values.find(key);
+        return it == values.end() ? def : it->second;
+    }
+
+    std::map<std::string, Function> & Registry() {
+        static std::map<std::string, Function> registry;
+        return registry;
+    }
+}
+
+// spreadsheet_bench [name] [key=value ...]
+// Без имени запускает все бенчмарки. json=path записывает результаты
+// измерений в path в формате JSON, json=- печатает их в конце вывода.
+// chrome_trace=path записывает трассу операций таблицы (Tracing.h) для Perfetto;
+// trace_events=N - размер буфера потока, trace_sample=N - доля вычислений формул
+int main(int argc, char ** argv) {
+    std::string name;
+    bench::Args args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (auto eq = arg.find('='); eq != std::string::npos)
+            args.values[arg.substr(0, eq)] = arg.substr(eq + 1);
+        else
+            name = arg;
+    }
+
+    auto chrome_trace = args.Get("chrome_trace", std::string());
+    if (!chrome_trace.empty()) {
+        TraceOptions options;
+        options.events_per_thread = static_cast<size_t>(args.Get("trace_events", static_cast<long long>(options.events_per_thread)));
+        options.evaluation_sample = static_cast<int>(args.Get("trace_sample", static_cast<long long>(options.evaluation_sample)));
+        StartTracing(options);
+    }
+
+    int status = 0;
+    for (auto & [bench_name, func] : bench::Registry()) {
+        if (!name.empty() && name != bench_name)
+            continue;
+        std::cout << bench_name << std::endl;
+        try {
+            func(args);
+        } catch (std::exception & error) {
+            std::cerr << bench_name << " failed: " << error.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (auto json = args.Get("json", std::string()); json == "-") {
+        bench::WriteJson(std::cout);
+    } else if (!json.empty()) {
+        std::ofstream out(json);
+        bench::WriteJson(out);
+    }
+    if (!chrome_trace.empty()) {
+        StopTracing();
+        WriteTrace(chrome_trace);
+    }
+    return status;
+}
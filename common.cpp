@@ -2,44 +2,38 @@
 #include "Engine.h"
 
 #include <algorithm>
+#include <cctype>
 
-#define CheckPosException(expr) {                             \
-    if (!(expr))  {                                           \
-        throw InvalidPositionException("Invalid position");   \
-    }                                                         \
-}
 #define BadPosition (-1)
 
 const int ALPHA_SIZE = 26;
+// Разбор без исключений: строка и столбец накапливаются, пока не превысят
+// пределы, поэтому переполнения нет и при очень длинной записи
 Position Position::FromString(std::string_view str) {
-    int row {0};
-    int col {0};
-
-    try {
-        CheckPosException(std::isalpha(str.front()));
-        while (std::isalpha(str.front())) {
-            CheckPosException(str.front() >= 'A' && str.front() <= 'Z');
-            col += col * (ALPHA_SIZE - 1) + str.front() - 'A';
-            str.remove_prefix(1);
-            if (std::isalpha(str.front()))
-                col++;
-            CheckPosException(std::isalpha(str.front()) || std::isdigit(str.front()));
-        }
-
-        CheckPosException(std::find_if(str.begin(), str.end(), [](auto ch) {
-            return !isdigit(ch);
-        }) == str.end());
-        CheckPosException(std::isdigit(str.front()));
-        CheckPosException(std::stoi(std::string{str}) > 0);
-        row = std::stoi(std::string{str}) - 1;
-
-        CheckPosException(col >= 0 && row >= 0);
-        CheckPosException(col < kMaxCols && row < kMaxRows);
-    } catch (...) {
-        return {BadPosition, BadPosition};
+    const Position bad {BadPosition, BadPosition};
+    size_t i = 0;
+    int col = 0;
+    for (; i < str.size() && std::isalpha(static_cast<unsigned char>(str[i])); i++) {
+        if (str[i] < 'A' || str[i] > 'Z')
+            return bad;
+        col = col * ALPHA_SIZE + (str[i] - 'A' + 1);
+        if (col > kMaxCols)
+            return bad;
     }
-
-    return {row, col};
+    if (i == 0 || i == str.size())
+        return bad;
+
+    int row = 0;
+    for (; i < str.size(); i++) {
+        if (!std::isdigit(static_cast<unsigned char>(str[i])))
+            return bad;
+        row = row * 10 + (str[i] - '0');
+        if (row > kMaxRows)
+            return bad;
+    }
+    if (row == 0)
+        return bad;
+    return {row - 1, col - 1};
 }
 
 std::string Position::ToString() const {
@@ -58,13 +52,7 @@ std::string Position::ToString() const {
 }
 
 bool Position::IsValid() const {
-    try {
-        CheckPosException(col >= 0 && row >= 0);
-        CheckPosException(col < kMaxCols && row < kMaxRows);
-        return true;
-    } catch (...) {
-        return false;
-    }
+    return col >= 0 && row >= 0 && col < kMaxCols && row < kMaxRows;
 }
 
 bool Position::operator==(const Position &rhs) const {
@@ -21,7 +21,7 @@ struct Position {
 
     static Position FromString(std::string_view str);
 
-    static const int kMaxRows = 16384;
+    static const int kMaxRows = 1048576;
     static const int kMaxCols = 16384;
 };
 
@@ -1,7 +1,29 @@
 #include "common.h"
 #include "formula.h"
+#include "Allocations.h"
+#include "Engine.h"
+#include "Export.h"
+#include "FlatMap.h"
+#include "Format.h"
+#include "Import.h"
+#include "Journal.h"
+#include "Literal.h"
+#include "SnapshotFile.h"
+#include "Tracing.h"
 #include "test_runner.h"
 
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#ifdef SPREADSHEET_ALLOC_HOOK
+#include "AllocationHook.h"
+#endif
+
 std::ostream& operator<<(std::ostream& output, Position pos) {
   return output << "(" << pos.row << ", " << pos.col << ")";
 }
@@ -64,7 +86,8 @@ namespace {
     testSingle(Position{0, 702}, "AAA1");
     testSingle(Position{136, 2}, "C137");
     testSingle(Position{Position::kMaxRows - 1, Position::kMaxCols - 1},
-               "XFD16384");
+               "XFD1048576");
+    testSingle(Position{123455, 0}, "A123456");
   }
 
   void TestPositionToStringInvalid() {
@@ -83,8 +106,9 @@ namespace {
     ASSERT(!Position::FromString("A+1").IsValid());
     ASSERT(!Position::FromString("R2D2").IsValid());
     ASSERT(!Position::FromString("C3PO").IsValid());
-    ASSERT(!Position::FromString("XFD16385").IsValid());
-    ASSERT(!Position::FromString("XFE16384").IsValid());
+    ASSERT(!Position::FromString("XFD1048577").IsValid());
+    ASSERT(!Position::FromString("XFE1048576").IsValid());
+    ASSERT(!Position::FromString("A99999999999").IsValid());
     ASSERT(!Position::FromString("A1234567890123456789").IsValid());
     ASSERT(!Position::FromString("ABCDEFGHIJKLMNOPQRS8").IsValid());
     ASSERT(!Position::FromString("X0").IsValid());
@@ -421,10 +445,10 @@ namespace {
 
     try_formula("=X0");
     try_formula("=ABCD1");
-    try_formula("=A123456");
+    try_formula("=A1048577");
     try_formula("=ABCDEFGHIJKLMNOPQRS1234567890");
-    try_formula("=XFD16385");
-    try_formula("=XFE16384");
+    try_formula("=XFD1048577");
+    try_formula("=XFE1048576");
     try_formula("=R2D2");
   }
 
@@ -491,6 +515,67 @@ namespace {
     ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(),
                  ICell::Value(FormulaError::Category::Ref));
     ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetText(), "=A1+B1");
+
+    // уже вычисленная формула выше удаляемой строки
+    sheet = CreateSheet();
+    sheet->SetCell("A5"_pos, "3");
+    sheet->SetCell("C1"_pos, "=A5+1");
+    sheet->SetCell("D1"_pos, "=C1*2");
+    ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), ICell::Value(8.0));
+    sheet->DeleteRows(4);
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(),
+                 ICell::Value(FormulaError::Category::Ref));
+    ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(),
+                 ICell::Value(FormulaError::Category::Ref));
+
+    // удаляемая полоса начинается не с первой строки или столбца
+    sheet = CreateSheet();
+    sheet->SetCell("A3"_pos, "1");
+    sheet->SetCell("A4"_pos, "2");
+    sheet->SetCell("A5"_pos, "3");
+    sheet->SetCell("A7"_pos, "7");
+    sheet->SetCell("B1"_pos, "=A3+A4+A5");
+    sheet->SetCell("B2"_pos, "=A7");
+    sheet->DeleteRows(2, 3);
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(),
+                 ICell::Value(FormulaError::Category::Ref));
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetText(), "=A4");
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetValue(), ICell::Value(7.0));
+    ASSERT((sheet->GetPrintableSize() == Size{4, 2}));
+
+    sheet = CreateSheet();
+    sheet->SetCell("C1"_pos, "1");
+    sheet->SetCell("D1"_pos, "2");
+    sheet->SetCell("F1"_pos, "6");
+    sheet->SetCell("A2"_pos, "=C1+D1");
+    sheet->SetCell("B2"_pos, "=F1");
+    sheet->DeleteCols(2, 2);
+    ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(),
+                 ICell::Value(FormulaError::Category::Ref));
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetText(), "=D1");
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetValue(), ICell::Value(6.0));
+    ASSERT((sheet->GetPrintableSize() == Size{2, 4}));
+
+    // строки и столбцы за таблицей: ячейки, на которые ссылаются формулы,
+    // сдвигаются вместе со ссылками
+    sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "=A10+J1");
+    sheet->DeleteRows(4, 2);
+    sheet->DeleteCols(4, 2);
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "=A8+H1");
+    ASSERT((sheet->GetPrintableSize() == Size{1, 1}));
+    sheet->SetCell("A8"_pos, "2");
+    sheet->SetCell("H1"_pos, "3");
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(), ICell::Value(5.0));
+
+    // ссылки #REF! не попадают в список ячеек формулы и после вставок
+    sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "=B5+C1");
+    sheet->DeleteRows(4);
+    sheet->InsertRows(0);
+    sheet->InsertCols(0);
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetText(), "=#REF!+D2");
+    ASSERT((sheet->GetCell("B2"_pos)->GetReferencedCells() == std::vector<Position>{"D2"_pos}));
   }
 
   void TestCellsDeletionAdjacent() {
@@ -630,12 +715,1283 @@ void TestPascalTriangle(){
 
 void Test001() {
     auto sheet= CreateSheet();
+    dynamic_cast<SpreadSheet &>(*sheet).SetNumberSyntax(NumberSyntax::Integer);
     sheet->SetCell("A1"_pos,"3.14");
     sheet->SetCell("A2"_pos,"=A1+42");
     auto res= sheet->GetCell("A2"_pos)->GetValue();
     ASSERT(std::holds_alternative<FormulaError>(res));
 }
 
+void TestDecimalLiterals() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "3.14");
+    sheet->SetCell("A2"_pos, "=A1+42");
+    auto res = sheet->GetCell("A2"_pos)->GetValue();
+    ASSERT(std::holds_alternative<double>(res));
+    ASSERT(std::abs(std::get<double>(res) - 45.14) < 1e-9);
+
+    sheet->SetCell("B1"_pos, "1e3");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), ICell::Value(1000.0));
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "1e3");
+    sheet->SetCell("B2"_pos, "-.5");
+    ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetValue(), ICell::Value(-0.5));
+    sheet->SetCell("B3"_pos, "+7");
+    ASSERT_EQUAL(sheet->GetCell("B3"_pos)->GetValue(), ICell::Value(7.0));
+
+    for (std::string text : {"1e", "inf", "nan", "1.2.3", "3D", " 1", "-", "+-1"}) {
+        sheet->SetCell("C1"_pos, text);
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), ICell::Value(text));
+    }
+
+    std::vector<std::string_view> column{"", "12", "1.5", "abc", "=A1"};
+    std::vector<Literal> literals;
+    ClassifyLiterals(column, literals, NumberSyntax::Integer);
+    ASSERT(literals[0].kind == Literal::Kind::Empty);
+    ASSERT(literals[1].kind == Literal::Kind::Number && literals[1].number == 12);
+    ASSERT(literals[2].kind == Literal::Kind::Text);
+    ASSERT(literals[3].kind == Literal::Kind::Text);
+    ASSERT(literals[4].kind == Literal::Kind::Formula);
+}
+
+void TestNumberFormat() {
+    ASSERT_EQUAL(FormatNumber(0.1), "0.1");
+    ASSERT_EQUAL(FormatNumber(1e+200), "1e+200");
+
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "=1/3");
+    sheet->SetCell("B1"_pos, "=0.1+0.2");
+    std::ostringstream shortest;
+    sheet->PrintValues(shortest);
+    ASSERT_EQUAL(shortest.str(), "0.3333333333333333\t0.30000000000000004\n");
+
+    sheet->SetCell("C1"_pos, "=123456789 + 1");
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetText(), "=123456789+1");
+
+    auto other = CreateSheet();
+    other->SetCell("A1"_pos, "=1/3");
+    dynamic_cast<SpreadSheet &>(*sheet).SetNumberFormat(NumberFormat::Stream);
+    std::ostringstream stream, expected;
+    sheet->PrintValues(stream);
+    expected << 1.0 / 3 << '\t' << 0.1 + 0.2 << '\t' << 123456790.0 << '\n';
+    ASSERT_EQUAL(stream.str(), expected.str());
+    // кешированное выражение перестраивается в новом формате
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetText(), "=1.23457e+08+1");
+    auto snapshot = dynamic_cast<SpreadSheet &>(*sheet).Snapshot();
+    ASSERT_EQUAL(snapshot->GetCell("C1"_pos)->GetText(), "=1.23457e+08+1");
+    ASSERT_EQUAL(ParseFormula("123456789 + 1")->GetExpression(), "123456789+1");
+
+    // формат задаётся для каждой таблицы отдельно
+    std::ostringstream other_values;
+    other->PrintValues(other_values);
+    ASSERT_EQUAL(other_values.str(), "0.3333333333333333\n");
+
+    dynamic_cast<SpreadSheet &>(*sheet).SetNumberFormat(NumberFormat::Shortest);
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetText(), "=123456789+1");
+}
+
+void TestExpressionCache() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "=B1 + (C1)");
+    auto cell = sheet->GetCell("A1"_pos);
+    ASSERT_EQUAL(cell->GetText(), "=B1+C1");
+
+    // Тот же текст с другими пробелами не пересоздаёт ячейку
+    sheet->SetCell("A1"_pos, "= B1+C1 ");
+    ASSERT(sheet->GetCell("A1"_pos) == cell);
+    ASSERT(dynamic_cast<DefaultCell *>(cell)->HasSameText("=B1 + C1"));
+    ASSERT(!dynamic_cast<DefaultCell *>(cell)->HasSameText("=B1+C2"));
+
+    sheet->InsertRows(0);
+    ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetText(), "=B2+C2");
+    ASSERT(dynamic_cast<DefaultCell *>(sheet->GetCell("A2"_pos))->HasSameText("=B2+C2"));
+
+    // Пробелы в обычном тексте значимы
+    sheet->SetCell("D1"_pos, "ab");
+    sheet->SetCell("D1"_pos, "a b");
+    ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetText(), "a b");
+    sheet->SetCell("D1"_pos, "a bc");
+    ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetText(), "a bc");
+}
+
+void TestImport() {
+    auto source = CreateSheet();
+    source->SetCell("A1"_pos, "1");
+    source->SetCell("B1"_pos, "=A1*2");
+    source->SetCell("C2"_pos, "'=text");
+    source->SetCell("A3"_pos, "=B1+C4");
+    source->SetCell("C4"_pos, "2.5");
+    std::ostringstream texts;
+    source->PrintTexts(texts);
+
+    auto sheet = CreateSheet();
+    auto & spread_sheet = dynamic_cast<SpreadSheet &>(*sheet);
+    ImportTexts(spread_sheet, texts.str(), ImportOptions{'\t', 3});
+
+    std::ostringstream imported_texts, values, imported_values;
+    sheet->PrintTexts(imported_texts);
+    ASSERT_EQUAL(imported_texts.str(), texts.str());
+    source->PrintValues(values);
+    sheet->PrintValues(imported_values);
+    ASSERT_EQUAL(imported_values.str(), values.str());
+
+    // Циклы и синтаксические ошибки не меняют таблицу
+    sheet->SetCell("A1"_pos, "kept");
+    try {
+        ImportTexts(spread_sheet, "=B1\t=A1\n");
+        ASSERT(false);
+    } catch (const CircularDependencyException &) {
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "kept");
+        ASSERT(sheet->GetCell("B1"_pos)->GetText() == "=A1*2");
+    }
+    try {
+        ImportTexts(spread_sheet, "1\t=1+\n");
+        ASSERT(false);
+    } catch (const FormulaException &) {
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "kept");
+    }
+}
+
+void TestSnapshot() {
+    auto source = CreateSheet();
+    source->SetCell("A1"_pos, "007");
+    source->SetCell("B1"_pos, "=A1*2");
+    source->SetCell("C2"_pos, "'=text");
+    source->SetCell("A3"_pos, "=B1+C4/2");
+    source->SetCell("C4"_pos, "2.5");
+    source->SetCell("A6"_pos, "1");
+    source->SetCell("D5"_pos, "=A6+1");
+    source->DeleteRows(5);
+    std::ostringstream texts, values;
+    source->PrintTexts(texts);
+    source->PrintValues(values);
+
+    auto path = (std::filesystem::temp_directory_path() / "spreadsheet_snapshot_test.bin").string();
+    dynamic_cast<SpreadSheet &>(*source).Save(path);
+
+    auto sheet = CreateSheet();
+    sheet->SetCell("Z9"_pos, "replaced");
+    auto & spread_sheet = dynamic_cast<SpreadSheet &>(*sheet);
+    spread_sheet.Load(path);
+
+    std::ostringstream loaded_texts, loaded_values;
+    sheet->PrintTexts(loaded_texts);
+    sheet->PrintValues(loaded_values);
+    ASSERT_EQUAL(loaded_texts.str(), texts.str());
+    ASSERT_EQUAL(loaded_values.str(), values.str());
+    ASSERT(sheet->GetPrintableSize() == source->GetPrintableSize());
+    ASSERT_EQUAL(sheet->GetCell("D5"_pos)->GetText(), "=#REF!+1");
+
+    // Загруженные связи работают как обычные
+    sheet->SetCell("C4"_pos, "5");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("A3"_pos)->GetValue()), 16.5);
+    try {
+        sheet->SetCell("C4"_pos, "=A3");
+        ASSERT(false);
+    } catch (const CircularDependencyException &) {
+    }
+
+    // Повреждённый файл не меняет таблицу
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-1, std::ios::end);
+        file.put('#');
+    }
+    try {
+        spread_sheet.Load(path);
+        ASSERT(false);
+    } catch (const std::runtime_error &) {
+        ASSERT_EQUAL(sheet->GetCell("C4"_pos)->GetText(), "5");
+    }
+
+    // Недопустимый вид значения или категория ошибки формулы отвергаются
+    // до очистки таблицы, даже при верной контрольной сумме
+    auto corrupt_formula = [&](uint8_t value_kind, uint8_t error) {
+        dynamic_cast<SpreadSheet &>(*source).Save(path);
+        std::string bytes;
+        {
+            std::ifstream file(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        SnapshotHeader header{};
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        for (uint64_t i = 0; i < header.cell_count; i++) {
+            auto record = reinterpret_cast<SnapshotCell *>(bytes.data() + sizeof(header)) + i;
+            if (record->kind == static_cast<uint8_t>(Literal::Kind::Formula)) {
+                record->value_kind = value_kind;
+                record->error = error;
+            }
+        }
+        header.checksum = SnapshotChecksum(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+    for (auto [value_kind, error] : {std::pair<uint8_t, uint8_t>{3, 0}, {static_cast<uint8_t>(SnapshotValue::Error), 3}}) {
+        corrupt_formula(value_kind, error);
+        try {
+            spread_sheet.Load(path);
+            ASSERT(false);
+        } catch (const std::runtime_error &) {
+            ASSERT_EQUAL(sheet->GetCell("C4"_pos)->GetText(), "5");
+        }
+    }
+    corrupt_formula(static_cast<uint8_t>(SnapshotValue::Error), static_cast<uint8_t>(FormulaError::Category::Div0));
+    spread_sheet.Load(path);
+    ASSERT(std::get<FormulaError>(sheet->GetCell("B1"_pos)->GetValue()) == FormulaError(FormulaError::Category::Div0));
+
+    // Файл с верной контрольной суммой, но не из таблицы: цикл формул,
+    // ссылки не по программе, повторная позиция или позиция вне таблицы
+    auto chain = CreateSheet();
+    chain->SetCell("A1"_pos, "=B1");
+    chain->SetCell("B1"_pos, "=C1");
+    auto loaded = sheet->GetCell("B1"_pos)->GetText();
+    using Change = void (*)(SnapshotCell &, SnapshotRef &, int32_t (&)[2]);
+    auto rewrite = [&](Change change) {
+        dynamic_cast<SpreadSheet &>(*chain).Save(path);
+        std::string bytes;
+        {
+            std::ifstream file(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        SnapshotHeader header{};
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        auto records = reinterpret_cast<SnapshotCell *>(bytes.data() + sizeof(header));
+        auto refs = reinterpret_cast<SnapshotRef *>(records + header.cell_count);
+        auto code = reinterpret_cast<char *>(refs + header.ref_count);
+        // records[1] - B1, её программа - единственная ссылка на C1
+        auto program = code + records[1].data_offset + 1;
+        int32_t target[2];
+        std::memcpy(target, program, sizeof(target));
+        change(records[1], refs[records[1].refs_offset], target);
+        std::memcpy(program, target, sizeof(target));
+        header.checksum = SnapshotChecksum(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        try {
+            spread_sheet.Load(path);
+            ASSERT(false);
+        } catch (const std::runtime_error &) {
+            ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), loaded);
+        }
+    };
+    // B1 = A1 при A1 = B1
+    rewrite([](SnapshotCell &, SnapshotRef & ref, int32_t (& target)[2]) {
+        ref = {0, 0};
+        target[1] = 0;
+    });
+    // программа ссылается на A1, а список ссылок - на C1
+    rewrite([](SnapshotCell &, SnapshotRef &, int32_t (& target)[2]) { target[1] = 0; });
+    rewrite([](SnapshotCell & record, SnapshotRef &, int32_t (&)[2]) { record.col = 0; });
+    rewrite([](SnapshotCell &, SnapshotRef & ref, int32_t (& target)[2]) {
+        ref.row = Position::kMaxRows;
+        target[0] = Position::kMaxRows;
+    });
+    std::filesystem::remove(path);
+}
+
+void TestExport() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "1");
+    sheet->SetCell("B2"_pos, "=A1+1");
+    sheet->SetCell("C2"_pos, "'=text");
+    sheet->SetCell("D3"_pos, "=1/0");
+    sheet->SetCell("B4"_pos, "x");
+    auto & spread_sheet = dynamic_cast<SpreadSheet &>(*sheet);
+
+    // Маленький буфер сбрасывается в поток по частям
+    Exporter exporter(ExportOptions{4});
+    std::ostringstream values, texts;
+    exporter.WriteValues(spread_sheet, values);
+    exporter.WriteTexts(spread_sheet, texts);
+    ASSERT_EQUAL(values.str(), "1\t\t\t\n\t2\t=text\t\n\t\t\t#DIV/0!\n\tx\t\t\n");
+    ASSERT_EQUAL(texts.str(), "1\t\t\t\n\t=A1+1\t'=text\t\n\t\t\t=1/0\n\tx\t\t\n");
+
+    std::ostringstream window;
+    exporter.WriteValues(spread_sheet, window, ExportRange{"B2"_pos, {2, 10}});
+    ASSERT_EQUAL(window.str(), "2\t=text\t\n\t\t#DIV/0!\n");
+
+    std::ostringstream outside;
+    exporter.WriteTexts(spread_sheet, outside, ExportRange{"E1"_pos, {2, 2}});
+    ASSERT_EQUAL(outside.str(), "\n\n");
+
+    // Параллельный вывод полосами по одной строке совпадает с последовательным
+    for (int i = 0; i < 40; i++) {
+        sheet->SetCell({i, i % 5}, i % 2 ? "=" + Position{i / 2, 0}.ToString() + "/3" : std::to_string(i) + ".5");
+    }
+    Exporter parallel(ExportOptions{1, 4});
+    std::ostringstream serial_values, parallel_values, serial_texts, parallel_texts;
+    parallel.WriteValues(spread_sheet, parallel_values);
+    parallel.WriteTexts(spread_sheet, parallel_texts);
+    sheet->PrintValues(serial_values);
+    sheet->PrintTexts(serial_texts);
+    ASSERT_EQUAL(parallel_values.str(), serial_values.str());
+    ASSERT_EQUAL(parallel_texts.str(), serial_texts.str());
+}
+
+void TestJournal() {
+    auto directory = std::filesystem::temp_directory_path();
+    auto journal_path = (directory / "spreadsheet_journal_test.log").string();
+    auto snapshot_path = (directory / "spreadsheet_journal_test.bin").string();
+    std::filesystem::remove(journal_path);
+
+    std::string texts, values;
+    {
+        SpreadSheet sheet;
+        Journal journal(journal_path, JournalOptions{2, 1 << 20, false});
+        sheet.SetJournal(&journal);
+        sheet.SetCell("A1"_pos, "1");
+        sheet.SetCell("B1"_pos, "=A1+1");
+        sheet.SetCell("C1"_pos, "tmp");
+        sheet.Checkpoint(snapshot_path);
+
+        sheet.ClearCell("C1"_pos);
+        sheet.InsertRows(0);
+        sheet.SetCell("A1"_pos, "=A2*10");
+        try {
+            sheet.SetCell("A2"_pos, "=B2");
+            ASSERT(false);
+        } catch (const CircularDependencyException &) {
+        }
+        sheet.SetCell("C3"_pos, "'=x");
+        sheet.SetCell("C3"_pos, "2.5");
+        sheet.SetCell("D2"_pos, "=C3");
+        journal.Commit();
+        ASSERT_EQUAL(sheet.GetJournalSequence(), 9u);
+
+        std::ostringstream texts_stream, values_stream;
+        sheet.PrintTexts(texts_stream);
+        sheet.PrintValues(values_stream);
+        texts = texts_stream.str();
+        values = values_stream.str();
+    }
+
+    // Оборванная запись в конце журнала отбрасывается
+    {
+        std::ofstream tail(journal_path, std::ios::binary | std::ios::app);
+        tail << "torn";
+    }
+    uint64_t base_sequence = 0;
+    auto records = Journal::Read(journal_path, &base_sequence);
+    ASSERT_EQUAL(base_sequence, 3u);
+    ASSERT_EQUAL(records.size(), 6u);
+    ASSERT(records.front().op == JournalOp::ClearCell);
+
+    SpreadSheet recovered;
+    recovered.Load(snapshot_path);
+    ASSERT_EQUAL(recovered.GetJournalSequence(), 3u);
+    recovered.Replay(journal_path);
+    ASSERT_EQUAL(recovered.GetJournalSequence(), 9u);
+    std::ostringstream recovered_texts, recovered_values;
+    recovered.PrintTexts(recovered_texts);
+    recovered.PrintValues(recovered_values);
+    ASSERT_EQUAL(recovered_texts.str(), texts);
+    ASSERT_EQUAL(recovered_values.str(), values);
+
+    // Журнал продолжается после целых записей
+    {
+        Journal journal(journal_path, JournalOptions{1, 1 << 20, false});
+        ASSERT_EQUAL(journal.GetLastSequence(), 9u);
+        recovered.SetJournal(&journal);
+        recovered.SetCell("E1"_pos, "5");
+        recovered.SetJournal(nullptr);
+    }
+    records = Journal::Read(journal_path);
+    ASSERT_EQUAL(records.size(), 7u);
+    ASSERT_EQUAL(records.back().text, "5");
+
+    // Новый журнал продолжает нумерацию загруженного снимка, иначе Replay
+    // пропустил бы его записи
+    auto second_path = (directory / "spreadsheet_journal_test_2.log").string();
+    std::filesystem::remove(second_path);
+    recovered.Save(snapshot_path);
+    {
+        SpreadSheet restored;
+        restored.Load(snapshot_path);
+        Journal journal(second_path, JournalOptions{1, 1 << 20, false});
+        restored.SetJournal(&journal);
+        ASSERT_EQUAL(journal.GetLastSequence(), 10u);
+        restored.SetCell("F1"_pos, "6");
+        ASSERT_EQUAL(restored.GetJournalSequence(), 11u);
+        restored.SetJournal(nullptr);
+    }
+    SpreadSheet replayed;
+    replayed.Load(snapshot_path);
+    replayed.Replay(second_path);
+    ASSERT_EQUAL(replayed.GetCell("F1"_pos)->GetText(), "6");
+
+    // Формулы журналируются без потерь при любом формате чисел таблицы
+    std::filesystem::remove(second_path);
+    {
+        SpreadSheet streamed;
+        streamed.SetNumberFormat(NumberFormat::Stream);
+        Journal journal(second_path, JournalOptions{1, 1 << 20, false});
+        streamed.SetJournal(&journal);
+        streamed.SetCell("A1"_pos, "=123456789+1");
+        ASSERT_EQUAL(streamed.GetCell("A1"_pos)->GetText(), "=1.23457e+08+1");
+        streamed.SetJournal(nullptr);
+    }
+    SpreadSheet exact;
+    exact.Replay(second_path);
+    ASSERT_EQUAL(exact.GetCell("A1"_pos)->GetText(), "=123456789+1");
+    ASSERT_EQUAL(exact.GetCell("A1"_pos)->GetValue(), ICell::Value(123456790.0));
+
+    // Журнал с операциями, которых нет в таблице, не подключается
+    {
+        SpreadSheet fresh;
+        Journal journal(journal_path, JournalOptions{1, 1 << 20, false});
+        try {
+            fresh.SetJournal(&journal);
+            ASSERT(false);
+        } catch (const std::logic_error &) {
+        }
+    }
+
+    std::filesystem::remove(second_path);
+    std::filesystem::remove(journal_path);
+    std::filesystem::remove(snapshot_path);
+}
+
+void TestChangeSet() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1*2");
+    sheet.SetCell("C1"_pos, "=A1*0");
+    sheet.SetCell("Z100"_pos, "far");
+
+    auto changes = sheet.GetChangesSince(0);
+    ASSERT(!changes.full);
+    ASSERT_EQUAL(changes.cells.size(), 4u);
+    ASSERT_EQUAL(changes.version, sheet.GetVersion());
+    ASSERT(sheet.GetChangesSince(changes.version).cells.empty());
+
+    // Пересчитанные значения попадают в изменения, неизменившиеся - нет
+    auto since = changes.version;
+    sheet.SetCell("A1"_pos, "5");
+    sheet.SetCell("A1"_pos, "5");
+    changes = sheet.GetChangesSince(since);
+    ASSERT_EQUAL(changes.cells.size(), 2u);
+    ASSERT(changes.cells[0].pos == "A1"_pos);
+    ASSERT_EQUAL(std::get<double>(changes.cells[0].value), 5.0);
+    ASSERT(changes.cells[1].pos == "B1"_pos);
+    ASSERT_EQUAL(std::get<double>(changes.cells[1].value), 10.0);
+
+    since = changes.version;
+    sheet.ClearCell("Z100"_pos);
+    changes = sheet.GetChangesSince(since);
+    ASSERT_EQUAL(changes.cells.size(), 1u);
+    ASSERT(changes.cells[0].pos == "Z100"_pos);
+    ASSERT_EQUAL(std::get<std::string>(changes.cells[0].value), "");
+
+    // Значение, вычисленное вне запроса, тоже учитывается
+    since = changes.version;
+    sheet.SetCell("A1"_pos, "7");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("B1"_pos)->GetValue()), 14.0);
+    changes = sheet.GetChangesSince(since);
+    ASSERT_EQUAL(changes.cells.size(), 2u);
+
+    // Структурные изменения отдают таблицу целиком
+    since = changes.version;
+    sheet.InsertRows(0);
+    changes = sheet.GetChangesSince(since);
+    ASSERT(changes.full);
+    ASSERT_EQUAL(changes.cells.size(), 3u);
+    ASSERT(changes.size == sheet.GetPrintableSize());
+    ASSERT(changes.cells[1].pos == "B2"_pos);
+    ASSERT(sheet.GetChangesSince(changes.version).cells.empty());
+
+    // Старые очистки забываются: запрос до них получает таблицу целиком
+    const int cleared = static_cast<int>(kMaxRemovedCells) + 1;
+    for (int row = 200; row < 200 + cleared; row++)
+        sheet.SetCell({row, 0}, "x");
+    since = sheet.GetVersion();
+    for (int row = 200; row < 200 + cleared; row++)
+        sheet.ClearCell({row, 0});
+    changes = sheet.GetChangesSince(since);
+    ASSERT(changes.full);
+    ASSERT_EQUAL(changes.cells.size(), 3u);
+    changes = sheet.GetChangesSince(sheet.GetVersion() - 1);
+    ASSERT(!changes.full);
+    ASSERT_EQUAL(changes.cells.size(), 1u);
+    ASSERT((changes.cells[0].pos == Position{200 + cleared - 1, 0}));
+}
+
+void TestConcurrentReads() {
+    SpreadSheet sheet;
+    const int rows = 200;
+    sheet.SetCell({0, 0}, "1");
+    for (int row = 1; row < rows; row++) {
+        sheet.SetCell({row, 0}, "=A" + std::to_string(row) + "+1");
+        sheet.SetCell({row, 1}, "=A" + std::to_string(row + 1) + "*2");
+    }
+
+    // Потоки вычисляют одни и те же цепочки формул с разных концов
+    auto read_all = [&](double first) {
+        std::vector<std::thread> readers;
+        std::atomic<int> mismatches {0};
+        for (int t = 0; t < 8; t++) {
+            readers.emplace_back([&, t] {
+                for (int i = 0; i < rows; i++) {
+                    int row = t % 2 ? i : rows - 1 - i;
+                    auto value = sheet.GetCell({row, 0})->GetValue();
+                    if (std::get<double>(value) != first + row)
+                        mismatches++;
+                    if (row > 0 && std::get<double>(sheet.GetCell({row, 1})->GetValue()) != 2 * (first + row))
+                        mismatches++;
+                    if (row > 0 && sheet.GetCell({row, 1})->GetText() != "=A" + std::to_string(row + 1) + "*2")
+                        mismatches++;
+                }
+            });
+        }
+        for (auto & reader : readers)
+            reader.join();
+        return mismatches.load();
+    };
+
+    ASSERT_EQUAL(read_all(1), 0);
+    sheet.SetCell({0, 0}, "10");
+    ASSERT_EQUAL(read_all(10), 0);
+    ASSERT_EQUAL(sheet.GetChangesSince(0).cells.size(), 2u * rows - 1);
+}
+
+void TestSheetSnapshot() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1*2");
+    sheet.SetCell("C2"_pos, "'=text");
+    std::ostringstream values, texts;
+    sheet.PrintValues(values);
+    sheet.PrintTexts(texts);
+
+    auto snapshot = sheet.Snapshot();
+    sheet.SetCell("A1"_pos, "5");
+    sheet.ClearCell("C2"_pos);
+    sheet.SetCell("D4"_pos, "new");
+    sheet.InsertRows(0);
+    sheet.SetCell("B2"_pos, "=A2+1");
+
+    // Снимок не видит изменений, сделанных после него
+    ASSERT_EQUAL(std::get<double>(snapshot->GetCell("B1"_pos)->GetValue()), 2.0);
+    ASSERT_EQUAL(snapshot->GetCell("B1"_pos)->GetText(), "=A1*2");
+    ASSERT_EQUAL(std::get<std::string>(snapshot->GetCell("C2"_pos)->GetValue()), "=text");
+    ASSERT(snapshot->GetCell("D4"_pos) == nullptr);
+    ASSERT(snapshot->GetPrintableSize() == (Size{2, 3}));
+    std::ostringstream snapshot_values, snapshot_texts;
+    snapshot->PrintValues(snapshot_values);
+    snapshot->PrintTexts(snapshot_texts);
+    ASSERT_EQUAL(snapshot_values.str(), values.str());
+    ASSERT_EQUAL(snapshot_texts.str(), texts.str());
+
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("B2"_pos)->GetValue()), 6.0);
+    ASSERT_EQUAL(sheet.Snapshot()->GetCell("B2"_pos)->GetText(), "=A2+1");
+    ASSERT_EQUAL(std::get<double>(sheet.Snapshot()->GetCell("B2"_pos)->GetValue()), 6.0);
+
+    bool caught = false;
+    try {
+        std::const_pointer_cast<SheetSnapshot>(snapshot)->SetCell("A1"_pos, "1");
+    } catch (std::logic_error &) {
+        caught = true;
+    }
+    ASSERT(caught);
+
+    // Читатель снимка работает параллельно с изменениями таблицы
+    const int rows = 100;
+    for (int row = 0; row < rows; row++)
+        sheet.SetCell({row, 5}, row ? "=F" + std::to_string(row) + "+1" : "0");
+    snapshot = sheet.Snapshot();
+    int mismatches = 0;
+    std::thread reader([&] {
+        for (int row = rows - 1; row >= 0; row--) {
+            if (std::get<double>(snapshot->GetCell({row, 5})->GetValue()) != row)
+                mismatches++;
+        }
+    });
+    for (int row = 0; row < rows; row++)
+        sheet.SetCell({row, 5}, std::to_string(-row));
+    reader.join();
+    ASSERT_EQUAL(mismatches, 0);
+
+    // Очищенная ячейка живёт, пока на неё ссылаются, и пропадает из
+    // следующих снимков вместе с последней ссылкой
+    sheet.SetCell("I1"_pos, "x");
+    sheet.SetCell("H1"_pos, "5");
+    sheet.SetCell("G1"_pos, "=H1");
+    sheet.ClearCell("H1"_pos);
+    ASSERT(sheet.Snapshot()->GetCell("H1"_pos) != nullptr);
+    sheet.SetCell("G1"_pos, "1");
+    ASSERT(sheet.GetCell("H1"_pos) == nullptr);
+    ASSERT(sheet.Snapshot()->GetCell("H1"_pos) == nullptr);
+}
+
+void TestBatch() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("C1"_pos, "old");
+    sheet.SetCell("D1"_pos, "keep");
+
+    sheet.BeginBatch();
+    sheet.SetCell("A1"_pos, "2");
+    sheet.SetCell("B1"_pos, "=A1+1");
+    sheet.ClearCell("C1"_pos);
+    // до Commit чтения видят таблицу без пакета
+    ASSERT(sheet.GetCell("B1"_pos) == nullptr);
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetText(), "old");
+    bool caught = false;
+    try {
+        sheet.SetCell("E1"_pos, "=A1+");
+    } catch (FormulaException &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    caught = false;
+    try {
+        sheet.InsertRows(0);
+    } catch (std::logic_error &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    sheet.Commit();
+    ASSERT(!sheet.InBatch());
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("B1"_pos)->GetValue()), 3.0);
+    ASSERT(sheet.GetCell("C1"_pos) == nullptr);
+
+    // Цикл отменяет весь пакет, включая очистки
+    sheet.BeginBatch();
+    sheet.ClearCell("D1"_pos);
+    sheet.SetCell("E1"_pos, "5");
+    sheet.SetCell("A1"_pos, "=B1");
+    caught = false;
+    try {
+        sheet.Commit();
+    } catch (CircularDependencyException &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetText(), "2");
+    ASSERT_EQUAL(sheet.GetCell("D1"_pos)->GetText(), "keep");
+    ASSERT(sheet.GetCell("E1"_pos) == nullptr);
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("B1"_pos)->GetValue()), 3.0);
+
+    // Цикл со старым содержимым очищаемой ячейки не мешает
+    sheet.BeginBatch();
+    sheet.ClearCell("B1"_pos);
+    sheet.SetCell("A1"_pos, "=B1");
+    sheet.Commit();
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("A1"_pos)->GetValue()), 0.0);
+
+    sheet.BeginBatch();
+    sheet.SetCell("A1"_pos, "9");
+    sheet.Rollback();
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetText(), "=B1");
+
+    // Откат возвращает прежние ячейки, а не их текст в формате таблицы
+    SpreadSheet streamed;
+    streamed.SetNumberFormat(NumberFormat::Stream);
+    streamed.SetCell("A1"_pos, "=123456789+1");
+    streamed.SetCell("A2"_pos, "=123456789+2");
+    streamed.BeginBatch();
+    streamed.ClearCell("A1"_pos);
+    streamed.SetCell("A2"_pos, "3");
+    streamed.SetCell("B1"_pos, "=B2");
+    streamed.SetCell("B2"_pos, "=B1");
+    caught = false;
+    try {
+        streamed.Commit();
+    } catch (CircularDependencyException &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    for (auto [pos, value] : {std::pair{"A1"_pos, 123456790.0}, {"A2"_pos, 123456791.0}}) {
+        auto cell = dynamic_cast<DefaultCell const *>(streamed.GetCell(pos));
+        ASSERT_EQUAL(cell->GetValue(), ICell::Value(value));
+        ASSERT_EQUAL(cell->GetExactText(), "=123456789+" + std::to_string(static_cast<int>(value) - 123456789));
+    }
+}
+
+void TestAsyncRecalc() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    for (int row = 1; row < 50; row++) {
+        sheet.SetCell({row, 0}, "=" + Position{row - 1, 0}.ToString() + "+1");
+    }
+    sheet.SetCell("B1"_pos, "=A50*2");
+    sheet.SetRecalcMode(RecalcMode::Async);
+    ASSERT(sheet.GetRecalcMode() == RecalcMode::Async);
+    ASSERT_EQUAL(std::get<double>(sheet.GetConsistentView()->GetCell("B1"_pos)->GetValue()), 100.0);
+
+    sheet.SetCell("A1"_pos, "11");
+    auto future = sheet.GetValueAsync("A50"_pos);
+    sheet.SetCell("C1"_pos, "=B1+1");
+    ASSERT_EQUAL(std::get<double>(future.get()), 60.0);
+    sheet.WaitForRecalc();
+    auto view = sheet.GetConsistentView();
+    ASSERT_EQUAL(std::get<double>(view->GetCell("B1"_pos)->GetValue()), 120.0);
+    ASSERT_EQUAL(std::get<double>(view->GetCell("C1"_pos)->GetValue()), 121.0);
+    // живая таблица видит те же значения
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("C1"_pos)->GetValue()), 121.0);
+
+    // Пакет уходит на пересчёт одним заданием, очистка тоже пересчитывается
+    sheet.BeginBatch();
+    sheet.SetCell("A1"_pos, "0");
+    sheet.ClearCell("C1"_pos);
+    sheet.Commit();
+    sheet.WaitForRecalc();
+    view = sheet.GetConsistentView();
+    ASSERT_EQUAL(std::get<double>(view->GetCell("B1"_pos)->GetValue()), 98.0);
+    ASSERT(view->GetCell("C1"_pos) == nullptr);
+
+    // После вставки строк позиции меняются и пересчитывается всё
+    sheet.InsertRows(0);
+    sheet.SetCell("A2"_pos, "4");
+    ASSERT_EQUAL(std::get<double>(sheet.GetValueAsync("B2"_pos).get()), 106.0);
+    sheet.WaitForRecalc();
+    ASSERT_EQUAL(sheet.GetConsistentView()->GetCell("B2"_pos)->GetText(), "=A51*2");
+
+    // Прежний вид не меняется
+    ASSERT_EQUAL(std::get<double>(view->GetCell("B1"_pos)->GetValue()), 98.0);
+
+    sheet.SetRecalcMode(RecalcMode::Lazy);
+    sheet.SetCell("A2"_pos, "5");
+    ASSERT_EQUAL(std::get<double>(sheet.GetValueAsync("B2"_pos).get()), 108.0);
+}
+
+void TestSubscriptions() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("A2"_pos, "=A1*2");
+    sheet.SetCell("A3"_pos, "=A1-A1");
+    std::vector<ValueNotification> received;
+    auto id = sheet.Subscribe({"A2"_pos, {2, 1}}, [&](ValueNotification const & notification) {
+        received.push_back(notification);
+    });
+
+    // одно уведомление на операцию, только действительно изменившиеся значения
+    sheet.SetCell("A1"_pos, "5");
+    ASSERT_EQUAL(received.size(), 1u);
+    ASSERT_EQUAL(received[0].cells.size(), 1u);
+    ASSERT(received[0].cells[0].pos == "A2"_pos);
+    ASSERT_EQUAL(std::get<double>(received[0].cells[0].value), 10.0);
+    sheet.SetCell("B1"_pos, "=A2");
+    sheet.SetCell("A1"_pos, "5");
+    ASSERT_EQUAL(received.size(), 1u);
+
+    sheet.BeginBatch();
+    sheet.SetCell("A1"_pos, "6");
+    sheet.SetCell("A3"_pos, "text");
+    sheet.Commit();
+    ASSERT_EQUAL(received.size(), 2u);
+    ASSERT_EQUAL(received[1].cells.size(), 2u);
+    ASSERT_EQUAL(std::get<std::string>(received[1].cells[1].value), "text");
+    sheet.ClearCell("A3"_pos);
+    ASSERT_EQUAL(received.size(), 3u);
+    ASSERT_EQUAL(std::get<std::string>(received[2].cells[0].value), "");
+    ASSERT(sheet.Unsubscribe(id));
+    sheet.SetCell("A1"_pos, "7");
+    ASSERT_EQUAL(received.size(), 3u);
+
+    // Очередь: переполнение сливает уведомления в следующее
+    auto queue = std::make_shared<NotificationQueue>(2);
+    sheet.Subscribe({"A2"_pos}, queue);
+    sheet.SetCell("A1"_pos, "8");
+    sheet.SetCell("A1"_pos, "9");
+    sheet.SetCell("A1"_pos, "10");
+    ValueNotification notification;
+    ASSERT(queue->TryPop(notification));
+    ASSERT_EQUAL(std::get<double>(notification.cells[0].value), 16.0);
+    ASSERT(queue->TryPop(notification));
+    ASSERT_EQUAL(std::get<double>(notification.cells[0].value), 18.0);
+    ASSERT(!queue->TryPop(notification));
+    sheet.SetCell("A1"_pos, "5");
+    ASSERT(queue->TryPop(notification));
+    ASSERT_EQUAL(std::get<double>(notification.cells[0].value), 10.0);
+
+    // В Async уведомления рассылает поток пересчёта
+    sheet.SetRecalcMode(RecalcMode::Async);
+    sheet.WaitForRecalc();
+    ASSERT(!queue->TryPop(notification));
+    sheet.SetCell("A1"_pos, "11");
+    sheet.WaitForRecalc();
+    ASSERT(queue->TryPop(notification));
+    ASSERT_EQUAL(std::get<double>(notification.cells[0].value), 22.0);
+    sheet.InsertRows(0);
+    sheet.WaitForRecalc();
+    ASSERT(queue->TryPop(notification));
+    // A1 переехала в A2
+    ASSERT_EQUAL(notification.cells.size(), 1u);
+    ASSERT_EQUAL(std::get<double>(notification.cells[0].value), 11.0);
+    sheet.SetRecalcMode(RecalcMode::Lazy);
+
+    // Несколько читателей получают каждый элемент ровно один раз
+    SpmcQueue<int> numbers(64);
+    std::atomic<long long> sum = 0;
+    std::atomic<int> popped = 0;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; i++) {
+        readers.emplace_back([&] {
+            int value;
+            while (!done || popped < 10000) {
+                if (numbers.TryPop(value)) {
+                    sum += value;
+                    popped++;
+                }
+            }
+        });
+    }
+    for (int i = 1; i <= 10000; i++) {
+        while (!numbers.TryPush(int(i)));
+    }
+    done = true;
+    for (auto & reader : readers)
+        reader.join();
+    ASSERT_EQUAL(popped.load(), 10000);
+    ASSERT_EQUAL(sum.load(), 10000LL * 10001 / 2);
+}
+
+void TestStats() {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; value++)
+        histogram.Record(value);
+    ASSERT_EQUAL(histogram.Count(), 1000u);
+    ASSERT_EQUAL(histogram.Max(), 1000u);
+    ASSERT_EQUAL(histogram.Mean(), 500.5);
+    ASSERT_EQUAL(histogram.Percentile(0.01), 10u);
+    ASSERT(histogram.Percentile(0.5) >= 500 && histogram.Percentile(0.5) <= 500 + 500 / 16);
+    ASSERT_EQUAL(histogram.Percentile(1.0), 1000u);
+    for (uint64_t value : {17ull, 1000ull, 123456789ull, ~0ull}) {
+        auto bucket = LatencyHistogram::BucketOf(value);
+        ASSERT(LatencyHistogram::BucketUpperBound(bucket) >= value);
+        ASSERT(bucket == 0 || LatencyHistogram::BucketUpperBound(bucket - 1) < value);
+    }
+
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1+1");
+    sheet.SetCell("C1"_pos, "=B1*2");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(4.0));
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(4.0));
+    sheet.SetCell("A1"_pos, "5");
+    sheet.InsertRows(0);
+
+    auto stats = sheet.GetStats();
+#ifdef SPREADSHEET_STATS
+    ASSERT_EQUAL(stats[StatCounter::ParserInvocations], 2u);
+    ASSERT_EQUAL(stats[StatCounter::EdgesVisited], 3u);
+    ASSERT_EQUAL(stats[StatCounter::FormulaEvaluations], 2u);
+    ASSERT_EQUAL(stats[StatCounter::CacheMisses], 2u);
+    ASSERT_EQUAL(stats[StatCounter::CacheHits], 1u);
+    ASSERT_EQUAL(stats[StatCounter::CellsInvalidated], 2u);
+    ASSERT_EQUAL(stats[StatCounter::Writes], 5u);
+    ASSERT_EQUAL(stats[StatCounter::StructureCellsTouched], 3u);
+    ASSERT_EQUAL(stats[SheetMethod::SetCell].Count(), 4u);
+    ASSERT_EQUAL(stats[SheetMethod::InsertRows].Count(), 1u);
+    ASSERT(stats[SheetMethod::GetCell].Count() >= 2);
+    ASSERT(stats[SheetMethod::SetCell].Percentile(0.5) <= stats[SheetMethod::SetCell].Max());
+#endif
+    sheet.ResetStats();
+    stats = sheet.GetStats();
+    for (int counter = 0; counter < kStatCounters; counter++)
+        ASSERT_EQUAL(stats[static_cast<StatCounter>(counter)], 0u);
+    for (int method = 0; method < kSheetMethods; method++)
+        ASSERT_EQUAL(stats[static_cast<SheetMethod>(method)].Count(), 0u);
+}
+
+void TestTracing() {
+    auto count = [](std::string const & trace, std::string const & name) {
+        size_t found = 0;
+        for (auto pos = trace.find("\"name\":\"" + name + "\""); pos != std::string::npos; pos = trace.find("\"name\":\"" + name + "\"", pos + 1))
+            found++;
+        return found;
+    };
+
+    TraceOptions options;
+    options.evaluation_sample = 1;
+    StartTracing(options);
+    {
+        auto sheet = CreateSheet();
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1+1");
+        sheet->SetCell("C1"_pos, "=B1*2");
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), ICell::Value(4.0));
+        sheet->SetCell("A1"_pos, "2");
+        sheet->InsertRows(0);
+        std::ostringstream out;
+        sheet->PrintValues(out);
+    }
+    StopTracing();
+    CreateSheet()->SetCell("A1"_pos, "=1");
+
+    std::ostringstream out;
+    WriteTrace(out);
+    auto trace = out.str();
+    ASSERT_EQUAL(trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0u);
+    ASSERT_EQUAL(count(trace, "SetCell"), 4u);
+    ASSERT_EQUAL(count(trace, "Parse"), 2u);
+    ASSERT_EQUAL(count(trace, "AddEdge"), 2u);
+    ASSERT_EQUAL(count(trace, "CheckAcyclicity"), 2u);
+    // B1 и C1 при чтении и ещё раз при печати после правки A1
+    ASSERT_EQUAL(count(trace, "Evaluate"), 4u);
+    ASSERT_EQUAL(count(trace, "InsertRows"), 1u);
+    ASSERT_EQUAL(count(trace, "FixupFormulas"), 1u);
+    ASSERT_EQUAL(count(trace, "PrintValues"), 1u);
+    ASSERT(count(trace, "Invalidate") >= 1);
+    ASSERT(trace.find("\"name\":\"SetCell\",\"cat\":\"edit\",\"ph\":\"X\"") != std::string::npos);
+    ASSERT(trace.find("\"args\":{\"cell\":\"C1\"}") != std::string::npos);
+
+    // кольцо хранит последние события
+    options.events_per_thread = 3;
+    StartTracing(options);
+    {
+        auto sheet = CreateSheet();
+        for (int i = 0; i < 10; i++)
+            sheet->SetCell({i, 0}, std::to_string(i));
+    }
+    StopTracing();
+    out.str({});
+    WriteTrace(out);
+    trace = out.str();
+    ASSERT_EQUAL(count(trace, "SetCell"), 3u);
+    ASSERT(trace.find("\"cell\":\"A10\"") != std::string::npos);
+    ASSERT(trace.find("\"cell\":\"A7\"") == std::string::npos);
+}
+
+void TestAllocations() {
+    ASSERT_EQUAL(AllocSubsystemName(AllocSubsystem::Parse), "parse");
+    ASSERT(AllocScope::Current() == AllocSubsystem::Other);
+    {
+        AllocScope outer(AllocSubsystem::Print);
+        {
+            AllocScope inner(AllocSubsystem::Eval);
+            ASSERT(AllocScope::Current() == AllocSubsystem::Eval);
+        }
+        ASSERT(AllocScope::Current() == AllocSubsystem::Print);
+    }
+    ASSERT(AllocScope::Current() == AllocSubsystem::Other);
+
+    auto sheet = CreateSheet();
+    std::ostringstream out;
+    auto before = GetAllocationStats();
+    sheet->SetCell("A1"_pos, "1");
+    sheet->SetCell("B1"_pos, "=A1+1");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), ICell::Value(2.0));
+    sheet->PrintTexts(out);
+    auto after = GetAllocationStats();
+    auto allocated = [&](AllocSubsystem subsystem) {
+        return after[subsystem].count - before[subsystem].count;
+    };
+#ifdef SPREADSHEET_ALLOC_HOOK
+    ASSERT(allocated(AllocSubsystem::Parse) > 0);
+    ASSERT(allocated(AllocSubsystem::Graph) > 0);
+    ASSERT(allocated(AllocSubsystem::Storage) > 0);
+    ASSERT(allocated(AllocSubsystem::Print) > 0);
+    ASSERT(after[AllocSubsystem::Parse].bytes > before[AllocSubsystem::Parse].bytes);
+    uint64_t sum = 0;
+    for (auto & item : after.by_subsystem)
+        sum += item.count;
+    ASSERT_EQUAL(after.Total().count, sum);
+#else
+    ASSERT_EQUAL(after.Total().count, 0u);
+    ASSERT_EQUAL(allocated(AllocSubsystem::Parse), 0u);
+#endif
+}
+
+void TestMemoryUsage() {
+    SpreadSheet sheet;
+    auto empty = sheet.MemoryUsage();
+    ASSERT_EQUAL(empty.cells, 0u);
+    ASSERT_EQUAL(empty.formulas, 0u);
+
+    std::string long_text(1000, 'x');
+    sheet.SetCell("A1"_pos, long_text);
+    sheet.SetCell("C3"_pos, "=A1+Z100");
+    auto usage = sheet.MemoryUsage();
+    ASSERT(usage.grid >= 3 * sizeof(std::vector<std::weak_ptr<DefaultCell>>));
+    // A1, C3 и пустая Z100 за пределами таблицы
+    ASSERT_EQUAL(usage.cells, 3 * memory::SharedBytes<DefaultCell>());
+    ASSERT(usage.texts > long_text.size());
+    ASSERT(usage.formulas > sizeof(DefaultFormula));
+    ASSERT(usage.graph_vertexes > 0);
+    ASSERT(usage.graph_edges > 0);
+    ASSERT(usage.graph_cache > 0);
+    ASSERT_EQUAL(usage.Total(), usage.grid + usage.cells + usage.texts + usage.formulas
+                                + usage.graph_vertexes + usage.graph_edges + usage.graph_cache);
+    ASSERT_EQUAL(sheet.MemoryUsage().Total(), usage.Total());
+
+    sheet.ClearCell("C3"_pos);
+    auto cleared = sheet.MemoryUsage();
+    ASSERT_EQUAL(cleared.cells, memory::SharedBytes<DefaultCell>());
+    ASSERT_EQUAL(cleared.formulas, 0u);
+    // массив карты ячеек за таблицей остаётся до её роста или очистки
+    ASSERT(cleared.graph_cache <= usage.graph_cache);
+    ASSERT(cleared.Total() < usage.Total());
+
+    // Ячейки удалённых строк и столбцов, в том числе за таблицей,
+    // освобождаются, когда на них перестают ссылаться формулы
+    SpreadSheet deleted;
+    deleted.SetCell("A5"_pos, "3");
+    deleted.SetCell("A1"_pos, "=A5+A20");
+    deleted.SetCell("D1"_pos, "4");
+    deleted.SetCell("B1"_pos, "=D1+Z1");
+    deleted.DeleteRows(4, 20);
+    deleted.DeleteCols(3, 30);
+    ASSERT_EQUAL(deleted.GetCell("A1"_pos)->GetText(), "=#REF!+#REF!");
+    ASSERT_EQUAL(deleted.GetCell("B1"_pos)->GetText(), "=#REF!+#REF!");
+    deleted.SetCell("A1"_pos, "1");
+    deleted.ClearCell("B1"_pos);
+    ASSERT_EQUAL(deleted.MemoryUsage().cells, memory::SharedBytes<DefaultCell>());
+}
+
+void TestFlatMap() {
+    for (Position pos : {Position{0, 0}, Position{0, 16383}, Position{16383, 0}, Position{16383, 16383}}) {
+        ASSERT(PositionKey(pos).ToPosition() == pos);
+    }
+    ASSERT(PositionKey({1, 0}) < PositionKey({1, 1}));
+    ASSERT(PositionKey({1, 16383}) < PositionKey({2, 0}));
+
+    // сдвиг при удалении проверяется на длинных цепочках одинаковых хешей
+    struct Collide {
+        size_t operator()(int key) const {
+            return static_cast<size_t>(key % 7);
+        }
+    };
+    FlatMap<int, int, Collide> map;
+    std::map<int, int> expected;
+    uint32_t seed = 12345;
+    for (int step = 0; step < 20000; step++) {
+        seed = seed * 1103515245 + 12345;
+        int key = static_cast<int>(seed >> 16) % 300;
+        if (seed & 1) {
+            map[key] = step;
+            expected[key] = step;
+        } else {
+            ASSERT_EQUAL(map.erase(key), expected.erase(key));
+        }
+    }
+    ASSERT_EQUAL(map.size(), expected.size());
+    for (auto & [key, value] : expected)
+        ASSERT_EQUAL(map.at(key), value);
+    size_t visited = 0;
+    for (auto & [key, value] : map) {
+        ASSERT_EQUAL(expected.at(key), value);
+        visited++;
+    }
+    ASSERT_EQUAL(visited, expected.size());
+    ASSERT(map.find(1000) == map.end());
+    ASSERT(!map.try_emplace(expected.begin()->first, -1).second);
+}
+
+void TestLargeRows() {
+    SpreadSheet sheet;
+    auto far = "C1000000"_pos;
+    ASSERT_EQUAL(far, (Position{999999, 2}));
+    sheet.SetCell(far, "21");
+    sheet.SetCell("A1"_pos, "=C1000000*2");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), ICell::Value(42.0));
+    ASSERT_EQUAL(sheet.GetPrintableSize(), (Size{1000000, 3}));
+
+    auto since = sheet.GetVersion();
+    sheet.SetCell(far, "5");
+    ASSERT_EQUAL(sheet.GetChangesSince(since).cells.size(), 2u);
+
+    sheet.InsertRows(0, Position::kMaxRows - 1 - 1000000);
+    ASSERT_EQUAL(sheet.GetCell("A48576"_pos)->GetText(), "=C1048575*2");
+    ASSERT_EQUAL(sheet.GetCell("A48576"_pos)->GetValue(), ICell::Value(10.0));
+    bool caught = false;
+    try {
+        sheet.InsertRows(0);
+    } catch (TableTooBigException const &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    // пустые строки сетки не выделяют памяти
+    ASSERT(sheet.MemoryUsage().grid < (64u << 20));
+}
+
+void TestReferenceBinding() {
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "2");
+    sheet.SetCell("B1"_pos, "=A1+A1*E5");
+    sheet.SetCell("E5"_pos, "3");
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), ICell::Value(8.0));
+
+    // перезапись и очистка сохраняют объект ячейки, на который смотрит ссылка
+    sheet.SetCell("A1"_pos, "4");
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), ICell::Value(16.0));
+    sheet.ClearCell("E5"_pos);
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), ICell::Value(4.0));
+    sheet.SetCell("E5"_pos, "text");
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetValue(), ICell::Value(FormulaError(FormulaError::Category::Value)));
+    sheet.SetCell("E5"_pos, "1");
+
+    // сдвиги переносят ссылки вместе с ячейками
+    sheet.InsertRows(0, 2);
+    sheet.InsertCols(0);
+    sheet.SetCell("B3"_pos, "5");
+    ASSERT_EQUAL(sheet.GetCell("C3"_pos)->GetText(), "=B3+B3*F7");
+    ASSERT_EQUAL(sheet.GetCell("C3"_pos)->GetValue(), ICell::Value(10.0));
+    sheet.DeleteRows(0, 2);
+    sheet.SetCell("F5"_pos, "2");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(15.0));
+
+    // откат циклической формулы возвращает рёбра прежней
+    sheet.SetCell("D1"_pos, "=C1");
+    bool caught = false;
+    try {
+        sheet.SetCell("B1"_pos, "=D1+Z99");
+    } catch (CircularDependencyException const &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetText(), "5");
+    sheet.SetCell("F5"_pos, "3");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(20.0));
+    sheet.SetCell("C1"_pos, "=B1*F5");
+    caught = false;
+    try {
+        sheet.SetCell("C1"_pos, "=F5+D1");
+    } catch (CircularDependencyException const &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetText(), "=B1*F5");
+    sheet.SetCell("F5"_pos, "4");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(20.0));
+    ASSERT_EQUAL(sheet.GetCell("D1"_pos)->GetValue(), ICell::Value(20.0));
+
+    // снимок вычисляет по своим ячейкам
+    auto snapshot = sheet.Snapshot();
+    sheet.SetCell("F5"_pos, "10");
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), ICell::Value(50.0));
+    ASSERT_EQUAL(snapshot->GetCell("C1"_pos)->GetValue(), ICell::Value(20.0));
+}
+
+void TestBoxedValue() {
+    ASSERT_EQUAL(sizeof(BoxedValue), 8u);
+    for (double number : {0.0, -0.0, 1.5, -1e308, std::numeric_limits<double>::infinity(),
+                          -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min()}) {
+        BoxedValue value(number);
+        ASSERT(value.IsNumber() && !value.IsError() && !value.IsText());
+        ASSERT(value.AsNumber() == number && std::signbit(value.AsNumber()) == std::signbit(number));
+    }
+    // любой NaN, включая отрицательный, остаётся числом
+    BoxedValue nan(-std::numeric_limits<double>::quiet_NaN());
+    ASSERT(nan.IsNumber() && std::isnan(nan.AsNumber()));
+    ASSERT(nan == BoxedValue(std::numeric_limits<double>::signaling_NaN()));
+
+    for (auto category : {FormulaError::Category::Ref, FormulaError::Category::Value, FormulaError::Category::Div0}) {
+        BoxedValue error = FormulaError(category);
+        ASSERT(error.IsError() && !error.IsNumber());
+        ASSERT_EQUAL(error.AsError(), FormulaError(category));
+        ASSERT(error.ToFormulaValue() == IFormula::Value(FormulaError(category)));
+    }
+    auto text = BoxedValue::Text(0xFFFFFFFFu);
+    ASSERT(text.IsText() && !text.IsNumber() && text.TextHandle() == 0xFFFFFFFFu);
+    ASSERT(text.ToFormulaValue() == IFormula::Value(FormulaError(FormulaError::Category::Value)));
+    ASSERT(BoxedValue::From(ICell::Value("abc")).IsText());
+    ASSERT(BoxedValue::From(ICell::Value(2.5)) == BoxedValue(2.5));
+
+    SpreadSheet sheet;
+    sheet.SetCell("A1"_pos, "'=text");
+    sheet.SetCell("A2"_pos, "=A1+1");
+    sheet.SetCell("A3"_pos, "=-A4/2");
+    ASSERT(dynamic_cast<DefaultCell const *>(sheet.GetCell("A1"_pos))->GetBoxedValue().IsText());
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), ICell::Value("=text"));
+    ASSERT_EQUAL(sheet.GetCell("A2"_pos)->GetValue(), ICell::Value(FormulaError(FormulaError::Category::Value)));
+    ASSERT_EQUAL(sheet.GetCell("A3"_pos)->GetValue(), ICell::Value(-0.0));
+    sheet.SetCell("A4"_pos, "5");
+    ASSERT_EQUAL(sheet.GetCell("A3"_pos)->GetValue(), ICell::Value(-2.5));
+}
+
+void TestTextPool() {
+    TextPool pool;
+    auto hash = [](std::string_view text) { return DefaultCell::HashText(text); };
+    ASSERT_EQUAL(pool.Intern("", hash("")), TextPool::kNoText);
+    auto first = pool.Intern("north", hash("north"));
+    ASSERT_EQUAL(pool.Intern("north", hash("north")), first);
+    ASSERT_EQUAL(pool.size(), 1u);
+    pool.Release(first);
+    ASSERT_EQUAL(pool.View(first), "north");
+    pool.Release(first);
+    ASSERT_EQUAL(pool.size(), 0u);
+    // номер освободившегося текста достаётся следующему
+    ASSERT_EQUAL(pool.Intern("south", hash("south")), first);
+    pool.Release(first);
+
+    std::vector<TextPool::Handle> handles;
+    for (int i = 0; i < 1000; i++) {
+        auto text = "text" + std::to_string(i);
+        handles.push_back(pool.Intern(text, hash(text)));
+    }
+    for (int i = 0; i < 1000; i += 2)
+        pool.Release(handles[i]);
+    ASSERT_EQUAL(pool.size(), 500u);
+    for (int i = 1; i < 1000; i += 2) {
+        auto text = "text" + std::to_string(i);
+        ASSERT_EQUAL(pool.View(handles[i]), text);
+        ASSERT_EQUAL(pool.Intern(text, hash(text)), handles[i]);
+    }
+
+    SpreadSheet sheet;
+    std::string region = "region-north-east-1";
+    for (int row = 0; row < 1000; row++) {
+        sheet.SetCell({row, 0}, region);
+        sheet.SetCell({row, 1}, row % 2 ? "AAPL" : "'=MSFT");
+    }
+    auto usage = sheet.MemoryUsage();
+    ASSERT(usage.texts < 1000);
+    auto cell = [&](Position pos) { return dynamic_cast<DefaultCell const *>(sheet.GetCell(pos)); };
+    ASSERT(cell({0, 0})->GetRawText().data() == cell({999, 0})->GetRawText().data());
+    ASSERT_EQUAL(cell({0, 1})->GetRawText(), "'=MSFT");
+    ASSERT_EQUAL(cell({0, 1})->GetTextValue(), "=MSFT");
+    ASSERT_EQUAL(sheet.GetCell({0, 1})->GetValue(), ICell::Value("=MSFT"));
+    ASSERT(cell({1, 1})->GetBoxedValue() == cell({3, 1})->GetBoxedValue());
+    ASSERT(cell({1, 1})->GetBoxedValue() != cell({0, 1})->GetBoxedValue());
+
+    // откат циклической формулы возвращает прежний текст
+    sheet.SetCell("C1"_pos, "=A1");
+    bool caught = false;
+    try {
+        sheet.SetCell("A1"_pos, "=C1");
+    } catch (CircularDependencyException const &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetText(), region);
+    ASSERT(sheet.GetCell("A1"_pos)->GetText() == sheet.GetCell("A2"_pos)->GetText());
+
+    for (int row = 0; row < 1000; row++)
+        sheet.SetCell({row, 0}, "distinct-row-text-" + std::to_string(row));
+    auto distinct = sheet.MemoryUsage().texts;
+    ASSERT(distinct > usage.texts + 1000 * 16);
+    for (int row = 0; row < 1000; row++)
+        sheet.ClearCell({row, 0});
+    ASSERT(sheet.MemoryUsage().texts + 1000 * 16 < distinct);
+    ASSERT_EQUAL(sheet.GetCell("B2"_pos)->GetText(), "AAPL");
+
+    // тексты чисел в пул не попадают: короткие хранятся в ячейке, длинные - в куче
+    SpreadSheet numbers;
+    auto empty_texts = numbers.MemoryUsage().texts;
+    for (int row = 0; row < 1000; row++)
+        numbers.SetCell({row, 0}, std::to_string(row * 7919));
+    ASSERT_EQUAL(numbers.MemoryUsage().texts, empty_texts);
+    std::string long_number = "3.14159265358979323846";
+    numbers.SetCell("B1"_pos, long_number);
+    ASSERT_EQUAL(numbers.MemoryUsage().texts, empty_texts + long_number.size());
+    ASSERT_EQUAL(numbers.GetCell("B1"_pos)->GetText(), long_number);
+    ASSERT_EQUAL(numbers.GetCell("A3"_pos)->GetValue(), ICell::Value(2.0 * 7919));
+    auto number_cell = dynamic_cast<DefaultCell const *>(numbers.GetCell("B1"_pos));
+    ASSERT(number_cell->HasSameText(long_number));
+    ASSERT(!number_cell->HasSameText("3.14"));
+    ASSERT_EQUAL(number_cell->GetTextHash(), DefaultCell::HashText(long_number));
+    numbers.SetCell("C1"_pos, "=B1");
+    caught = false;
+    try {
+        numbers.SetCell("B1"_pos, "=C1");
+    } catch (CircularDependencyException const &) {
+        caught = true;
+    }
+    ASSERT(caught);
+    ASSERT_EQUAL(numbers.GetCell("B1"_pos)->GetText(), long_number);
+}
+
 void Test002() {
     auto sheet= CreateSheet();
     bool caught= false;
@@ -834,6 +2190,28 @@ int main() {
 //  RUN_TEST(tr, TestNonExistentCell);
 
   RUN_TEST(tr, Test001);
+  RUN_TEST(tr, TestDecimalLiterals);
+  RUN_TEST(tr, TestNumberFormat);
+  RUN_TEST(tr, TestExpressionCache);
+  RUN_TEST(tr, TestImport);
+  RUN_TEST(tr, TestSnapshot);
+  RUN_TEST(tr, TestExport);
+  RUN_TEST(tr, TestJournal);
+  RUN_TEST(tr, TestChangeSet);
+  RUN_TEST(tr, TestConcurrentReads);
+  RUN_TEST(tr, TestSheetSnapshot);
+  RUN_TEST(tr, TestBatch);
+  RUN_TEST(tr, TestAsyncRecalc);
+  RUN_TEST(tr, TestSubscriptions);
+  RUN_TEST(tr, TestStats);
+  RUN_TEST(tr, TestTracing);
+  RUN_TEST(tr, TestAllocations);
+  RUN_TEST(tr, TestMemoryUsage);
+  RUN_TEST(tr, TestFlatMap);
+  RUN_TEST(tr, TestLargeRows);
+    RUN_TEST(tr, TestReferenceBinding);
+    RUN_TEST(tr, TestBoxedValue);
+    RUN_TEST(tr, TestTextPool);
   RUN_TEST(tr, Test002);
   RUN_TEST(tr, Test003);
 //  RUN_TEST(tr, Test004);